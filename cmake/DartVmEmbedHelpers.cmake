@@ -1,9 +1,12 @@
 include(CMakeParseArguments)
 
+set(_DARTVM_EMBED_HELPERS_DIR "${CMAKE_CURRENT_LIST_DIR}")
+
 function(dartvm_embed_add_program_target target_name)
   set(options)
-  set(one_value_args DART_FILE OUTPUT PUBSPEC_DIR WORKING_DIRECTORY FLAVOR)
-  set(multi_value_args EXTRA_INPUTS)
+  set(one_value_args DART_FILE OUTPUT PUBSPEC_DIR WORKING_DIRECTORY FLAVOR
+      EMBED_SYMBOL)
+  set(multi_value_args EXTRA_INPUTS TRAINING_ARGS)
   cmake_parse_arguments(DVE "${options}" "${one_value_args}" "${multi_value_args}" ${ARGN})
 
   if(NOT DVE_DART_FILE)
@@ -21,8 +24,12 @@ function(dartvm_embed_add_program_target target_name)
   if(NOT DVE_FLAVOR)
     set(DVE_FLAVOR "${DARTVM_EMBED_DEFAULT_FLAVOR}")
   endif()
-  if(NOT DVE_FLAVOR STREQUAL "jit" AND NOT DVE_FLAVOR STREQUAL "aot")
-    message(FATAL_ERROR "dartvm_embed_add_program_target: FLAVOR must be jit|aot")
+  if(NOT DVE_FLAVOR STREQUAL "jit" AND NOT DVE_FLAVOR STREQUAL "aot" AND
+     NOT DVE_FLAVOR STREQUAL "appjit")
+    message(FATAL_ERROR "dartvm_embed_add_program_target: FLAVOR must be jit|aot|appjit")
+  endif()
+  if(DVE_TRAINING_ARGS AND NOT DVE_FLAVOR STREQUAL "appjit")
+    message(FATAL_ERROR "dartvm_embed_add_program_target: TRAINING_ARGS requires FLAVOR appjit")
   endif()
 
   if(NOT EXISTS "${DARTVM_EMBED_DART_BIN}")
@@ -99,6 +106,20 @@ function(dartvm_embed_add_program_target target_name)
       COMMENT "Generating app-aot-elf snapshot (${target_name})"
       VERBATIM
     )
+  elseif(DVE_FLAVOR STREQUAL "appjit")
+    # The training run executes main() with TRAINING_ARGS; code compiled
+    # during that run is captured in the snapshot.
+    add_custom_command(
+      OUTPUT "${DVE_OUTPUT}"
+      COMMAND "${DARTVM_EMBED_DART_BIN}" compile jit-snapshot
+              -o "${DVE_OUTPUT}"
+              "${DVE_DART_FILE}"
+              ${DVE_TRAINING_ARGS}
+      WORKING_DIRECTORY "${DVE_WORKING_DIRECTORY}"
+      DEPENDS ${_deps}
+      COMMENT "Generating AppJIT snapshot with training run (${target_name})"
+      VERBATIM
+    )
   else()
     add_custom_command(
       OUTPUT "${DVE_OUTPUT}"
@@ -114,4 +135,36 @@ function(dartvm_embed_add_program_target target_name)
 
   add_custom_target(${target_name} DEPENDS "${DVE_OUTPUT}")
   set_property(TARGET ${target_name} PROPERTY DARTVM_EMBED_PROGRAM_PATH "${DVE_OUTPUT}")
+
+  # EMBED_SYMBOL: also emit <target_name>_object, an OBJECT library that links
+  # the program bytes into the executable as <EMBED_SYMBOL>/<EMBED_SYMBOL>Size.
+  if(DVE_EMBED_SYMBOL)
+    if(NOT UNIX OR APPLE)
+      message(FATAL_ERROR "dartvm_embed_add_program_target: EMBED_SYMBOL is only supported on Linux")
+    endif()
+    if(DVE_FLAVOR STREQUAL "appjit")
+      message(FATAL_ERROR "dartvm_embed_add_program_target: EMBED_SYMBOL does not support FLAVOR appjit")
+    endif()
+    get_property(_enabled_languages GLOBAL PROPERTY ENABLED_LANGUAGES)
+    if(NOT "ASM" IN_LIST _enabled_languages)
+      enable_language(ASM)
+    endif()
+
+    set(DVE_INCBIN_FILE "${DVE_OUTPUT}")
+    set(DVE_INCBIN_SYMBOL "${DVE_EMBED_SYMBOL}")
+    # Keep ELF images page aligned, as they are in on-disk snapshots.
+    if(DVE_FLAVOR STREQUAL "aot")
+      set(DVE_INCBIN_ALIGNMENT 4096)
+    else()
+      set(DVE_INCBIN_ALIGNMENT 64)
+    endif()
+    set(_embed_asm "${CMAKE_CURRENT_BINARY_DIR}/${target_name}_embed.S")
+    configure_file("${_DARTVM_EMBED_HELPERS_DIR}/DartVmEmbedIncbin.S.in"
+      "${_embed_asm}" @ONLY)
+    set_source_files_properties("${_embed_asm}" PROPERTIES
+      OBJECT_DEPENDS "${DVE_OUTPUT}")
+
+    add_library(${target_name}_object OBJECT "${_embed_asm}")
+    add_dependencies(${target_name}_object ${target_name})
+  endif()
 endfunction()
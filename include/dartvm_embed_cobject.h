@@ -0,0 +1,240 @@
+#pragma once
+
+// C++17 helpers for posting structured data to Dart ports without a heap
+// allocation per Dart_CObject node.
+//
+// Structs are marshalled from compile-time field descriptors: specialize
+// dartvm_embed::CObjectFields with a tuple of member pointers, and each
+// value becomes a Dart List of its fields in that order.
+//
+//   struct Sample { int64_t ts; double value; std::string tag; };
+//   template <>
+//   struct dartvm_embed::CObjectFields<Sample> {
+//     static constexpr auto kFields =
+//         std::make_tuple(&Sample::ts, &Sample::value, &Sample::tag);
+//   };
+//
+//   dartvm_embed::CObjectArena arena;
+//   dartvm_embed::PostBatch(port, samples.data(), samples.size(), &arena);
+//   arena.Reset();  // Keeps its blocks for the next batch.
+//
+// Supported field types: bool, integers (up to 32-bit signed as int32,
+// otherwise int64; uint64_t is reinterpreted), floating point, std::string,
+// std::string_view, const char*, std::vector<uint8_t> (Uint8List, not copied
+// until posted), std::vector of any supported type, and structs with their
+// own CObjectFields. Requires the Dart SDK's runtime/include directory on the
+// include path.
+
+#include <dart_native_api.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dartvm_embed_lib.h"
+
+namespace dartvm_embed {
+
+// Bump allocator for Dart_CObject graphs. Reset() rewinds without freeing, so
+// a reused arena stops allocating once it has grown to the largest batch.
+// Graphs built from it stay valid until the next Reset(). Not thread-safe.
+class CObjectArena {
+ public:
+  explicit CObjectArena(size_t block_size = 16 * 1024)
+      : block_size_(block_size) {}
+
+  CObjectArena(const CObjectArena&) = delete;
+  CObjectArena& operator=(const CObjectArena&) = delete;
+
+  void* Allocate(size_t size, size_t align) {
+    while (current_ < blocks_.size()) {
+      Block& block = blocks_[current_];
+      const uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+      const size_t start =
+          ((base + offset_ + align - 1) & ~(uintptr_t{align} - 1)) - base;
+      if (start + size <= block.size) {
+        offset_ = start + size;
+        return block.data.get() + start;
+      }
+      ++current_;
+      offset_ = 0;
+    }
+    const size_t block_size = std::max(block_size_, size + align);
+    blocks_.push_back(Block{std::make_unique<std::byte[]>(block_size),
+                            block_size});
+    current_ = blocks_.size() - 1;
+    offset_ = 0;
+    return Allocate(size, align);
+  }
+
+  Dart_CObject* NewObject() {
+    auto* object = static_cast<Dart_CObject*>(
+        Allocate(sizeof(Dart_CObject), alignof(Dart_CObject)));
+    memset(object, 0, sizeof(*object));
+    return object;
+  }
+
+  Dart_CObject** NewArray(size_t length) {
+    return static_cast<Dart_CObject**>(
+        Allocate(sizeof(Dart_CObject*) * (length > 0 ? length : 1),
+                 alignof(Dart_CObject*)));
+  }
+
+  const char* CopyString(std::string_view text) {
+    char* copy = static_cast<char*>(Allocate(text.size() + 1, 1));
+    memcpy(copy, text.data(), text.size());
+    copy[text.size()] = '\0';
+    return copy;
+  }
+
+  void Reset() {
+    current_ = 0;
+    offset_ = 0;
+  }
+
+  // Bytes reserved across all blocks.
+  size_t capacity() const {
+    size_t total = 0;
+    for (const Block& block : blocks_) {
+      total += block.size;
+    }
+    return total;
+  }
+
+ private:
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  std::vector<Block> blocks_;
+  size_t current_ = 0;
+  size_t offset_ = 0;
+  size_t block_size_;
+};
+
+// Specialize with `static constexpr auto kFields = std::make_tuple(&T::a,
+// &T::b, ...);` to make T marshallable.
+template <typename T>
+struct CObjectFields;
+
+namespace internal {
+
+template <typename T, typename = void>
+struct HasCObjectFields : std::false_type {};
+
+template <typename T>
+struct HasCObjectFields<T, std::void_t<decltype(CObjectFields<T>::kFields)>>
+    : std::true_type {};
+
+template <typename T>
+struct IsVector : std::false_type {};
+
+template <typename T, typename A>
+struct IsVector<std::vector<T, A>> : std::true_type {};
+
+template <typename T>
+struct DependentFalse : std::false_type {};
+
+}  // namespace internal
+
+template <typename T>
+Dart_CObject* Marshal(const T& value, CObjectArena* arena);
+
+namespace internal {
+
+template <typename T, typename Tuple, size_t... I>
+void MarshalFields(const T& value,
+                   const Tuple& fields,
+                   Dart_CObject** out,
+                   CObjectArena* arena,
+                   std::index_sequence<I...>) {
+  ((out[I] = Marshal(value.*(std::get<I>(fields)), arena)), ...);
+}
+
+}  // namespace internal
+
+// Builds the Dart_CObject graph for |value| in |arena|.
+template <typename T>
+Dart_CObject* Marshal(const T& value, CObjectArena* arena) {
+  Dart_CObject* object = arena->NewObject();
+  if constexpr (std::is_same_v<T, bool>) {
+    object->type = Dart_CObject_kBool;
+    object->value.as_bool = value;
+  } else if constexpr (std::is_integral_v<T>) {
+    if constexpr (std::is_signed_v<T> && sizeof(T) <= sizeof(int32_t)) {
+      object->type = Dart_CObject_kInt32;
+      object->value.as_int32 = static_cast<int32_t>(value);
+    } else {
+      object->type = Dart_CObject_kInt64;
+      object->value.as_int64 = static_cast<int64_t>(value);
+    }
+  } else if constexpr (std::is_floating_point_v<T>) {
+    object->type = Dart_CObject_kDouble;
+    object->value.as_double = static_cast<double>(value);
+  } else if constexpr (std::is_same_v<T, std::string> ||
+                       std::is_same_v<T, std::string_view>) {
+    object->type = Dart_CObject_kString;
+    object->value.as_string = arena->CopyString(value);
+  } else if constexpr (std::is_same_v<T, const char*> ||
+                       std::is_same_v<T, char*>) {
+    if (value == nullptr) {
+      object->type = Dart_CObject_kNull;
+    } else {
+      object->type = Dart_CObject_kString;
+      object->value.as_string = arena->CopyString(value);
+    }
+  } else if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+    object->type = Dart_CObject_kTypedData;
+    object->value.as_typed_data.type = Dart_TypedData_kUint8;
+    object->value.as_typed_data.length = static_cast<intptr_t>(value.size());
+    object->value.as_typed_data.values = value.data();
+  } else if constexpr (internal::IsVector<T>::value) {
+    Dart_CObject** values = arena->NewArray(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+      values[i] = Marshal(value[i], arena);
+    }
+    object->type = Dart_CObject_kArray;
+    object->value.as_array.length = static_cast<intptr_t>(value.size());
+    object->value.as_array.values = values;
+  } else if constexpr (internal::HasCObjectFields<T>::value) {
+    constexpr auto& fields = CObjectFields<T>::kFields;
+    constexpr size_t kCount =
+        std::tuple_size_v<std::decay_t<decltype(fields)>>;
+    Dart_CObject** values = arena->NewArray(kCount);
+    internal::MarshalFields(value, fields, values, arena,
+                            std::make_index_sequence<kCount>());
+    object->type = Dart_CObject_kArray;
+    object->value.as_array.length = static_cast<intptr_t>(kCount);
+    object->value.as_array.values = values;
+  } else {
+    static_assert(internal::DependentFalse<T>::value,
+                  "type has no Dart_CObject mapping; specialize CObjectFields");
+  }
+  return object;
+}
+
+// Marshals count items into |arena| and posts them to |port| as a single
+// message (a Dart List with one element per item).
+template <typename T>
+DartVmEmbedStatus PostBatch(Dart_Port port,
+                            const T* items,
+                            size_t count,
+                            CObjectArena* arena) {
+  Dart_CObject** objects = arena->NewArray(count);
+  for (size_t i = 0; i < count; ++i) {
+    objects[i] = Marshal(items[i], arena);
+  }
+  return DartVmEmbed_PostCObjectBatch(port, objects,
+                                      static_cast<intptr_t>(count));
+}
+
+}  // namespace dartvm_embed
@@ -4,6 +4,7 @@
 
 typedef struct _Dart_Isolate* Dart_Isolate;
 typedef struct _Dart_Handle* Dart_Handle;
+typedef struct _Dart_CObject Dart_CObject;
 typedef bool (*DartVmEmbedFileModifiedCallback)(const char* url, int64_t since);
 
 #if defined(_WIN32)
@@ -16,26 +17,395 @@ typedef bool (*DartVmEmbedFileModifiedCallback)(const char* url, int64_t since);
   #define DARTVM_EMBED_LIB_EXPORT
 #endif
 
+// Declares the symbols emitted by
+// dartvm_embed_add_program_target(... EMBED_SYMBOL <symbol>).
+#define DARTVM_EMBED_DECLARE_PROGRAM(symbol) \
+  extern "C" const uint8_t symbol[];         \
+  extern "C" const int64_t symbol##Size
+
 extern "C" {
 
+// CPU set and preferred NUMA node for a thread (Linux). cpu_count == 0 with
+// numa_node >= 0 selects every CPU of that node; numa_node == -1 leaves the
+// memory policy alone. Memory is preferred, not bound, to the node.
+struct DartVmEmbedPlacement {
+  const int* cpus;
+  int cpu_count;
+  int numa_node;
+
+  DartVmEmbedPlacement() : cpus(nullptr), cpu_count(0), numa_node(-1) {}
+};
+
 struct DartVmEmbedInitConfig {
   bool start_kernel_isolate;
+  // JIT only. Defers the kernel isolate until the first source compile
+  // (CreateIsolateFromSource, spawnUri of a .dart file, a reload) or
+  // DartVmEmbed_PrestartKernelService.
+  bool lazy_kernel_isolate;
   const uint8_t* vm_snapshot_data_override;
   const uint8_t* vm_snapshot_instructions_override;
   int vm_flag_count;
   const char** vm_flags;
+  // Optional vm_platform_strong.dill path, mapped once and shared. Falls back
+  // to DARTVM_EMBED_PLATFORM_DILL_PATH, the platform embedded at build time,
+  // then the runtime's built-in platform.
+  const char* platform_kernel_path;
+  // Optional placement for threads the VM starts itself (worker pool,
+  // background compiler, GC helpers).
+  DartVmEmbedPlacement vm_thread_placement;
+  // Creates the VM service isolate, which CPU profiling and hot reload need.
+  // DARTVM_EMBED_VM_SERVICE and DARTVM_EMBED_HOT_RELOAD override it.
+  bool enable_service_isolate;
+  // Worker threads shared by all native ports (DartVmEmbed_NewNativePort).
+  // <= 0 selects one per hardware thread.
+  int native_port_threads;
 
   DartVmEmbedInitConfig()
       : start_kernel_isolate(true),
+        lazy_kernel_isolate(true),
         vm_snapshot_data_override(nullptr),
         vm_snapshot_instructions_override(nullptr),
         vm_flag_count(0),
-        vm_flags(nullptr) {}
+        vm_flags(nullptr),
+        platform_kernel_path(nullptr),
+        enable_service_isolate(true),
+        native_port_threads(0) {}
 };
 
 // Opaque handle returned by AOT ELF loader.
 typedef void* DartVmEmbedAotElfHandle;
 
+// Stable numeric status codes reported by the *Ex APIs. Values are never
+// renumbered; new codes are appended.
+typedef enum {
+  DARTVM_EMBED_STATUS_OK = 0,
+  DARTVM_EMBED_STATUS_INVALID_ARGUMENT = 1,
+  DARTVM_EMBED_STATUS_UNSUPPORTED = 2,
+  DARTVM_EMBED_STATUS_IO_ERROR = 3,
+  DARTVM_EMBED_STATUS_INVALID_PROGRAM = 4,
+  DARTVM_EMBED_STATUS_OUT_OF_MEMORY = 5,
+  DARTVM_EMBED_STATUS_VM_INIT_FAILED = 6,
+  DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED = 7,
+  DARTVM_EMBED_STATUS_COMPILE_ERROR = 8,
+  DARTVM_EMBED_STATUS_UNHANDLED_EXCEPTION = 9,
+  DARTVM_EMBED_STATUS_DART_ERROR = 10,
+  DARTVM_EMBED_STATUS_FAILED = 11,
+  DARTVM_EMBED_STATUS_TIMEOUT = 12,
+  DARTVM_EMBED_STATUS_QUOTA_EXCEEDED = 13,
+} DartVmEmbedStatus;
+
+// Scalar value passed to and returned from DartVmEmbed_InvokeBatch.
+typedef enum {
+  DARTVM_EMBED_VALUE_NULL = 0,
+  DARTVM_EMBED_VALUE_BOOL = 1,
+  DARTVM_EMBED_VALUE_INT64 = 2,
+  DARTVM_EMBED_VALUE_DOUBLE = 3,
+} DartVmEmbedValueType;
+
+struct DartVmEmbedValue {
+  DartVmEmbedValueType type;
+  union {
+    bool as_bool;
+    int64_t as_int64;
+    double as_double;
+  };
+};
+
+// Placement of an isolate as last observed by the embedder.
+struct DartVmEmbedPlacementReport {
+  int numa_node;          // requested node, -1 if none
+  int cpu_count;          // size of the requested CPU set, 0 if unpinned
+  int last_cpu;           // CPU of the last embedder entry, -1 if unknown
+  int last_numa_node;     // NUMA node of last_cpu, -1 if unknown
+  int vm_threads_placed;  // VM-started threads placed so far (process-wide)
+
+  DartVmEmbedPlacementReport()
+      : numa_node(-1),
+        cpu_count(0),
+        last_cpu(-1),
+        last_numa_node(-1),
+        vm_threads_placed(0) {}
+};
+
+// Multi-tenant isolate manager. Each tenant owns one isolate created from its
+// program on first acquire and recreated transparently after eviction.
+typedef struct DartVmEmbedTenantManager DartVmEmbedTenantManager;
+
+// Called after a tenant's isolate is (re)created, before it is handed out;
+// returning false discards the isolate. Runs without the manager lock.
+typedef bool (*DartVmEmbedTenantInitCallback)(void* user_data,
+                                              const char* tenant_id,
+                                              Dart_Isolate isolate);
+
+struct DartVmEmbedTenantManagerConfig {
+  // When process RSS is above this many bytes, idle isolates are evicted in
+  // LRU order until their heap usage covers the excess. 0 disables eviction.
+  int64_t rss_watermark_bytes;
+  // Heap quota for tenants registered without one. 0 means unlimited.
+  int64_t default_heap_quota_bytes;
+  DartVmEmbedTenantInitCallback on_isolate_created;
+  void* user_data;
+
+  DartVmEmbedTenantManagerConfig()
+      : rss_watermark_bytes(0),
+        default_heap_quota_bytes(0),
+        on_isolate_created(nullptr),
+        user_data(nullptr) {}
+};
+
+struct DartVmEmbedTenantStats {
+  bool resident;
+  bool busy;
+  int64_t heap_used_bytes;   // new + old space, including external
+  int64_t heap_quota_bytes;
+  int64_t creations;
+  int64_t evictions;         // watermark evictions
+  int64_t quota_kills;
+
+  DartVmEmbedTenantStats()
+      : resident(false),
+        busy(false),
+        heap_used_bytes(0),
+        heap_quota_bytes(0),
+        creations(0),
+        evictions(0),
+        quota_kills(0) {}
+};
+
+// Upper bounds of the creation latency histogram buckets, in seconds:
+// 0.0005 0.001 0.002 0.005 0.01 0.025 0.05 0.1 0.25 0.5 1 +Inf.
+#define DARTVM_EMBED_CREATION_LATENCY_BUCKETS 12
+
+// Aggregated embedder metrics; rates come from the *_total counters. Counts
+// cover root isolates created through the public API, and any create call
+// that returns no isolate is a creation failure.
+struct DartVmEmbedMetricsSnapshot {
+  int64_t isolates_alive;
+  int64_t isolate_creations_total;
+  int64_t isolate_creation_failures_total;
+  int64_t isolate_shutdowns_total;
+  int64_t kernel_buffer_bytes;
+  int64_t loaded_aot_elfs;
+  int64_t reload_file_checks_total;
+  int64_t service_warmups_total;
+  int64_t service_warmup_retries_total;
+  // Per-bucket (non-cumulative) counts of successful creations.
+  int64_t creation_latency_buckets[DARTVM_EMBED_CREATION_LATENCY_BUCKETS];
+  int64_t creation_latency_sum_ns;
+  // Isolates initialized inside an existing group (Isolate.spawn) and the
+  // embedder setup time they took.
+  int64_t isolate_spawns_total;
+  int64_t isolate_spawn_setup_ns_total;
+
+  DartVmEmbedMetricsSnapshot()
+      : isolates_alive(0),
+        isolate_creations_total(0),
+        isolate_creation_failures_total(0),
+        isolate_shutdowns_total(0),
+        kernel_buffer_bytes(0),
+        loaded_aot_elfs(0),
+        reload_file_checks_total(0),
+        service_warmups_total(0),
+        service_warmup_retries_total(0),
+        creation_latency_buckets(),
+        creation_latency_sum_ns(0),
+        isolate_spawns_total(0),
+        isolate_spawn_setup_ns_total(0) {}
+};
+
+struct DartVmEmbedHeapSamplingConfig {
+  // Mean bytes allocated between samples.
+  int64_t sampling_interval_bytes;
+  // Distinct (class, stack) entries kept; further stacks are folded into one
+  // overflow entry.
+  int32_t max_stacks;
+  // Native frames captured per sample, at most 64. 0 records the class only.
+  int32_t max_frames;
+
+  DartVmEmbedHeapSamplingConfig()
+      : sampling_interval_bytes(512 * 1024), max_stacks(4096), max_frames(32) {}
+};
+
+struct DartVmEmbedHeapSamplingStats {
+  bool active;
+  int64_t samples_total;
+  int64_t live_samples;
+  int64_t live_sampled_bytes;
+  int64_t stacks;
+  int64_t overflow_samples;
+
+  DartVmEmbedHeapSamplingStats()
+      : active(false),
+        samples_total(0),
+        live_samples(0),
+        live_sampled_bytes(0),
+        stacks(0),
+        overflow_samples(0) {}
+};
+
+struct DartVmEmbedCpuProfileConfig {
+  // Profiler sampling period in microseconds (VM flag profile_period).
+  int32_t sample_period_us;
+
+  DartVmEmbedCpuProfileConfig() : sample_period_us(1000) {}
+};
+
+typedef enum {
+  DARTVM_EMBED_CPU_PROFILE_PPROF = 0,
+  // One "root;...;leaf count" line per distinct stack (flamegraph.pl input).
+  DARTVM_EMBED_CPU_PROFILE_COLLAPSED = 1,
+} DartVmEmbedCpuProfileFormat;
+
+// Sizes of the embedder's per-isolate bookkeeping and the cost of its lock.
+// Each size returns to its baseline once the isolates holding it shut down,
+// so growth across churn is a leak.
+struct DartVmEmbedEmbedderStats {
+  int64_t tracked_isolates;
+  int64_t owned_isolates;
+  int64_t callback_owned_isolate_data;
+  int64_t callback_owned_group_data;
+  int64_t group_setup_caches;
+  int64_t kernel_buffers;
+  int64_t loaded_aot_elfs;
+  int64_t app_jit_snapshots;
+  int64_t app_snapshots;
+  int64_t prepared_call_isolates;
+  int64_t warmed_isolates;
+  int64_t isolate_placements;
+  int64_t message_notify_fds;
+  int64_t native_ports;
+  int64_t lock_acquisitions;
+  int64_t lock_contentions;
+  int64_t lock_wait_ns;
+
+  DartVmEmbedEmbedderStats()
+      : tracked_isolates(0),
+        owned_isolates(0),
+        callback_owned_isolate_data(0),
+        callback_owned_group_data(0),
+        group_setup_caches(0),
+        kernel_buffers(0),
+        loaded_aot_elfs(0),
+        app_jit_snapshots(0),
+        app_snapshots(0),
+        prepared_call_isolates(0),
+        warmed_isolates(0),
+        isolate_placements(0),
+        message_notify_fds(0),
+        native_ports(0),
+        lock_acquisitions(0),
+        lock_contentions(0),
+        lock_wait_ns(0) {}
+};
+
+typedef enum {
+  // Not available: AOT runtime, start_kernel_isolate=false or no VM.
+  DARTVM_EMBED_KERNEL_SERVICE_DISABLED = 0,
+  // Deferred until the first compile or DartVmEmbed_PrestartKernelService.
+  DARTVM_EMBED_KERNEL_SERVICE_NOT_STARTED = 1,
+  DARTVM_EMBED_KERNEL_SERVICE_STARTING = 2,
+  DARTVM_EMBED_KERNEL_SERVICE_RUNNING = 3,
+} DartVmEmbedKernelServiceState;
+
+// Times are nanoseconds; -1 when the event has not happened yet.
+// start_requested_ns is measured from DartVmEmbed_Initialize, startup_ns from
+// the start request to the kernel isolate being runnable.
+struct DartVmEmbedKernelServiceStats {
+  DartVmEmbedKernelServiceState state;
+  bool lazy;
+  int64_t start_requested_ns;
+  int64_t startup_ns;
+
+  DartVmEmbedKernelServiceStats()
+      : state(DARTVM_EMBED_KERNEL_SERVICE_DISABLED),
+        lazy(false),
+        start_requested_ns(-1),
+        startup_ns(-1) {}
+};
+
+// Host function bound to a dart:ffi @Native declaration. args_n is the
+// native arity the VM asks for, or -1 to accept any.
+struct DartVmEmbedFfiNative {
+  const char* name;
+  void* function;
+  intptr_t args_n;
+};
+
+// How a native port's handler runs on the port's worker threads.
+typedef enum {
+  // One worker; messages are handled one at a time in arrival order.
+  DARTVM_EMBED_NATIVE_PORT_SERIAL = 0,
+  // `threads` workers share one queue; no ordering between messages.
+  DARTVM_EMBED_NATIVE_PORT_PARALLEL = 1,
+  // `threads` serial lanes; messages with the same key keep their order.
+  DARTVM_EMBED_NATIVE_PORT_KEYED = 2,
+} DartVmEmbedNativePortConcurrency;
+
+// Runs on a native port pool thread, with no isolate entered. message is a copy
+// owned by the embedder and valid until the handler returns; replies go out
+// with Dart_PostCObject to a SendPort carried in the message.
+typedef void (*DartVmEmbedNativePortHandler)(void* user_data,
+                                             int64_t port,
+                                             Dart_CObject* message);
+
+// Ordering key of a message on a KEYED port. Runs on the VM's delivery
+// thread, so it should only inspect the message.
+typedef int64_t (*DartVmEmbedNativePortKeyFunction)(void* user_data,
+                                                    Dart_CObject* message);
+
+// name (nullable, unique among open ports) registers the port for lookup.
+// threads caps concurrent handlers for PARALLEL and is the lane count for
+// KEYED; key defaults to a List message's first int or String element.
+struct DartVmEmbedNativePortConfig {
+  const char* name;
+  DartVmEmbedNativePortHandler handler;
+  void* user_data;
+  DartVmEmbedNativePortConcurrency concurrency;
+  int threads;
+  DartVmEmbedNativePortKeyFunction key;
+
+  DartVmEmbedNativePortConfig()
+      : name(nullptr),
+        handler(nullptr),
+        user_data(nullptr),
+        concurrency(DARTVM_EMBED_NATIVE_PORT_SERIAL),
+        threads(1),
+        key(nullptr) {}
+};
+
+// queue_depth is the number of messages waiting for a worker right now;
+// queue wait runs from delivery to the handler starting. messages_dropped
+// counts messages still queued when the port was closed.
+struct DartVmEmbedNativePortStats {
+  int64_t queue_depth;
+  int64_t max_queue_depth;
+  int64_t messages_handled;
+  int64_t messages_dropped;
+  int64_t queue_wait_ns_total;
+  int64_t queue_wait_ns_max;
+  int64_t handler_ns_total;
+  int64_t handler_ns_max;
+
+  DartVmEmbedNativePortStats()
+      : queue_depth(0),
+        max_queue_depth(0),
+        messages_handled(0),
+        messages_dropped(0),
+        queue_wait_ns_total(0),
+        queue_wait_ns_max(0),
+        handler_ns_total(0),
+        handler_ns_max(0) {}
+};
+
+// Opaque entry point resolved by DartVmEmbed_PrepareCall.
+typedef struct DartVmEmbedPreparedCall DartVmEmbedPreparedCall;
+
+// Entry point of a forked fork-server worker. Runs in the child before the VM
+// is initialized there; its return value becomes the child's exit code.
+typedef int (*DartVmEmbedForkWorkerMain)(void* user_data,
+                                         const uint8_t* request,
+                                         intptr_t request_size);
+
 // Initializes embedder + Dart VM.
 // Returns true on success. On error, *error receives malloc-allocated message.
 DARTVM_EMBED_LIB_EXPORT bool DartVmEmbed_Initialize(
@@ -76,8 +446,29 @@ DARTVM_EMBED_LIB_EXPORT Dart_Isolate DartVmEmbed_CreateIsolateFromAppSnapshot(
     void* isolate_data,
     char** error);
 
+// Writes an AppJIT snapshot of a warmed, idle isolate into cache_dir, named
+// after a hash of its group's kernel. JIT only. Returns true on success.
+DARTVM_EMBED_LIB_EXPORT bool DartVmEmbed_SaveAppJitSnapshot(
+    Dart_Isolate isolate,
+    const char* cache_dir,
+    char** error);
+
+// Creates a root isolate from cache_dir's AppJIT entry for kernel_buffer, or
+// from kernel_buffer itself on a miss. JIT only. *out_cache_hit (optional)
+// reports whether the cache was used.
+DARTVM_EMBED_LIB_EXPORT Dart_Isolate DartVmEmbed_CreateIsolateFromAppJitCache(
+    const char* cache_dir,
+    const char* script_uri,
+    const char* name,
+    const uint8_t* kernel_buffer,
+    intptr_t kernel_buffer_size,
+    void* isolate_group_data,
+    void* isolate_data,
+    bool* out_cache_hit,
+    char** error);
+
 // Creates a root isolate from a program file.
-// - jit runtime: expects a kernel file (for example .dill)
+// - jit runtime: expects a kernel file (.dill) or an AppJIT snapshot
 // - aot runtime: expects an app-aot-elf file (for example .aot)
 // This function also initializes VM when needed.
 DARTVM_EMBED_LIB_EXPORT Dart_Isolate DartVmEmbed_CreateIsolateFromProgramFile(
@@ -87,6 +478,48 @@ DARTVM_EMBED_LIB_EXPORT Dart_Isolate DartVmEmbed_CreateIsolateFromProgramFile(
     void* isolate_data,
     char** error);
 
+// Creates a root isolate from in-memory kernel (JIT) or app-aot-elf (AOT)
+// bytes, e.g. from DARTVM_EMBED_DECLARE_PROGRAM. The buffer is used in place
+// and must outlive the group. This function also initializes VM when needed.
+DARTVM_EMBED_LIB_EXPORT Dart_Isolate DartVmEmbed_CreateIsolateFromProgramBuffer(
+    const uint8_t* program,
+    intptr_t program_size,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error);
+
+// Fork-server mode: a VM-free zygote preloads programs and forks workers that
+// inherit them copy-on-write; a worker creating an isolate from a preloaded
+// path initializes its own VM and skips the program I/O.
+
+// Preloads program_path in the zygote. Fails once the VM is initialized.
+DARTVM_EMBED_LIB_EXPORT bool DartVmEmbed_ForkServerPreloadProgram(
+    const char* program_path,
+    char** error);
+
+// Forks one worker running worker_main(user_data, request, request_size).
+// Returns the child pid in the parent, or -1 on error.
+DARTVM_EMBED_LIB_EXPORT int64_t DartVmEmbed_ForkWorker(
+    DartVmEmbedForkWorkerMain worker_main,
+    void* user_data,
+    const uint8_t* request,
+    intptr_t request_size,
+    char** error);
+
+// Serves fork requests on control_fd until the peer closes it (returns true).
+// Request: uint32_t payload size (native order), then the payload. Reply:
+// int64_t pid, or -1 with the reason in this thread's LastErrorMessage.
+DARTVM_EMBED_LIB_EXPORT bool DartVmEmbed_ForkServerServe(
+    int control_fd,
+    DartVmEmbedForkWorkerMain worker_main,
+    void* user_data,
+    char** error);
+
+// Releases every preloaded program in a zygote that has stopped forking.
+// No-op once the VM is initialized; DartVmEmbed_Cleanup releases them then.
+DARTVM_EMBED_LIB_EXPORT void DartVmEmbed_ForkServerReleasePrograms(void);
+
 // Loads an app-aot-elf snapshot and returns VM/Isolate snapshot pointers.
 // Returns true on success. On error, *error receives malloc-allocated message.
 DARTVM_EMBED_LIB_EXPORT bool DartVmEmbed_LoadAotElf(
@@ -99,7 +532,19 @@ DARTVM_EMBED_LIB_EXPORT bool DartVmEmbed_LoadAotElf(
     const uint8_t** out_isolate_snapshot_instructions,
     char** error);
 
-// Unloads an ELF loaded by DartVmEmbed_LoadAotElf.
+// In-memory variant of DartVmEmbed_LoadAotElf.
+DARTVM_EMBED_LIB_EXPORT bool DartVmEmbed_LoadAotElfFromMemory(
+    const uint8_t* snapshot,
+    uint64_t snapshot_size,
+    DartVmEmbedAotElfHandle* out_handle,
+    const uint8_t** out_vm_snapshot_data,
+    const uint8_t** out_vm_snapshot_instructions,
+    const uint8_t** out_isolate_snapshot_data,
+    const uint8_t** out_isolate_snapshot_instructions,
+    char** error);
+
+// Unloads an ELF loaded by DartVmEmbed_LoadAotElf or
+// DartVmEmbed_LoadAotElfFromMemory.
 DARTVM_EMBED_LIB_EXPORT void DartVmEmbed_UnloadAotElf(
     DartVmEmbedAotElfHandle handle);
 
@@ -145,10 +590,319 @@ DARTVM_EMBED_LIB_EXPORT Dart_Handle DartVmEmbed_RunLoop(void);
 DARTVM_EMBED_LIB_EXPORT bool DartVmEmbed_RunLoopOnIsolate(Dart_Isolate isolate,
                                                           char** error);
 
+// Status API. The *Ex variants report failures as a status code and a
+// thread-local message buffer instead of malloc-allocated error text. Only
+// that allocation goes away; creating an isolate still allocates.
+
+// Status of the last *Ex call on the calling thread.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_LastStatus(void);
+
+// Message of the last failed *Ex call on the calling thread, "" after
+// success. Valid until the next *Ex call on the same thread; truncated to
+// the buffer size. Do not free.
+DARTVM_EMBED_LIB_EXPORT const char* DartVmEmbed_LastErrorMessage(void);
+
+// Static name of a status code. Do not free.
+DARTVM_EMBED_LIB_EXPORT const char* DartVmEmbed_StatusName(
+    DartVmEmbedStatus status);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_CreateIsolateFromKernelEx(
+    const char* script_uri,
+    const char* name,
+    const uint8_t* kernel_buffer,
+    intptr_t kernel_buffer_size,
+    void* isolate_group_data,
+    void* isolate_data,
+    Dart_Isolate* out_isolate);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus
+DartVmEmbed_CreateIsolateFromAppSnapshotEx(
+    const char* script_uri,
+    const char* name,
+    const uint8_t* isolate_snapshot_data,
+    const uint8_t* isolate_snapshot_instructions,
+    void* isolate_group_data,
+    void* isolate_data,
+    Dart_Isolate* out_isolate);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus
+DartVmEmbed_CreateIsolateFromProgramFileEx(
+    const char* program_path,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    Dart_Isolate* out_isolate);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus
+DartVmEmbed_CreateIsolateFromProgramBufferEx(
+    const uint8_t* program,
+    intptr_t program_size,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    Dart_Isolate* out_isolate);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_RunRootEntryOnIsolateEx(
+    Dart_Isolate isolate,
+    const char* entry_name);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_RunLoopOnIsolateEx(
+    Dart_Isolate isolate);
+
+// Returns a non-blocking eventfd (Linux) that becomes readable when a message
+// is posted to the isolate, or -1. The isolate owns it; when it fires, call
+// DartVmEmbed_HandlePendingMessages.
+DARTVM_EMBED_LIB_EXPORT int DartVmEmbed_GetMessageNotifyFd(
+    Dart_Isolate isolate);
+
+// Handles the messages signalled on the isolate's notify fd and returns
+// without blocking. An error status (for example the isolate exiting) means
+// the isolate should be shut down.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_HandlePendingMessages(
+    Dart_Isolate isolate);
+
+// Handles queued messages until budget_ns elapses or max_messages were
+// handled (<= 0 disables either), then stores an upper bound of those still
+// queued in out_remaining (nullable). A long handler is not interrupted.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_PumpMessages(
+    Dart_Isolate isolate,
+    int64_t budget_ns,
+    int64_t max_messages,
+    int64_t* out_remaining);
+
+// Posts objects[0..count) as one message, a List in Dart, so a batch costs
+// one enqueue and wakeup. The objects are copied; the caller keeps them.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_PostCObjectBatch(
+    int64_t port,
+    Dart_CObject** objects,
+    intptr_t count);
+
+// Deadline variants. The isolate is killed when budget_ns elapses first; the
+// call then reports DARTVM_EMBED_STATUS_TIMEOUT and the isolate must be shut
+// down with DartVmEmbed_ShutdownIsolateByHandle.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus
+DartVmEmbed_RunRootEntryOnIsolateWithDeadline(
+    Dart_Isolate isolate,
+    const char* entry_name,
+    int64_t budget_ns);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus
+DartVmEmbed_RunLoopOnIsolateWithDeadline(
+    Dart_Isolate isolate,
+    int64_t budget_ns);
+
+// Calls root-library function_name call_count times in one isolate entry.
+// Call i takes args[i * arg_count ..] (arg_count <= 16) and stores its null,
+// bool, int or double result in results[i]. Stops at the first failure;
+// *out_completed (optional) counts the calls that succeeded.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_InvokeBatch(
+    Dart_Isolate isolate,
+    const char* function_name,
+    const DartVmEmbedValue* args,
+    intptr_t arg_count,
+    intptr_t call_count,
+    DartVmEmbedValue* results,
+    intptr_t scope_recycle_interval,
+    intptr_t* out_completed);
+
+// Pins the calling thread and sets its preferred NUMA node; null stops that.
+// Isolates created afterwards on it record the placement, and the embedder
+// helpers that enter them apply it to the entering thread, which keeps it.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_SetThreadPlacement(
+    const DartVmEmbedPlacement* placement);
+
+// Reports the recorded placement of isolate.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_GetIsolatePlacement(
+    Dart_Isolate isolate,
+    DartVmEmbedPlacementReport* out_report);
+
+// Tenant manager API. All calls are thread-safe; a tenant can be acquired by
+// one thread at a time. Calls that may create or shut down isolates
+// (acquire, release, unregister) must be made with no isolate entered.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_TenantManagerCreate(
+    const DartVmEmbedTenantManagerConfig* config,
+    DartVmEmbedTenantManager** out_manager);
+
+// Shuts down every tenant isolate and frees the manager. Must not run
+// concurrently with any other call on the manager; call it with no isolate
+// entered.
+DARTVM_EMBED_LIB_EXPORT void DartVmEmbed_TenantManagerDestroy(
+    DartVmEmbedTenantManager* manager);
+
+// Registers a tenant program (see DartVmEmbed_CreateIsolateFromProgramFile).
+// heap_quota_bytes <= 0 selects the manager default.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_TenantRegister(
+    DartVmEmbedTenantManager* manager,
+    const char* tenant_id,
+    const char* program_path,
+    const char* script_uri,
+    int64_t heap_quota_bytes);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_TenantUnregister(
+    DartVmEmbedTenantManager* manager,
+    const char* tenant_id);
+
+// Returns the tenant's isolate, creating it when it is not resident (also
+// after it died, e.g. shut down following a deadline kill). The isolate is
+// not entered and stays exempt from eviction until released.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_TenantAcquire(
+    DartVmEmbedTenantManager* manager,
+    const char* tenant_id,
+    Dart_Isolate* out_isolate);
+
+// Marks the tenant idle. If its heap usage exceeds the quota the isolate is
+// shut down and DARTVM_EMBED_STATUS_QUOTA_EXCEEDED is returned; otherwise
+// idle isolates are evicted down to the RSS watermark.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_TenantRelease(
+    DartVmEmbedTenantManager* manager,
+    const char* tenant_id);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_TenantGetStats(
+    DartVmEmbedTenantManager* manager,
+    const char* tenant_id,
+    DartVmEmbedTenantStats* out_stats);
+
+// Resolves function_name in library_uri (root library when null) once and
+// keeps its closure. In AOT the function needs @pragma('vm:entry-point').
+// Once the isolate dies the call fails until released.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_PrepareCall(
+    Dart_Isolate isolate,
+    const char* library_uri,
+    const char* function_name,
+    DartVmEmbedPreparedCall** out_call);
+
+// Invokes a prepared call without any name lookup or string allocation.
+// Same argument and result rules as DartVmEmbed_InvokeBatch; out_result is
+// optional.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_InvokePrepared(
+    DartVmEmbedPreparedCall* call,
+    const DartVmEmbedValue* args,
+    intptr_t arg_count,
+    DartVmEmbedValue* out_result);
+
+// Releases a prepared call. Still required after its isolate has shut down
+// (shutdown only detaches it).
+DARTVM_EMBED_LIB_EXPORT void DartVmEmbed_ReleasePreparedCall(
+    DartVmEmbedPreparedCall* call);
+
+// Metrics. Updates are per-thread sharded and cheap; reads aggregate.
+DARTVM_EMBED_LIB_EXPORT void DartVmEmbed_GetMetricsSnapshot(
+    DartVmEmbedMetricsSnapshot* out_snapshot);
+
+// Writes the metrics in Prometheus text format to fd.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_WriteMetricsPrometheusFd(
+    int fd);
+
+// Atomically replaces path (write + rename) with the metrics in Prometheus
+// text format, for the node exporter textfile collector (*.prom).
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus
+DartVmEmbed_WriteMetricsPrometheusFile(const char* path);
+
+// Heap allocation sampling across all isolates. Requires an initialized VM.
+// config may be null for defaults. Samples are kept after Stop and across
+// restarts.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_StartHeapSampling(
+    const DartVmEmbedHeapSamplingConfig* config);
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_StopHeapSampling(void);
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_GetHeapSamplingStats(
+    DartVmEmbedHeapSamplingStats* out_stats);
+
+// Writes the sampled allocations to path as an uncompressed pprof profile.
+// Stacks are unsymbolized return addresses that pprof resolves against the
+// executable mappings recorded in the profile.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_WriteHeapProfilePprof(
+    const char* path);
+
+// CPU profiling through the in-process VM service, so no websocket client is
+// needed. Fails when the service isolate is disabled.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_StartCpuProfile(
+    const DartVmEmbedCpuProfileConfig* config);
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_StopCpuProfile(void);
+
+// Writes the isolate's CPU samples to path. The isolate must be running Dart
+// code or its message loop on another thread to answer the service request.
+// clear_samples discards the dumped samples.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_DumpCpuProfile(
+    Dart_Isolate isolate,
+    const char* path,
+    DartVmEmbedCpuProfileFormat format,
+    bool clear_samples);
+
 // Shuts down current isolate.
 DARTVM_EMBED_LIB_EXPORT void DartVmEmbed_ShutdownIsolate(void);
 
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_GetEmbedderStats(
+    DartVmEmbedEmbedderStats* out_stats);
+
 // Shuts down isolate by handle (enters isolate internally when needed).
 DARTVM_EMBED_LIB_EXPORT void DartVmEmbed_ShutdownIsolateByHandle(
     Dart_Isolate isolate);
+
+// Shuts isolates down in parallel on worker_count threads (<= 0: one per
+// hardware thread); null with count 0 selects every embedder-created root
+// isolate not held by a tenant manager. No thread may have them entered.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_ShutdownIsolates(
+    const Dart_Isolate* isolates,
+    intptr_t count,
+    int worker_count);
+
+// Exits the process without shutting isolates down or calling
+// DartVmEmbed_Cleanup: flushes stdio and calls _exit(exit_code). For
+// restarts where per-isolate teardown would only delay the exit.
+DARTVM_EMBED_LIB_EXPORT void DartVmEmbed_FastExit(int exit_code);
+
+// Releases the deferred VM service isolate now instead of when the first user
+// isolate becomes runnable, e.g. to attach DevTools early. Fails when the
+// service isolate is disabled.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_StartServiceIsolate(
+    void);
+
+// Starts a deferred kernel isolate without waiting for it, so its startup
+// overlaps whatever the caller does before the first source compile. No-op
+// when it is already started.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_PrestartKernelService(
+    void);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_GetKernelServiceStats(
+    DartVmEmbedKernelServiceStats* out_stats);
+
+// Registers host symbols for @Native functions in a perfect hash built at
+// runtime (not compile time); the embedder's FFI resolver consults it before
+// the VM's default lookup. Call before DartVmEmbed_Initialize; count 0
+// removes the table. Duplicate names are rejected.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_RegisterFfiNatives(
+    const DartVmEmbedFfiNative* natives,
+    intptr_t count);
+
+// Resolves name and arity exactly as the VM's @Native resolver does: the
+// registered function, or null when the name is unknown or args_n does not
+// match its registered arity.
+DARTVM_EMBED_LIB_EXPORT void* DartVmEmbed_LookupFfiNative(const char* name,
+                                                         intptr_t args_n);
+
+// Opens a native port whose handlers run on the pool sized by
+// native_port_threads. It closes with owner (nullable) or at CloseNativePort
+// or Cleanup; closing waits for running handlers, so a handler must not close
+// its own port.
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_NewNativePort(
+    Dart_Isolate owner,
+    const DartVmEmbedNativePortConfig* config,
+    int64_t* out_port);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_CloseNativePort(
+    int64_t port);
+
+// Port registered under name, or 0 (ILLEGAL_PORT) when there is none.
+DARTVM_EMBED_LIB_EXPORT int64_t DartVmEmbed_LookupNativePort(
+    const char* name);
+
+// Dart-side lookup through an @Native<Handle Function(Pointer<Char>)> with
+// symbol 'DartVmEmbed_LookupNativeSendPort': the named port's SendPort, or
+// null. Always resolved by the embedder, so the host need not export it.
+DARTVM_EMBED_LIB_EXPORT Dart_Handle DartVmEmbed_LookupNativeSendPort(
+    const char* name);
+
+DARTVM_EMBED_LIB_EXPORT DartVmEmbedStatus DartVmEmbed_GetNativePortStats(
+    int64_t port,
+    DartVmEmbedNativePortStats* out_stats);
 }
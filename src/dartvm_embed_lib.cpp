@@ -1,11 +1,35 @@
 #include "dartvm_embed_lib.h"
 
+#include <algorithm>
 #include <assert.h>
-#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <errno.h>
+#include <fcntl.h>
+#include <functional>
+#include <list>
+#include <memory>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 #include <unordered_map>
 #include <unordered_set>
@@ -21,16 +45,104 @@
 #include <bin/isolate_data.h>
 #include <bin/loader.h>
 #include <bin/main_options.h>
+#include <bin/snapshot_utils.h>
 #include <bin/vmservice_impl.h>
 #include <include/dart_api.h>
 #include <include/dart_embedder_api.h>
+#include <include/dart_native_api.h>
 #include <include/dart_tools_api.h>
 
 static bool g_vm_initialized = false;
-static std::unordered_map<Dart_Isolate, DartVmEmbedAotElfHandle>
-    g_isolate_loaded_aot_elfs;
-static std::unordered_map<Dart_Isolate, std::vector<uint8_t>>
-    g_isolate_kernel_buffers;
+
+// std::mutex that counts acquisitions and the time spent waiting for
+// contended ones, so lock cost shows up in DartVmEmbed_GetEmbedderStats.
+class InstrumentedMutex {
+ public:
+  void lock() {
+    acquisitions_.fetch_add(1, std::memory_order_relaxed);
+    if (mutex_.try_lock()) {
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    mutex_.lock();
+    contentions_.fetch_add(1, std::memory_order_relaxed);
+    wait_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count(),
+                       std::memory_order_relaxed);
+  }
+  void unlock() { mutex_.unlock(); }
+
+  int64_t acquisitions() const {
+    return acquisitions_.load(std::memory_order_relaxed);
+  }
+  int64_t contentions() const {
+    return contentions_.load(std::memory_order_relaxed);
+  }
+  int64_t wait_ns() const { return wait_ns_.load(std::memory_order_relaxed); }
+
+ private:
+  std::mutex mutex_;
+  std::atomic<int64_t> acquisitions_{0};
+  std::atomic<int64_t> contentions_{0};
+  std::atomic<int64_t> wait_ns_{0};
+};
+
+// Guards g_isolate_records and the callback-owned sets. They are updated
+// from host threads and from VM threads (isolate group create/cleanup
+// callbacks), so the lock is only held around map operations, never across
+// calls into the VM. g_preloaded_programs is exempt: it is only written while
+// the VM is not running.
+static InstrumentedMutex g_embedder_maps_mutex;
+
+// Entry point resolved once by DartVmEmbed_PrepareCall. |closure| is cleared
+// when the owning isolate shuts down, however it dies; the object itself
+// lives until DartVmEmbed_ReleasePreparedCall. A call is attached while it is
+// listed in its isolate's record.
+struct DartVmEmbedPreparedCall {
+  Dart_Isolate isolate = nullptr;
+  Dart_PersistentHandle closure = nullptr;
+};
+
+// Platform kernel shared by every kernel-based isolate group creation.
+// Resolved once by DartVmEmbed_Initialize and released by DartVmEmbed_Cleanup;
+// |mapping| is set when the bytes come from a read-only file mapping.
+struct SharedPlatformKernel {
+  const uint8_t* buffer = nullptr;
+  intptr_t size = 0;
+  void* mapping = nullptr;
+  size_t mapping_size = 0;
+};
+
+static SharedPlatformKernel g_platform_kernel;
+
+// Program preloaded by a fork-server zygote before the VM is initialized.
+// Forked workers inherit the bytes and mappings copy-on-write. Entries are
+// released by DartVmEmbed_ForkServerReleasePrograms in the zygote and by
+// DartVmEmbed_Cleanup in a worker, once no isolate can run from them.
+struct PreloadedProgram {
+  std::vector<uint8_t> kernel;
+  dart::bin::AppSnapshot* app_snapshot = nullptr;
+  DartVmEmbedAotElfHandle aot_elf = nullptr;
+  const uint8_t* vm_data = nullptr;
+  const uint8_t* vm_instr = nullptr;
+  const uint8_t* iso_data = nullptr;
+  const uint8_t* iso_instr = nullptr;
+};
+
+static std::unordered_map<std::string, PreloadedProgram> g_preloaded_programs;
+static const uint32_t kForkServerMaxRequestSize = 1024 * 1024;
+
+static void ReleasePreloadedPrograms() {
+  for (auto& entry : g_preloaded_programs) {
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+    DartVmEmbed_UnloadAotElf(entry.second.aot_elf);
+#else
+    delete entry.second.app_snapshot;
+#endif
+  }
+  g_preloaded_programs.clear();
+}
 
 struct OwnedIsolateState {
   dart::bin::IsolateGroupData* isolate_group_data = nullptr;
@@ -39,16 +151,923 @@ struct OwnedIsolateState {
   bool owns_isolate = false;
 };
 
-static std::unordered_map<Dart_Isolate, OwnedIsolateState> g_owned_isolates;
 static std::unordered_set<dart::bin::IsolateData*> g_callback_owned_isolate_data;
 static std::unordered_set<dart::bin::IsolateGroupData*> g_callback_owned_group_data;
-static std::unordered_set<Dart_Isolate> g_vmservice_warmed_isolates;
+
+// Group-invariant results of root isolate setup, reused by every isolate the
+// group spawns. Written at group start (overwriting any entry left by a
+// previous group at the same address) and erased when the group data goes.
+struct GroupSetupCache {
+  std::string resolved_packages_config;
+  std::string resolved_script_uri;
+};
+
+static std::unordered_map<dart::bin::IsolateGroupData*, GroupSetupCache>
+    g_group_setup_caches;
+
+// App snapshot a root isolate group was created from. The VM runs code
+// straight out of its mapping, and isolates the group spawned can outlive the
+// root, so CleanupGroup releases it rather than root isolate shutdown.
+struct GroupSnapshot {
+  dart::bin::AppSnapshot* snapshot = nullptr;
+  bool from_app_jit_cache = false;
+};
+
+static std::unordered_map<dart::bin::IsolateGroupData*, GroupSnapshot>
+    g_group_snapshots;
+
 static DartVmEmbedFileModifiedCallback g_file_modified_callback = nullptr;
+
+// Host symbols for @Native functions, laid out as a perfect hash (hash and
+// displace) that DartVmEmbed_RegisterFfiNatives builds at runtime: a name's
+// bucket selects a seed, and the seeded hash lands on the one slot that can
+// hold it. There is one slot per name unless building the table needed spare
+// ones. Written only before the VM starts, so the resolver reads it without
+// locking.
+struct FfiNativeSlot {
+  std::string name;
+  void* function = nullptr;
+  intptr_t args_n = -1;
+};
+
+struct FfiNativeTable {
+  std::vector<uint32_t> seeds;
+  std::vector<FfiNativeSlot> slots;
+};
+
+static FfiNativeTable g_ffi_natives;
 static std::string g_vm_service_ip = "127.0.0.1";
 static int g_vm_service_port = 8181;
 static bool g_vm_service_auth_codes_disabled = true;
+static bool g_vm_service_serve_devtools = true;
+static bool g_vm_service_serve_observatory = true;
+// Whether OnCreateIsolateGroup creates the service isolate the VM asks for.
+// Profiling and hot reload go through it.
+static bool g_service_isolate_enabled = true;
+
+// Embedder metrics. Updates go to the calling thread's shard (relaxed atomics
+// on a cache line no other thread writes); readers sum all shards. Gauges
+// are kept as signed deltas.
+enum MetricId {
+  kMetricIsolateCreations,
+  kMetricIsolateCreationFailures,
+  kMetricIsolateShutdowns,
+  kMetricKernelBufferBytes,
+  kMetricLoadedAotElfs,
+  kMetricReloadFileChecks,
+  kMetricServiceWarmups,
+  kMetricServiceWarmupRetries,
+  kMetricIsolateSpawns,
+  kMetricIsolateSpawnSetupNs,
+  kMetricCount,
+};
+
+static const int64_t kCreationLatencyBoundsNs[] = {
+    500000,    1000000,   2000000,   5000000,   10000000,  25000000,
+    50000000,  100000000, 250000000, 500000000, 1000000000};
+static const size_t kCreationLatencyBuckets =
+    sizeof(kCreationLatencyBoundsNs) / sizeof(kCreationLatencyBoundsNs[0]) + 1;
+static const size_t kMetricsShards = 64;
+
+struct alignas(64) MetricsShard {
+  std::atomic<int64_t> values[kMetricCount];
+  std::atomic<int64_t> latency_buckets[kCreationLatencyBuckets];
+  std::atomic<int64_t> latency_sum_ns;
+};
+
+static MetricsShard g_metrics_shards[kMetricsShards];
+static std::atomic<size_t> g_next_metrics_shard{0};
+static thread_local MetricsShard* t_metrics_shard = nullptr;
+
+static MetricsShard& CurrentMetricsShard() {
+  if (t_metrics_shard == nullptr) {
+    t_metrics_shard =
+        &g_metrics_shards[g_next_metrics_shard.fetch_add(
+                              1, std::memory_order_relaxed) %
+                          kMetricsShards];
+  }
+  return *t_metrics_shard;
+}
+
+static void AddMetric(MetricId id, int64_t delta) {
+  CurrentMetricsShard().values[id].fetch_add(delta, std::memory_order_relaxed);
+}
+
+static int64_t SumMetric(MetricId id) {
+  int64_t sum = 0;
+  for (const MetricsShard& shard : g_metrics_shards) {
+    sum += shard.values[id].load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+static int64_t MonotonicNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static thread_local int t_creation_depth = 0;
+
+static void TrackIsolateRecord(Dart_Isolate isolate);
+static void OpenServiceIsolateGate();
+
+// Times the outermost public create call on this thread, starts tracking the
+// isolate it returns and releases a deferred service isolate; nested creates
+// (for example ProgramFile -> Kernel) are not counted twice.
+class CreationMetricsScope {
+ public:
+  CreationMetricsScope()
+      : outermost_(t_creation_depth++ == 0),
+        start_ns_(outermost_ ? MonotonicNowNs() : 0) {}
+  ~CreationMetricsScope() { --t_creation_depth; }
+
+  Dart_Isolate Finish(Dart_Isolate isolate) {
+    if (!outermost_) {
+      return isolate;
+    }
+    if (isolate == nullptr) {
+      AddMetric(kMetricIsolateCreationFailures, 1);
+      return isolate;
+    }
+    TrackIsolateRecord(isolate);
+    OpenServiceIsolateGate();
+    const int64_t elapsed_ns = MonotonicNowNs() - start_ns_;
+    size_t bucket = 0;
+    while (bucket + 1 < kCreationLatencyBuckets &&
+           elapsed_ns > kCreationLatencyBoundsNs[bucket]) {
+      ++bucket;
+    }
+    MetricsShard& shard = CurrentMetricsShard();
+    shard.values[kMetricIsolateCreations].fetch_add(1,
+                                                    std::memory_order_relaxed);
+    shard.latency_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.latency_sum_ns.fetch_add(elapsed_ns, std::memory_order_relaxed);
+    return isolate;
+  }
+
+ private:
+  const bool outermost_;
+  const int64_t start_ns_;
+};
+
+// Heap allocation sampling. The VM reports every sampled allocation through
+// HeapSampleCreateCallback; samples are aggregated by (class, native stack)
+// into a bounded table. Index 0 collects samples whose stack did not fit.
+static const uint32_t kHeapSampleMaxFrames = 64;
+
+struct HeapSampleStack {
+  std::string class_name;
+  uintptr_t frames[kHeapSampleMaxFrames];
+  uint32_t frame_count = 0;
+  uint64_t hash = 0;
+  int64_t alloc_count = 0;
+  int64_t alloc_bytes = 0;
+  int64_t live_count = 0;
+  int64_t live_bytes = 0;
+};
+
+// Returned to the VM for each sampled object and handed back on collection.
+struct HeapSampleToken {
+  uint32_t stack_index;
+  intptr_t size;
+};
+
+struct HeapSamplingState {
+  std::mutex mutex;
+  bool callbacks_registered = false;
+  bool active = false;
+  int64_t interval_bytes = 0;
+  uint32_t max_stacks = 0;
+  std::atomic<uint32_t> max_frames{0};
+  std::vector<HeapSampleStack> stacks;
+  // Open-addressed index into |stacks|; -1 marks an empty slot.
+  std::vector<int32_t> slots;
+  int64_t samples_total = 0;
+  int64_t overflow_samples = 0;
+};
+
+static HeapSamplingState g_heap_sampling;
+
+#if defined(__linux__)
+struct ThreadStackBounds {
+  bool resolved = false;
+  uintptr_t low = 0;
+  uintptr_t high = 0;
+};
+
+static thread_local ThreadStackBounds t_stack_bounds;
+
+static bool CurrentThreadStackBounds(uintptr_t* low, uintptr_t* high) {
+  if (!t_stack_bounds.resolved) {
+    t_stack_bounds.resolved = true;
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      void* stack_addr = nullptr;
+      size_t stack_size = 0;
+      if (pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0) {
+        t_stack_bounds.low = reinterpret_cast<uintptr_t>(stack_addr);
+        t_stack_bounds.high = t_stack_bounds.low + stack_size;
+      }
+      pthread_attr_destroy(&attr);
+    }
+  }
+  *low = t_stack_bounds.low;
+  *high = t_stack_bounds.high;
+  return *high > *low;
+}
+#endif
+
+// Best-effort frame-pointer walk of the calling thread. Dart code keeps frame
+// pointers; the walk stops at the first frame that leaves the thread stack.
+static uint32_t CaptureFramePointerStack(uintptr_t* frames,
+                                         uint32_t max_frames) {
+  uint32_t count = 0;
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+  uintptr_t low = 0;
+  uintptr_t high = 0;
+  if (!CurrentThreadStackBounds(&low, &high)) {
+    return 0;
+  }
+  uintptr_t fp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+  while (count < max_frames && fp >= low &&
+         fp + 2 * sizeof(uintptr_t) <= high &&
+         (fp & (sizeof(uintptr_t) - 1)) == 0) {
+    const uintptr_t* record = reinterpret_cast<const uintptr_t*>(fp);
+    const uintptr_t next_fp = record[0];
+    const uintptr_t pc = record[1];
+    if (pc == 0) {
+      break;
+    }
+    frames[count++] = pc;
+    if (next_fp <= fp) {
+      break;
+    }
+    fp = next_fp;
+  }
+#else
+  (void)frames;
+  (void)max_frames;
+#endif
+  return count;
+}
+
+static uint64_t HashHeapSample(const char* class_name,
+                               const uintptr_t* frames,
+                               uint32_t frame_count) {
+  uint64_t hash = 1469598103934665603ULL;
+  for (const char* c = class_name; *c != '\0'; ++c) {
+    hash = (hash ^ static_cast<uint8_t>(*c)) * 1099511628211ULL;
+  }
+  for (uint32_t i = 0; i < frame_count; ++i) {
+    hash = (hash ^ frames[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static void RebuildHeapSampleSlots(HeapSamplingState* state) {
+  size_t slot_count = 16;
+  while (slot_count < static_cast<size_t>(state->max_stacks) * 2) {
+    slot_count *= 2;
+  }
+  state->slots.assign(slot_count, -1);
+  for (size_t i = 1; i < state->stacks.size(); ++i) {
+    size_t slot = state->stacks[i].hash & (slot_count - 1);
+    while (state->slots[slot] != -1) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    state->slots[slot] = static_cast<int32_t>(i);
+  }
+}
+
+// Requires state->mutex. Returns 0 (the overflow entry) when the table is full.
+static uint32_t FindOrInsertHeapSample(HeapSamplingState* state,
+                                       const char* class_name,
+                                       const uintptr_t* frames,
+                                       uint32_t frame_count,
+                                       uint64_t hash) {
+  const size_t mask = state->slots.size() - 1;
+  size_t slot = hash & mask;
+  while (state->slots[slot] != -1) {
+    HeapSampleStack& stack = state->stacks[state->slots[slot]];
+    if (stack.hash == hash && stack.frame_count == frame_count &&
+        memcmp(stack.frames, frames, frame_count * sizeof(uintptr_t)) == 0 &&
+        stack.class_name == class_name) {
+      return static_cast<uint32_t>(state->slots[slot]);
+    }
+    slot = (slot + 1) & mask;
+  }
+  if (state->stacks.size() > state->max_stacks) {
+    ++state->overflow_samples;
+    return 0;
+  }
+  state->stacks.emplace_back();
+  HeapSampleStack& stack = state->stacks.back();
+  stack.class_name = class_name;
+  memcpy(stack.frames, frames, frame_count * sizeof(uintptr_t));
+  stack.frame_count = frame_count;
+  stack.hash = hash;
+  const uint32_t index = static_cast<uint32_t>(state->stacks.size() - 1);
+  state->slots[slot] = static_cast<int32_t>(index);
+  return index;
+}
+
+static void* HeapSampleCreateCallback(Dart_Isolate isolate,
+                                      Dart_IsolateGroup isolate_group,
+                                      const char* class_name,
+                                      intptr_t allocation_size) {
+  (void)isolate;
+  (void)isolate_group;
+  if (class_name == nullptr) {
+    class_name = "<unknown>";
+  }
+  uintptr_t frames[kHeapSampleMaxFrames];
+  const uint32_t frame_count = CaptureFramePointerStack(
+      frames, g_heap_sampling.max_frames.load(std::memory_order_relaxed));
+  const uint64_t hash = HashHeapSample(class_name, frames, frame_count);
+
+  std::lock_guard<std::mutex> lock(g_heap_sampling.mutex);
+  const uint32_t index = FindOrInsertHeapSample(
+      &g_heap_sampling, class_name, frames, frame_count, hash);
+  HeapSampleStack& stack = g_heap_sampling.stacks[index];
+  ++stack.alloc_count;
+  stack.alloc_bytes += allocation_size;
+  ++stack.live_count;
+  stack.live_bytes += allocation_size;
+  ++g_heap_sampling.samples_total;
+  return new HeapSampleToken{index, allocation_size};
+}
+
+static void HeapSampleDeleteCallback(void* data) {
+  HeapSampleToken* token = static_cast<HeapSampleToken*>(data);
+  if (token == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(g_heap_sampling.mutex);
+    HeapSampleStack& stack = g_heap_sampling.stacks[token->stack_index];
+    --stack.live_count;
+    stack.live_bytes -= token->size;
+  }
+  delete token;
+}
+
+// CPU set and preferred NUMA node applied to a thread. |active| is false for
+// threads that were never placed.
+struct ThreadPlacement {
+  bool active = false;
+  std::vector<int> cpus;
+  int numa_node = -1;
+};
+
+// Placement recorded for an isolate from the thread that created it, and
+// reapplied to threads that enter it through the embedder helpers.
+struct IsolatePlacement {
+  ThreadPlacement placement;
+  int last_cpu = -1;
+  int last_numa_node = -1;
+};
+
+// Placement observed while setting up a root isolate on this thread, kept
+// until CreationMetricsScope::Finish creates the isolate's record.
+static thread_local Dart_Isolate t_pending_placement_isolate = nullptr;
+static thread_local IsolatePlacement t_pending_placement;
+
+static ThreadPlacement g_vm_thread_placement;
+static std::atomic<int> g_vm_threads_placed{0};
+
+// Host-driven message handling state, attached when the isolate is tracked.
+// pending counts every post, OOB included, and is decremented per
+// Dart_HandleMessage call. That call drains all OOB messages plus one normal
+// message, so pending is an upper bound on the queue: it never undercounts,
+// and surplus counts only cost a no-op call. notify_fd, when set, is
+// signalled on every post and closed with the last reference.
+struct MessagePump {
+  ~MessagePump() {
+    const int fd = notify_fd.load(std::memory_order_relaxed);
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  std::atomic<int64_t> pending{0};
+  std::atomic<int> notify_fd{-1};
+};
+
+struct TenantEntry;
+
+// Ties a tenant's isolate record to its tenant entry. tenant is guarded by
+// the manager's mutex and cleared by whichever side lets go first: the
+// manager when it detaches the isolate, or the isolate's shutdown when it
+// dies some other way (deadline kill, a direct shutdown).
+struct TenantIsolateLink {
+  DartVmEmbedTenantManager* manager = nullptr;
+  TenantEntry* tenant = nullptr;
+};
+
+static void UnlinkTenantIsolate(const std::shared_ptr<TenantIsolateLink>& link);
+
+// Everything the embedder keeps for one root isolate, so shutdown is a single
+// lookup. Created when a public create call succeeds; erased by
+// DartVmEmbed_ShutdownIsolate.
+struct IsolateRecord {
+  OwnedIsolateState owned;
+  DartVmEmbedAotElfHandle aot_elf = nullptr;
+  std::vector<uint8_t> kernel;
+  std::vector<DartVmEmbedPreparedCall*> prepared_calls;
+  bool service_warmed = false;
+  bool has_placement = false;
+  IsolatePlacement placement;
+  std::shared_ptr<MessagePump> message_pump;
+  // Set while a tenant manager holds the isolate; it shuts it down itself.
+  std::shared_ptr<TenantIsolateLink> tenant_link;
+};
+
+static std::unordered_map<Dart_Isolate, IsolateRecord> g_isolate_records;
+
+// Message pumps, looked up by the VM's notify callback on every message post,
+// so they sit behind their own reader-writer lock instead of
+// g_embedder_maps_mutex. Callers that use a pump outside the lock hold their
+// own reference, so a concurrent shutdown cannot free it under them.
+static std::shared_mutex g_message_pump_mutex;
+static std::unordered_map<Dart_Isolate, std::shared_ptr<MessagePump>>
+    g_message_pumps;
+
+static void MessageNotifyCallback(Dart_Isolate isolate) {
+  std::shared_lock<std::shared_mutex> lock(g_message_pump_mutex);
+  auto it = g_message_pumps.find(isolate);
+  if (it == g_message_pumps.end()) {
+    return;
+  }
+  MessagePump* pump = it->second.get();
+  pump->pending.fetch_add(1, std::memory_order_relaxed);
+  const int fd = pump->notify_fd.load(std::memory_order_acquire);
+  if (fd >= 0) {
+    const uint64_t one = 1;
+    // EAGAIN only means the counter is saturated; the reader wakes anyway.
+    ssize_t written = write(fd, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+// Attaches the pump and the VM notify callback as soon as the isolate is
+// created, so every later post is counted. Nothing runs Dart code before
+// this, so the queue starts empty.
+static void TrackIsolateRecord(Dart_Isolate isolate) {
+  auto pump = std::make_shared<MessagePump>();
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    IsolateRecord& record =
+        g_isolate_records.try_emplace(isolate).first->second;
+    if (t_pending_placement_isolate == isolate) {
+      record.has_placement = true;
+      record.placement = t_pending_placement;
+      t_pending_placement_isolate = nullptr;
+    }
+    record.message_pump = pump;
+  }
+  {
+    std::unique_lock<std::shared_mutex> lock(g_message_pump_mutex);
+    g_message_pumps[isolate] = std::move(pump);
+  }
+  bool entered = false;
+  if (Dart_CurrentIsolate() == nullptr) {
+    Dart_EnterIsolate(isolate);
+    entered = true;
+  }
+  Dart_SetMessageNotifyCallback(MessageNotifyCallback);
+  if (entered) {
+    Dart_ExitIsolate();
+  }
+}
+
+static void ReleaseMessagePump(Dart_Isolate isolate) {
+  std::unique_lock<std::shared_mutex> lock(g_message_pump_mutex);
+  g_message_pumps.erase(isolate);
+}
+
+// Native ports served by a worker pool shared by every port. The VM hands
+// each message to NativePortDispatch one at a time and frees it on return,
+// so the dispatcher deep-copies it into a single allocation and queues it on
+// a lane. Serial and parallel ports have one lane; keyed ports have one
+// serial lane per `threads`. A lane with queued messages and a free handler
+// slot has an entry on the pool's ready queue for each message it can start.
+struct NativePortMessage {
+  std::unique_ptr<std::byte[]> storage;
+  Dart_CObject* object = nullptr;
+  int64_t enqueued_ns = 0;
+};
+
+struct NativePortLane {
+  std::deque<NativePortMessage> queue;
+  int max_active = 1;
+  int active = 0;
+  // Entries on the pool's ready queue; each starts one message.
+  int scheduled = 0;
+};
+
+struct NativePort {
+  int64_t id = ILLEGAL_PORT;
+  std::string name;
+  Dart_Isolate owner = nullptr;
+  DartVmEmbedNativePortHandler handler = nullptr;
+  void* user_data = nullptr;
+  DartVmEmbedNativePortKeyFunction key = nullptr;
+  bool keyed = false;
+
+  std::mutex mutex;
+  std::condition_variable idle_cv;
+  std::vector<NativePortLane> lanes;
+  // Handlers running across all lanes.
+  int active = 0;
+  bool closing = false;
+  DartVmEmbedNativePortStats stats;
+};
+
+struct NativePortTask {
+  std::shared_ptr<NativePort> port;
+  NativePortLane* lane = nullptr;
+};
+
+// size workers (DartVmEmbedInitConfig::native_port_threads), started with
+// the first port and stopped by DartVmEmbed_Cleanup. Lock order:
+// NativePort::mutex, then this mutex.
+struct NativePortPool {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<NativePortTask> ready;
+  std::vector<std::thread> workers;
+  int size = 1;
+  bool stopping = false;
+};
+
+static NativePortPool g_native_port_pool;
+
+// Looked up by the dispatcher on every message; a reader-writer lock for the
+// same reason as g_message_pump_mutex.
+static std::shared_mutex g_native_ports_mutex;
+static std::unordered_map<int64_t, std::shared_ptr<NativePort>>
+    g_native_ports;
+static std::unordered_map<std::string, int64_t> g_native_port_names;
+static thread_local const NativePort* t_native_port_worker = nullptr;
+
+static size_t CObjectChunk(size_t size) {
+  return (size + 15) & ~size_t{15};
+}
+
+static size_t TypedDataElementSize(Dart_TypedData_Type type) {
+  switch (type) {
+    case Dart_TypedData_kInt16:
+    case Dart_TypedData_kUint16:
+      return 2;
+    case Dart_TypedData_kInt32:
+    case Dart_TypedData_kUint32:
+    case Dart_TypedData_kFloat32:
+      return 4;
+    case Dart_TypedData_kInt64:
+    case Dart_TypedData_kUint64:
+    case Dart_TypedData_kFloat64:
+      return 8;
+    case Dart_TypedData_kInt32x4:
+    case Dart_TypedData_kFloat32x4:
+    case Dart_TypedData_kFloat64x2:
+      return 16;
+    default:
+      return 1;
+  }
+}
+
+// Only arrays can be shared or form cycles, so only they are tracked (in
+// per-thread scratch maps that keep their buckets between messages); a leaf
+// referenced twice is copied twice. Both passes follow the same rule.
+static thread_local std::unordered_set<const Dart_CObject*> t_cobject_seen;
+static thread_local std::unordered_map<const Dart_CObject*, Dart_CObject*>
+    t_cobject_copies;
+
+static size_t CObjectCopySize(const Dart_CObject* object) {
+  size_t size = CObjectChunk(sizeof(Dart_CObject));
+  switch (object->type) {
+    case Dart_CObject_kString:
+      size += CObjectChunk(strlen(object->value.as_string) + 1);
+      break;
+    case Dart_CObject_kArray:
+      if (!t_cobject_seen.insert(object).second) {
+        return 0;
+      }
+      size += CObjectChunk(sizeof(Dart_CObject*) *
+                           static_cast<size_t>(object->value.as_array.length));
+      for (intptr_t i = 0; i < object->value.as_array.length; ++i) {
+        size += CObjectCopySize(object->value.as_array.values[i]);
+      }
+      break;
+    case Dart_CObject_kTypedData:
+      size += CObjectChunk(
+          static_cast<size_t>(object->value.as_typed_data.length) *
+          TypedDataElementSize(object->value.as_typed_data.type));
+      break;
+    case Dart_CObject_kExternalTypedData:
+    case Dart_CObject_kUnmodifiableExternalTypedData:
+      size += CObjectChunk(
+          static_cast<size_t>(object->value.as_external_typed_data.length) *
+          TypedDataElementSize(object->value.as_external_typed_data.type));
+      break;
+    default:
+      break;
+  }
+  return size;
+}
+
+// External typed data is copied as plain typed data: its finalizer stays with
+// the VM's message.
+static Dart_CObject* CopyCObject(const Dart_CObject* object,
+                                 std::byte** cursor) {
+  if (object->type == Dart_CObject_kArray) {
+    auto it = t_cobject_copies.find(object);
+    if (it != t_cobject_copies.end()) {
+      return it->second;
+    }
+  }
+  auto* copy = reinterpret_cast<Dart_CObject*>(*cursor);
+  *cursor += CObjectChunk(sizeof(Dart_CObject));
+  *copy = *object;
+  switch (object->type) {
+    case Dart_CObject_kString: {
+      const size_t length = strlen(object->value.as_string) + 1;
+      char* text = reinterpret_cast<char*>(*cursor);
+      memcpy(text, object->value.as_string, length);
+      *cursor += CObjectChunk(length);
+      copy->value.as_string = text;
+      break;
+    }
+    case Dart_CObject_kArray: {
+      t_cobject_copies.emplace(object, copy);
+      const intptr_t length = object->value.as_array.length;
+      auto** values = reinterpret_cast<Dart_CObject**>(*cursor);
+      *cursor += CObjectChunk(sizeof(Dart_CObject*) *
+                              static_cast<size_t>(length));
+      copy->value.as_array.values = values;
+      for (intptr_t i = 0; i < length; ++i) {
+        values[i] = CopyCObject(object->value.as_array.values[i], cursor);
+      }
+      break;
+    }
+    case Dart_CObject_kTypedData: {
+      const size_t bytes =
+          static_cast<size_t>(object->value.as_typed_data.length) *
+          TypedDataElementSize(object->value.as_typed_data.type);
+      uint8_t* data = reinterpret_cast<uint8_t*>(*cursor);
+      if (bytes > 0) {
+        memcpy(data, object->value.as_typed_data.values, bytes);
+      }
+      *cursor += CObjectChunk(bytes);
+      copy->value.as_typed_data.values = data;
+      break;
+    }
+    case Dart_CObject_kExternalTypedData:
+    case Dart_CObject_kUnmodifiableExternalTypedData: {
+      const Dart_TypedData_Type type =
+          object->value.as_external_typed_data.type;
+      const intptr_t length = object->value.as_external_typed_data.length;
+      const size_t bytes =
+          static_cast<size_t>(length) * TypedDataElementSize(type);
+      uint8_t* data = reinterpret_cast<uint8_t*>(*cursor);
+      if (bytes > 0) {
+        memcpy(data, object->value.as_external_typed_data.data, bytes);
+      }
+      *cursor += CObjectChunk(bytes);
+      copy->type = Dart_CObject_kTypedData;
+      copy->value.as_typed_data.type = type;
+      copy->value.as_typed_data.length = length;
+      copy->value.as_typed_data.values = data;
+      break;
+    }
+    default:
+      break;
+  }
+  return copy;
+}
+
+static int64_t DefaultNativePortKey(const Dart_CObject* message) {
+  if (message->type != Dart_CObject_kArray ||
+      message->value.as_array.length == 0) {
+    return 0;
+  }
+  const Dart_CObject* first = message->value.as_array.values[0];
+  switch (first->type) {
+    case Dart_CObject_kInt32:
+      return first->value.as_int32;
+    case Dart_CObject_kInt64:
+      return first->value.as_int64;
+    case Dart_CObject_kString:
+      return static_cast<int64_t>(
+          std::hash<std::string_view>()(first->value.as_string));
+    default:
+      return 0;
+  }
+}
+
+// Queues one ready-queue entry for |lane| when it has a message no entry
+// covers yet and a free handler slot. Called with port->mutex held.
+static void ScheduleNativePortLane(const std::shared_ptr<NativePort>& port,
+                                   NativePortLane* lane) {
+  if (port->closing || lane->active + lane->scheduled >= lane->max_active ||
+      static_cast<size_t>(lane->scheduled) >= lane->queue.size()) {
+    return;
+  }
+  lane->scheduled++;
+  {
+    std::lock_guard<std::mutex> lock(g_native_port_pool.mutex);
+    g_native_port_pool.ready.push_back(NativePortTask{port, lane});
+  }
+  g_native_port_pool.cv.notify_one();
+}
+
+static void NativePortDispatch(Dart_Port port_id, Dart_CObject* message) {
+  std::shared_ptr<NativePort> port;
+  {
+    std::shared_lock<std::shared_mutex> lock(g_native_ports_mutex);
+    auto it = g_native_ports.find(port_id);
+    if (it == g_native_ports.end()) {
+      return;
+    }
+    port = it->second;
+  }
+
+  size_t lane = 0;
+  if (port->keyed) {
+    const int64_t key = port->key != nullptr
+                            ? port->key(port->user_data, message)
+                            : DefaultNativePortKey(message);
+    lane = std::hash<int64_t>()(key) % port->lanes.size();
+  }
+
+  NativePortMessage queued;
+  queued.storage.reset(new std::byte[CObjectCopySize(message)]);
+  std::byte* cursor = queued.storage.get();
+  queued.object = CopyCObject(message, &cursor);
+  queued.enqueued_ns = MonotonicNowNs();
+  t_cobject_seen.clear();
+  t_cobject_copies.clear();
+
+  NativePortLane* target = &port->lanes[lane];
+  std::lock_guard<std::mutex> lock(port->mutex);
+  if (port->closing) {
+    return;
+  }
+  target->queue.push_back(std::move(queued));
+  port->stats.queue_depth++;
+  port->stats.max_queue_depth =
+      std::max(port->stats.max_queue_depth, port->stats.queue_depth);
+  ScheduleNativePortLane(port, target);
+}
+
+// Starts the message a ready-queue entry stands for. The entry's reference
+// keeps the port alive even when it is closed from its own handler.
+static void RunNativePortTask(const NativePortTask& task) {
+  NativePort* port = task.port.get();
+  NativePortLane* lane = task.lane;
+  std::unique_lock<std::mutex> lock(port->mutex);
+  lane->scheduled--;
+  if (port->closing || lane->queue.empty()) {
+    return;
+  }
+  NativePortMessage message = std::move(lane->queue.front());
+  lane->queue.pop_front();
+  port->stats.queue_depth--;
+  lane->active++;
+  port->active++;
+  lock.unlock();
+
+  const int64_t start_ns = MonotonicNowNs();
+  t_native_port_worker = port;
+  port->handler(port->user_data, port->id, message.object);
+  t_native_port_worker = nullptr;
+  const int64_t end_ns = MonotonicNowNs();
+  message.storage.reset();
+
+  lock.lock();
+  const int64_t wait_ns = start_ns - message.enqueued_ns;
+  const int64_t handler_ns = end_ns - start_ns;
+  DartVmEmbedNativePortStats& stats = port->stats;
+  stats.messages_handled++;
+  stats.queue_wait_ns_total += wait_ns;
+  stats.queue_wait_ns_max = std::max(stats.queue_wait_ns_max, wait_ns);
+  stats.handler_ns_total += handler_ns;
+  stats.handler_ns_max = std::max(stats.handler_ns_max, handler_ns);
+  lane->active--;
+  port->active--;
+  ScheduleNativePortLane(task.port, lane);
+  if (port->closing) {
+    port->idle_cv.notify_all();
+  }
+}
+
+static void NativePortPoolWorkerMain() {
+  std::unique_lock<std::mutex> lock(g_native_port_pool.mutex);
+  while (true) {
+    g_native_port_pool.cv.wait(lock, [] {
+      return g_native_port_pool.stopping || !g_native_port_pool.ready.empty();
+    });
+    if (g_native_port_pool.ready.empty()) {
+      break;
+    }
+    NativePortTask task = std::move(g_native_port_pool.ready.front());
+    g_native_port_pool.ready.pop_front();
+    lock.unlock();
+    RunNativePortTask(task);
+    task.port.reset();
+    lock.lock();
+  }
+}
+
+static void ResetNativePortPool(int size) {
+  if (size <= 0) {
+    size = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  std::lock_guard<std::mutex> lock(g_native_port_pool.mutex);
+  g_native_port_pool.size = size;
+}
+
+static void StartNativePortPool() {
+  std::lock_guard<std::mutex> lock(g_native_port_pool.mutex);
+  while (static_cast<int>(g_native_port_pool.workers.size()) <
+         g_native_port_pool.size) {
+    g_native_port_pool.workers.emplace_back(NativePortPoolWorkerMain);
+  }
+}
+
+// Runs after every port is closed, so the ready queue only holds entries of
+// closed ports, which the workers discard before exiting.
+static void StopNativePortPool() {
+  std::vector<std::thread> workers;
+  {
+    std::lock_guard<std::mutex> lock(g_native_port_pool.mutex);
+    g_native_port_pool.stopping = true;
+    workers.swap(g_native_port_pool.workers);
+  }
+  g_native_port_pool.cv.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  std::lock_guard<std::mutex> lock(g_native_port_pool.mutex);
+  g_native_port_pool.stopping = false;
+}
+
+// Closes the VM port first so no dispatch starts afterwards; one already
+// running sees |closing| and drops its message. Waits for running handlers
+// except the calling one, when a handler shuts down its port's owner.
+static void CloseNativePortRecord(const std::shared_ptr<NativePort>& port) {
+  Dart_CloseNativePort(port->id);
+  std::unique_lock<std::mutex> lock(port->mutex);
+  port->closing = true;
+  for (NativePortLane& lane : port->lanes) {
+    port->stats.messages_dropped += static_cast<int64_t>(lane.queue.size());
+    lane.queue.clear();
+  }
+  port->stats.queue_depth = 0;
+  const int self = t_native_port_worker == port.get() ? 1 : 0;
+  port->idle_cv.wait(lock, [&] { return port->active <= self; });
+}
+
+// Owner nullptr closes every port (VM cleanup).
+static void CloseOwnedNativePorts(Dart_Isolate owner) {
+  if (owner != nullptr) {
+    // Runs for every isolate shutdown and most isolates own no port.
+    std::shared_lock<std::shared_mutex> lock(g_native_ports_mutex);
+    if (std::none_of(g_native_ports.begin(), g_native_ports.end(),
+                     [owner](const auto& entry) {
+                       return entry.second->owner == owner;
+                     })) {
+      return;
+    }
+  }
+  std::vector<std::shared_ptr<NativePort>> closing;
+  {
+    std::unique_lock<std::shared_mutex> lock(g_native_ports_mutex);
+    for (auto it = g_native_ports.begin(); it != g_native_ports.end();) {
+      if (owner == nullptr || it->second->owner == owner) {
+        if (!it->second->name.empty()) {
+          g_native_port_names.erase(it->second->name);
+        }
+        closing.push_back(std::move(it->second));
+        it = g_native_ports.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  for (const auto& port : closing) {
+    CloseNativePortRecord(port);
+  }
+}
+
+// Set once any isolate has a placement, so unplaced hosts skip the lock.
+static std::atomic<bool> g_any_isolate_placement{false};
+static thread_local ThreadPlacement t_thread_placement;
+static thread_local Dart_Isolate t_placed_for_isolate = nullptr;
 
 static bool FileModifiedCallbackTrampoline(const char* url, int64_t since) {
+  AddMetric(kMetricReloadFileChecks, 1);
   if (g_file_modified_callback != nullptr) {
     return g_file_modified_callback(url, since);
   }
@@ -87,6 +1106,12 @@ extern const uint8_t kDartCoreIsolateSnapshotInstructions[];
 #endif
 }
 
+#if defined(DARTVM_EMBED_EMBEDDED_PLATFORM_KERNEL)
+// Emitted from cmake/DartVmEmbedIncbin.S.in when DARTVM_EMBED_PLATFORM_DILL=ON.
+extern "C" const uint8_t kDartVmEmbedPlatformDill[];
+extern "C" const int64_t kDartVmEmbedPlatformDillSize;
+#endif
+
 static char* DupMessage(const char* message) {
   if (message == nullptr) {
     return nullptr;
@@ -100,22 +1125,89 @@ static char* DupMessage(const char* message) {
   return out;
 }
 
-static void SetErrorIfUnset(char** error, const char* message) {
-  if (error != nullptr && *error == nullptr) {
+// Status of the current *Ex call. Callers of the *Ex APIs pass error=nullptr
+// down the shared code paths; failures are then recorded here instead of in a
+// malloc-allocated message. The first failure of a call wins.
+struct ThreadStatus {
+  DartVmEmbedStatus code;
+  char message[512];
+};
+
+static thread_local ThreadStatus t_status = {DARTVM_EMBED_STATUS_OK, {0}};
+
+static void ResetThreadStatus() {
+  t_status.code = DARTVM_EMBED_STATUS_OK;
+  t_status.message[0] = '\0';
+}
+
+static void RecordThreadStatus(DartVmEmbedStatus code, const char* message) {
+  if (t_status.code != DARTVM_EMBED_STATUS_OK) {
+    return;
+  }
+  t_status.code = code;
+  snprintf(t_status.message, sizeof(t_status.message), "%s",
+           message != nullptr ? message : "");
+}
+
+// Completes an *Ex call: success clears anything recorded on ignored
+// sub-paths, failure without a recorded status falls back to |fallback|.
+static DartVmEmbedStatus FinishThreadStatus(bool ok,
+                                            DartVmEmbedStatus fallback) {
+  if (ok) {
+    ResetThreadStatus();
+    return DARTVM_EMBED_STATUS_OK;
+  }
+  RecordThreadStatus(fallback, DartVmEmbed_StatusName(fallback));
+  return t_status.code;
+}
+
+static void SetStatusIfUnset(char** error,
+                             DartVmEmbedStatus code,
+                             const char* message) {
+  if (error == nullptr) {
+    RecordThreadStatus(code, message);
+    return;
+  }
+  if (*error == nullptr) {
     *error = DupMessage(message);
   }
 }
 
+static void SetErrorIfUnset(char** error, const char* message) {
+  SetStatusIfUnset(error, DARTVM_EMBED_STATUS_FAILED, message);
+}
+
+static DartVmEmbedStatus StatusFromErrorHandle(Dart_Handle result) {
+  if (Dart_IsCompilationError(result)) {
+    return DARTVM_EMBED_STATUS_COMPILE_ERROR;
+  }
+  if (Dart_IsUnhandledExceptionError(result)) {
+    return DARTVM_EMBED_STATUS_UNHANDLED_EXCEPTION;
+  }
+  return DARTVM_EMBED_STATUS_DART_ERROR;
+}
+
 static bool SetErrorFromHandle(Dart_Handle result, char** error) {
   if (!Dart_IsError(result)) {
     return false;
   }
   if (error != nullptr) {
     *error = DupMessage(Dart_GetError(result));
+  } else {
+    RecordThreadStatus(StatusFromErrorHandle(result), Dart_GetError(result));
   }
   return true;
 }
 
+// Moves a VM-allocated error (which may be null) into |error|.
+static void TakeVmError(char** error,
+                        DartVmEmbedStatus code,
+                        char* vm_error,
+                        const char* fallback) {
+  SetStatusIfUnset(error, code, vm_error != nullptr ? vm_error : fallback);
+  free(vm_error);
+}
+
 static bool IsUnsupportedVerifySdkHashFlag(const char* flag) {
   if (flag == nullptr) {
     return false;
@@ -135,29 +1227,190 @@ static bool ReadProgramFile(const char* path,
     *error = nullptr;
   }
   if (path == nullptr || out == nullptr) {
-    SetErrorIfUnset(error, "ReadProgramFile: invalid argument.");
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                     "ReadProgramFile: invalid argument.");
     return false;
   }
-  std::ifstream f(path, std::ios::binary);
-  if (!f.is_open()) {
-    SetErrorIfUnset(error, "ReadProgramFile: failed to open program file.");
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_IO_ERROR,
+                     "ReadProgramFile: failed to open program file.");
     return false;
   }
-  f.seekg(0, std::ios::end);
-  const std::streamsize size = f.tellg();
-  f.seekg(0, std::ios::beg);
-  if (size <= 0) {
-    SetErrorIfUnset(error, "ReadProgramFile: empty program file.");
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_IO_ERROR,
+                     "ReadProgramFile: empty program file.");
     return false;
   }
-  out->resize(static_cast<size_t>(size));
-  if (!f.read(reinterpret_cast<char*>(out->data()), size).good()) {
-    SetErrorIfUnset(error, "ReadProgramFile: failed to read program file.");
+  out->resize(static_cast<size_t>(st.st_size));
+  size_t done = 0;
+  while (done < out->size()) {
+    const ssize_t n = read(fd, out->data() + done, out->size() - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    done += static_cast<size_t>(n);
+  }
+  close(fd);
+  if (done != out->size()) {
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_IO_ERROR,
+                     "ReadProgramFile: failed to read program file.");
     return false;
   }
   return true;
 }
 
+static bool WriteFully(int fd, const void* buffer, size_t size) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(buffer);
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t n = write(fd, in + done, size - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+#if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+// AppJIT cache entries are standard app snapshots, the format
+// dart::bin::Snapshot writes for --snapshot-kind=app-jit, named after a hash
+// and the size of the kernel they were trained from. The VM rejects a
+// snapshot from a different SDK build when the isolate is created, which
+// callers treat as a miss.
+static uint64_t HashKernel(const uint8_t* buffer, intptr_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (intptr_t i = 0; i < size; ++i) {
+    hash ^= buffer[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static std::string AppJitCachePath(const char* cache_dir,
+                                   const uint8_t* kernel_buffer,
+                                   intptr_t kernel_buffer_size) {
+  char name[64];
+  snprintf(name, sizeof(name), "%016llx-%llx.appjit",
+           static_cast<unsigned long long>(
+               HashKernel(kernel_buffer, kernel_buffer_size)),
+           static_cast<unsigned long long>(kernel_buffer_size));
+  std::string path = cache_dir;
+  if (!path.empty() && path.back() != '/') {
+    path.push_back('/');
+  }
+  path += name;
+  return path;
+}
+
+// Blob alignment of the app snapshot format (kAppSnapshotPageSize in
+// bin/snapshot_utils.cc).
+static const int64_t kAppSnapshotPageSize = 16 * 1024;
+
+static int64_t RoundUpToAppSnapshotPage(int64_t offset) {
+  return (offset + kAppSnapshotPageSize - 1) & ~(kAppSnapshotPageSize - 1);
+}
+
+// Writes an AppJIT snapshot in the layout Snapshot::TryReadAppSnapshot reads:
+// the AppJIT magic number, the VM data/instructions and isolate
+// data/instructions sizes as native int64s, then each blob at the next page
+// boundary. AppJIT snapshots carry no VM blobs, so their sizes are 0.
+static bool WriteAppJitSnapshotFile(int fd,
+                                    const uint8_t* data,
+                                    intptr_t data_size,
+                                    const uint8_t* instructions,
+                                    intptr_t instructions_size) {
+  static const uint8_t kAppJitMagic[8] = {0xdc, 0xdc, 0xf6, 0xf6, 0, 0, 0, 0};
+  int64_t header[5] = {0, 0, 0, data_size, instructions_size};
+  memcpy(&header[0], kAppJitMagic, sizeof(kAppJitMagic));
+  const int64_t data_offset = RoundUpToAppSnapshotPage(sizeof(header));
+  const int64_t instructions_offset =
+      RoundUpToAppSnapshotPage(data_offset + data_size);
+  return WriteFully(fd, header, sizeof(header)) &&
+         lseek(fd, data_offset, SEEK_SET) == data_offset &&
+         WriteFully(fd, data, static_cast<size_t>(data_size)) &&
+         lseek(fd, instructions_offset, SEEK_SET) == instructions_offset &&
+         WriteFully(fd, instructions, static_cast<size_t>(instructions_size)) &&
+         fsync(fd) == 0;
+}
+#endif
+
+#if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+// Resolution order: explicit path (config, then DARTVM_EMBED_PLATFORM_DILL_PATH)
+// mapped read-only, platform embedded into this library, DFE built-in platform.
+static bool LoadSharedPlatformKernel(const char* path, char** error) {
+  if (g_platform_kernel.buffer != nullptr) {
+    return true;
+  }
+  if (path == nullptr || path[0] == '\0') {
+    path = getenv("DARTVM_EMBED_PLATFORM_DILL_PATH");
+  }
+  if (path != nullptr && path[0] != '\0') {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      SetErrorIfUnset(error,
+                      "LoadSharedPlatformKernel: failed to open platform kernel.");
+      return false;
+    }
+    const size_t mapping_size = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      SetErrorIfUnset(error,
+                      "LoadSharedPlatformKernel: failed to map platform kernel.");
+      return false;
+    }
+    g_platform_kernel.mapping = mapping;
+    g_platform_kernel.mapping_size = mapping_size;
+    g_platform_kernel.buffer = reinterpret_cast<const uint8_t*>(mapping);
+    g_platform_kernel.size = static_cast<intptr_t>(mapping_size);
+    return true;
+  }
+#if defined(DARTVM_EMBED_EMBEDDED_PLATFORM_KERNEL)
+  g_platform_kernel.buffer = kDartVmEmbedPlatformDill;
+  g_platform_kernel.size = static_cast<intptr_t>(kDartVmEmbedPlatformDillSize);
+#else
+  dart::bin::dfe.LoadPlatform(&g_platform_kernel.buffer, &g_platform_kernel.size);
+#endif
+  return true;
+}
+#endif
+
+static void ReleaseSharedPlatformKernel(void) {
+  if (g_platform_kernel.mapping != nullptr) {
+    munmap(g_platform_kernel.mapping, g_platform_kernel.mapping_size);
+  }
+  g_platform_kernel = SharedPlatformKernel();
+}
+
+// Falls back to the app kernel when no platform is available, matching the
+// standalone embedder.
+static void SelectPlatformKernel(const uint8_t* app_kernel_buffer,
+                                 intptr_t app_kernel_buffer_size,
+                                 const uint8_t** out_buffer,
+                                 intptr_t* out_size) {
+  if (g_platform_kernel.buffer != nullptr && g_platform_kernel.size > 0) {
+    *out_buffer = g_platform_kernel.buffer;
+    *out_size = g_platform_kernel.size;
+    return;
+  }
+  *out_buffer = app_kernel_buffer;
+  *out_size = app_kernel_buffer_size;
+}
+
 static const char* EffectivePackagesConfig(const char* packages_config) {
   if (packages_config != nullptr) {
     return packages_config;
@@ -165,11 +1418,100 @@ static const char* EffectivePackagesConfig(const char* packages_config) {
   return dart::bin::Options::packages_file();
 }
 
+// Hot reload: user isolates load the service library and the kernel service
+// stays pinned. The service isolate itself is g_service_isolate_enabled.
 static bool ShouldEnableVmService(void) {
   const char* hot_reload = getenv("DARTVM_EMBED_HOT_RELOAD");
   return hot_reload != nullptr && strcmp(hot_reload, "1") == 0;
 }
 
+// Kernel service lifecycle. Dart_Initialize always requests the kernel
+// isolate; with lazy startup its creation callback waits here until the
+// first caller that needs compilation releases it, and startup then runs on
+// the VM thread pool while the caller continues.
+enum KernelServiceMode {
+  kKernelServiceDisabled = 0,
+  kKernelServiceLazy,
+  kKernelServiceStarted,
+};
+
+struct KernelServiceState {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<int> mode{kKernelServiceDisabled};
+  bool lazy = false;
+  std::atomic<int64_t> initialized_ns{0};
+  std::atomic<int64_t> requested_ns{-1};
+  std::atomic<int64_t> ready_ns{-1};
+};
+
+static KernelServiceState g_kernel_service;
+
+// Disabled also lets a waiting kernel isolate creation fail, so
+// Dart_Cleanup does not wait on it forever.
+static void ResetKernelService(KernelServiceMode mode, bool lazy) {
+  {
+    std::lock_guard<std::mutex> lock(g_kernel_service.mutex);
+    g_kernel_service.mode.store(mode, std::memory_order_release);
+    g_kernel_service.lazy = lazy;
+    g_kernel_service.initialized_ns.store(MonotonicNowNs(),
+                                          std::memory_order_relaxed);
+    g_kernel_service.requested_ns.store(
+        mode == kKernelServiceStarted ? MonotonicNowNs() : -1,
+        std::memory_order_relaxed);
+    g_kernel_service.ready_ns.store(-1, std::memory_order_relaxed);
+  }
+  g_kernel_service.cv.notify_all();
+}
+
+// Releases a deferred kernel isolate creation. Returns without waiting for
+// the isolate: the VM's compile path waits for the kernel port itself.
+static bool EnsureKernelServiceStarted() {
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  return false;
+#else
+  {
+    std::lock_guard<std::mutex> lock(g_kernel_service.mutex);
+    const int mode = g_kernel_service.mode.load(std::memory_order_relaxed);
+    if (mode != kKernelServiceLazy) {
+      return mode == kKernelServiceStarted;
+    }
+    g_kernel_service.requested_ns.store(MonotonicNowNs(),
+                                        std::memory_order_relaxed);
+    g_kernel_service.mode.store(kKernelServiceStarted,
+                                std::memory_order_release);
+  }
+  g_kernel_service.cv.notify_all();
+  return true;
+#endif
+}
+
+#if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+// Returns false when the VM is shutting down instead.
+static bool WaitForKernelServiceStart() {
+  std::unique_lock<std::mutex> lock(g_kernel_service.mutex);
+  g_kernel_service.cv.wait(lock, [] {
+    return g_kernel_service.mode.load(std::memory_order_relaxed) !=
+           kKernelServiceLazy;
+  });
+  return g_kernel_service.mode.load(std::memory_order_relaxed) ==
+         kKernelServiceStarted;
+}
+
+// dfe reads kernel (and kernel list) scripts directly; only sources need the
+// kernel service.
+static bool ScriptNeedsKernelService(const char* script_uri) {
+  const char* path = script_uri;
+  if (strncmp(path, "file://", 7) == 0) {
+    path += 7;
+  }
+  const dart::bin::DartUtils::MagicNumber magic =
+      dart::bin::DartUtils::SniffForMagicNumber(path);
+  return magic != dart::bin::DartUtils::kKernelMagicNumber &&
+         magic != dart::bin::DartUtils::kKernelListMagicNumber;
+}
+#endif
+
 static const char* SanitizePathLikeMain(const char* path, std::string* storage) {
   if (path == nullptr) {
     return nullptr;
@@ -186,45 +1528,138 @@ static const char* SanitizePathLikeMain(const char* path, std::string* storage)
   }
   return storage->c_str();
 #else
-  *storage = path;
-  return storage->c_str();
+  (void)storage;
+  return path;
 #endif
 }
 
+static bool ContainsBytes(const uint8_t* haystack,
+                          intptr_t haystack_len,
+                          const char* needle) {
+  const size_t needle_len = strlen(needle);
+  if (haystack_len < 0 || static_cast<size_t>(haystack_len) < needle_len) {
+    return false;
+  }
+  const size_t last = static_cast<size_t>(haystack_len) - needle_len;
+  for (size_t i = 0; i <= last; ++i) {
+    if (memcmp(haystack + i, needle, needle_len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 static bool IsVmServiceResponseSuccess(const uint8_t* response_json,
                                        intptr_t response_len) {
   if (response_json == nullptr || response_len <= 0) {
     return false;
   }
-  std::string response(reinterpret_cast<const char*>(response_json),
-                       static_cast<size_t>(response_len));
-  if (response.find("\"error\"") != std::string::npos &&
-      response.find("\"error\":null") == std::string::npos) {
+  if (ContainsBytes(response_json, response_len, "\"error\"") &&
+      !ContainsBytes(response_json, response_len, "\"error\":null")) {
     return false;
   }
-  return response.find("\"result\"") != std::string::npos;
+  return ContainsBytes(response_json, response_len, "\"result\"");
+}
+
+// The VM asks for the service isolate from a thread-pool task during
+// Dart_Initialize. When deferred, that task waits here until the first user
+// isolate is runnable (or a caller needs the service), so creating the
+// service isolate and binding its HTTP server stay off the startup path.
+struct ServiceIsolateGate {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool open = true;
+  bool shutting_down = false;
+};
+
+static ServiceIsolateGate g_service_isolate_gate;
+
+static void ResetServiceIsolateGate(bool deferred) {
+  std::lock_guard<std::mutex> lock(g_service_isolate_gate.mutex);
+  g_service_isolate_gate.open = !deferred;
+  g_service_isolate_gate.shutting_down = false;
+}
+
+static void OpenServiceIsolateGate() {
+  {
+    std::lock_guard<std::mutex> lock(g_service_isolate_gate.mutex);
+    if (g_service_isolate_gate.open) {
+      return;
+    }
+    g_service_isolate_gate.open = true;
+  }
+  g_service_isolate_gate.cv.notify_all();
+#if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  // The service accepts reloadSources at any time, so start compiling support
+  // in the background now rather than on the first reload.
+  if (ShouldEnableVmService()) {
+    EnsureKernelServiceStarted();
+  }
+#endif
+}
+
+// Lets a waiting service isolate creation fail so Dart_Cleanup does not wait
+// on it forever.
+static void CloseServiceIsolateGateForShutdown() {
+  {
+    std::lock_guard<std::mutex> lock(g_service_isolate_gate.mutex);
+    g_service_isolate_gate.open = true;
+    g_service_isolate_gate.shutting_down = true;
+  }
+  g_service_isolate_gate.cv.notify_all();
+}
+
+// Returns false when the VM is shutting down instead.
+static bool WaitForServiceIsolateGate() {
+  std::unique_lock<std::mutex> lock(g_service_isolate_gate.mutex);
+  g_service_isolate_gate.cv.wait(
+      lock, [] { return g_service_isolate_gate.open; });
+  return !g_service_isolate_gate.shutting_down;
+}
+
+// Copies the VM service id of |isolate| into |out|. The id only depends on
+// the isolate's main port, so the isolate is not entered: it may be running
+// on another thread, which is what lets it answer the service request.
+static bool ResolveIsolateServiceId(Dart_Isolate isolate,
+                                    char* out,
+                                    size_t out_size) {
+  char* isolate_service_id =
+      const_cast<char*>(Dart_IsolateServiceId(isolate));
+  const int len =
+      isolate_service_id != nullptr && isolate_service_id[0] != '\0'
+          ? snprintf(out, out_size, "%s", isolate_service_id)
+          : -1;
+  free(isolate_service_id);
+  return len > 0 && static_cast<size_t>(len) < out_size;
 }
 
 static bool WarmupVmServiceReloadCompiler(Dart_Isolate isolate, char** error) {
   if (!ShouldEnableVmService()) {
     return true;
   }
-  if (g_vmservice_warmed_isolates.find(isolate) != g_vmservice_warmed_isolates.end()) {
-    return true;
+  OpenServiceIsolateGate();
+  // reloadSources compiles through the kernel service.
+  EnsureKernelServiceStarted();
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    auto it = g_isolate_records.find(isolate);
+    if (it != g_isolate_records.end() && it->second.service_warmed) {
+      return true;
+    }
   }
 
-  bool entered = false;
-  if (Dart_CurrentIsolate() == nullptr) {
-    Dart_EnterIsolate(isolate);
-    entered = true;
-  }
-  const char* isolate_service_id = Dart_IsolateServiceId(isolate);
-  std::string service_id =
-      isolate_service_id != nullptr ? isolate_service_id : "";
-  if (entered) {
-    Dart_ExitIsolate();
-  }
-  if (service_id.empty()) {
+  char isolate_service_id[128];
+  char req[256];
+  const int req_len =
+      ResolveIsolateServiceId(isolate, isolate_service_id,
+                              sizeof(isolate_service_id))
+          ? snprintf(req, sizeof(req),
+                     "{\"jsonrpc\":\"2.0\",\"id\":\"warmup\","
+                     "\"method\":\"reloadSources\",\"params\":{"
+                     "\"isolateId\":\"%s\",\"force\":true}}",
+                     isolate_service_id)
+          : -1;
+  if (req_len < 0 || static_cast<size_t>(req_len) >= sizeof(req)) {
     SetErrorIfUnset(error,
                     "WarmupVmServiceReloadCompiler: failed to resolve isolate "
                     "service id.");
@@ -233,24 +1668,28 @@ static bool WarmupVmServiceReloadCompiler(Dart_Isolate isolate, char** error) {
 
   const int max_retries = 10;
   for (int i = 0; i < max_retries; ++i) {
-    const std::string req =
-        "{\"jsonrpc\":\"2.0\",\"id\":\"warmup\",\"method\":\"reloadSources\","
-        "\"params\":{\"isolateId\":\"" +
-        service_id + "\",\"force\":true}}";
     uint8_t* response_json = nullptr;
     intptr_t response_len = 0;
     char* vm_error = nullptr;
     const bool invoked = Dart_InvokeVMServiceMethod(
-        reinterpret_cast<uint8_t*>(const_cast<char*>(req.c_str())),
-        static_cast<intptr_t>(req.size()), &response_json, &response_len, &vm_error);
+        reinterpret_cast<uint8_t*>(req), static_cast<intptr_t>(req_len),
+        &response_json, &response_len, &vm_error);
     if (invoked && IsVmServiceResponseSuccess(response_json, response_len)) {
       free(response_json);
       free(vm_error);
-      g_vmservice_warmed_isolates.insert(isolate);
+      {
+        std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+        auto it = g_isolate_records.find(isolate);
+        if (it != g_isolate_records.end()) {
+          it->second.service_warmed = true;
+        }
+      }
+      AddMetric(kMetricServiceWarmups, 1);
       return true;
     }
     free(response_json);
     free(vm_error);
+    AddMetric(kMetricServiceWarmupRetries, 1);
     usleep(200 * 1000);
   }
 
@@ -259,15 +1698,452 @@ static bool WarmupVmServiceReloadCompiler(Dart_Isolate isolate, char** error) {
   return false;
 }
 
+#if defined(__linux__)
+// Reads /sys/devices/system/node/node<N>/cpulist ("0-7,16-23").
+static bool ReadNumaNodeCpus(int numa_node, std::vector<int>* cpus) {
+  char path[96];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+           numa_node);
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) {
+    return false;
+  }
+  char line[1024];
+  const bool read_ok = fgets(line, sizeof(line), f) != nullptr;
+  fclose(f);
+  if (!read_ok) {
+    return false;
+  }
+  const char* p = line;
+  while (*p != '\0' && *p != '\n') {
+    char* end = nullptr;
+    const long first = strtol(p, &end, 10);
+    if (end == p) {
+      return false;
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(static_cast<int>(cpu));
+    }
+    if (*p == ',') {
+      ++p;
+    }
+  }
+  return !cpus->empty();
+}
+
+static void CurrentCpuAndNode(int* cpu, int* numa_node) {
+  unsigned int c = 0;
+  unsigned int n = 0;
+  if (syscall(SYS_getcpu, &c, &n, nullptr) == 0) {
+    *cpu = static_cast<int>(c);
+    *numa_node = static_cast<int>(n);
+  } else {
+    *cpu = -1;
+    *numa_node = -1;
+  }
+}
+#endif
+
+// Builds a placement from a public description. An empty CPU list with a
+// NUMA node selects all CPUs of that node.
+static bool ResolvePlacement(const DartVmEmbedPlacement* in,
+                             ThreadPlacement* out,
+                             char** error) {
+  *out = ThreadPlacement();
+  if (in == nullptr || (in->cpu_count <= 0 && in->numa_node < 0)) {
+    return true;
+  }
+  if (in->cpu_count > 0 && in->cpus == nullptr) {
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                     "ResolvePlacement: cpus is null.");
+    return false;
+  }
+  if (in->numa_node >= 64) {
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                     "ResolvePlacement: numa_node must be below 64.");
+    return false;
+  }
+#if defined(__linux__)
+  out->active = true;
+  out->numa_node = in->numa_node;
+  out->cpus.assign(in->cpus, in->cpus + (in->cpu_count > 0 ? in->cpu_count : 0));
+  if (out->cpus.empty() && !ReadNumaNodeCpus(in->numa_node, &out->cpus)) {
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                     "ResolvePlacement: unknown NUMA node.");
+    return false;
+  }
+  for (int cpu : out->cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "ResolvePlacement: CPU index outside the cpu_set_t "
+                       "range.");
+      return false;
+    }
+  }
+  return true;
+#else
+  SetStatusIfUnset(error, DARTVM_EMBED_STATUS_UNSUPPORTED,
+                   "ResolvePlacement: CPU placement is only supported on "
+                   "Linux.");
+  return false;
+#endif
+}
+
+// Pins the calling thread and sets its preferred NUMA node, so pages it
+// touches first (heap pages of isolates it creates or runs) are node-local.
+static bool ApplyThreadPlacement(const ThreadPlacement& placement) {
+  if (!placement.active) {
+    return true;
+  }
+#if defined(__linux__)
+  bool ok = true;
+  if (!placement.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    // ResolvePlacement rejected indices outside the set.
+    for (int cpu : placement.cpus) {
+      CPU_SET(cpu, &set);
+    }
+    ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  }
+  if (placement.numa_node >= 0) {
+    const int kMpolPreferred = 1;
+    unsigned long nodemask = 1UL << placement.numa_node;
+    // The kernel reads maxnode - 1 bits, so one more than the mask width.
+    ok = syscall(SYS_set_mempolicy, kMpolPreferred, &nodemask,
+                 sizeof(nodemask) * 8 + 1) == 0 &&
+         ok;
+  }
+  return ok;
+#else
+  return false;
+#endif
+}
+
+static void OnVmThreadStart() {
+  if (ApplyThreadPlacement(g_vm_thread_placement) &&
+      g_vm_thread_placement.active) {
+    g_vm_threads_placed.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+static void RecordIsolatePlacement(Dart_Isolate isolate) {
+  if (!t_thread_placement.active) {
+    return;
+  }
+  IsolatePlacement record;
+  record.placement = t_thread_placement;
+#if defined(__linux__)
+  CurrentCpuAndNode(&record.last_cpu, &record.last_numa_node);
+#endif
+  // Root isolates get their record after setup; TrackIsolateRecord picks the
+  // placement up from this thread then.
+  t_pending_placement_isolate = isolate;
+  t_pending_placement = record;
+  g_any_isolate_placement.store(true, std::memory_order_relaxed);
+  t_placed_for_isolate = isolate;
+}
+
+// Called by the helpers that enter |isolate| on behalf of the host.
+static void ApplyIsolatePlacement(Dart_Isolate isolate) {
+  if (!g_any_isolate_placement.load(std::memory_order_relaxed) ||
+      t_placed_for_isolate == isolate) {
+    return;
+  }
+  ThreadPlacement placement;
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    auto it = g_isolate_records.find(isolate);
+    if (it == g_isolate_records.end() || !it->second.has_placement) {
+      return;
+    }
+    placement = it->second.placement.placement;
+  }
+  if (ApplyThreadPlacement(placement)) {
+    t_thread_placement = placement;
+    t_placed_for_isolate = isolate;
+  }
+#if defined(__linux__)
+  int last_cpu = -1;
+  int last_numa_node = -1;
+  CurrentCpuAndNode(&last_cpu, &last_numa_node);
+  std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+  auto it = g_isolate_records.find(isolate);
+  if (it != g_isolate_records.end() && it->second.has_placement) {
+    it->second.placement.last_cpu = last_cpu;
+    it->second.placement.last_numa_node = last_numa_node;
+  }
+#endif
+}
+
+// Run-budget watchdog: one hashed timer wheel (1ms ticks, 512 slots) served
+// by a thread that starts on first use and sleeps while nothing is armed.
+// Timers live on the stack of the call they guard, so arming allocates
+// nothing. An expired timer kills its isolate with Dart_KillIsolate, called
+// without the wheel lock held. Whichever of expiry and the guarded call's
+// completion claims the timer first under the lock decides the outcome.
+enum WatchdogTimerState {
+  kWatchdogTimerArmed,
+  kWatchdogTimerFiring,
+  kWatchdogTimerKilled,
+  kWatchdogTimerCompleted,
+};
+
+struct WatchdogTimer {
+  Dart_Isolate isolate = nullptr;
+  size_t slot = 0;
+  uint64_t rounds = 0;
+  WatchdogTimerState state = kWatchdogTimerCompleted;
+};
+
+static const int64_t kWatchdogTickNs = 1000 * 1000;
+static const size_t kWatchdogSlots = 512;
+
+struct Watchdog {
+  std::mutex mutex;
+  std::condition_variable cv;
+  // Signalled when firing timers have been killed.
+  std::condition_variable killed_cv;
+  std::thread thread;
+  bool running = false;
+  bool stopping = false;
+  size_t armed = 0;
+  uint64_t current_tick = 0;
+  std::chrono::steady_clock::time_point epoch;
+  std::vector<WatchdogTimer*> slots[kWatchdogSlots];
+  // Timers claimed by the current tick, killed outside the lock. Only the
+  // watchdog thread touches it; its capacity is reused across ticks.
+  std::vector<WatchdogTimer*> firing;
+};
+
+static Watchdog g_watchdog;
+
+static uint64_t WatchdogNowTick() {
+  const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - g_watchdog.epoch);
+  return static_cast<uint64_t>(elapsed.count() / kWatchdogTickNs);
+}
+
+static void WatchdogMain() {
+  std::unique_lock<std::mutex> lock(g_watchdog.mutex);
+  while (!g_watchdog.stopping) {
+    if (g_watchdog.armed == 0) {
+      g_watchdog.cv.wait(lock);
+      continue;
+    }
+    const uint64_t now_tick = WatchdogNowTick();
+    while (g_watchdog.current_tick < now_tick) {
+      ++g_watchdog.current_tick;
+      std::vector<WatchdogTimer*>& slot =
+          g_watchdog.slots[g_watchdog.current_tick % kWatchdogSlots];
+      for (size_t i = 0; i < slot.size();) {
+        WatchdogTimer* timer = slot[i];
+        if (timer->rounds > 0) {
+          --timer->rounds;
+          ++i;
+          continue;
+        }
+        timer->state = kWatchdogTimerFiring;
+        g_watchdog.firing.push_back(timer);
+        slot[i] = slot.back();
+        slot.pop_back();
+        --g_watchdog.armed;
+      }
+    }
+    if (!g_watchdog.firing.empty()) {
+      // Firing timers stay valid: their owners wait for kWatchdogTimerKilled.
+      lock.unlock();
+      for (WatchdogTimer* timer : g_watchdog.firing) {
+        Dart_KillIsolate(timer->isolate);
+      }
+      lock.lock();
+      for (WatchdogTimer* timer : g_watchdog.firing) {
+        timer->state = kWatchdogTimerKilled;
+      }
+      g_watchdog.firing.clear();
+      g_watchdog.killed_cv.notify_all();
+      continue;
+    }
+    g_watchdog.cv.wait_until(
+        lock, g_watchdog.epoch + std::chrono::nanoseconds(
+                                     (g_watchdog.current_tick + 1) *
+                                     kWatchdogTickNs));
+  }
+}
+
+static void ArmWatchdog(WatchdogTimer* timer,
+                        Dart_Isolate isolate,
+                        int64_t budget_ns) {
+  std::lock_guard<std::mutex> lock(g_watchdog.mutex);
+  if (!g_watchdog.running) {
+    g_watchdog.epoch = std::chrono::steady_clock::now();
+    g_watchdog.current_tick = 0;
+    g_watchdog.stopping = false;
+    g_watchdog.thread = std::thread(WatchdogMain);
+    g_watchdog.running = true;
+  }
+  const uint64_t now_tick = WatchdogNowTick();
+  if (g_watchdog.armed == 0) {
+    // Nothing is pending, so idle ticks can be skipped.
+    g_watchdog.current_tick = now_tick;
+  }
+  const uint64_t ticks =
+      budget_ns <= kWatchdogTickNs
+          ? 1
+          : static_cast<uint64_t>((budget_ns + kWatchdogTickNs - 1) /
+                                  kWatchdogTickNs);
+  const uint64_t target = now_tick + ticks;
+  timer->isolate = isolate;
+  timer->state = kWatchdogTimerArmed;
+  timer->slot = target % kWatchdogSlots;
+  timer->rounds = (target - g_watchdog.current_tick - 1) / kWatchdogSlots;
+  g_watchdog.slots[timer->slot].push_back(timer);
+  ++g_watchdog.armed;
+  g_watchdog.cv.notify_one();
+}
+
+// Marks the guarded call completed. Returns true when expiry claimed the
+// timer first; the isolate has then been killed by the time this returns.
+static bool DisarmWatchdog(WatchdogTimer* timer) {
+  std::unique_lock<std::mutex> lock(g_watchdog.mutex);
+  if (timer->state == kWatchdogTimerArmed) {
+    std::vector<WatchdogTimer*>& slot = g_watchdog.slots[timer->slot];
+    for (size_t i = 0; i < slot.size(); ++i) {
+      if (slot[i] == timer) {
+        slot[i] = slot.back();
+        slot.pop_back();
+        --g_watchdog.armed;
+        break;
+      }
+    }
+    timer->state = kWatchdogTimerCompleted;
+    return false;
+  }
+  g_watchdog.killed_cv.wait(
+      lock, [timer] { return timer->state == kWatchdogTimerKilled; });
+  return true;
+}
+
+static void StopWatchdog() {
+  {
+    std::lock_guard<std::mutex> lock(g_watchdog.mutex);
+    if (!g_watchdog.running) {
+      return;
+    }
+    g_watchdog.stopping = true;
+    g_watchdog.cv.notify_one();
+  }
+  g_watchdog.thread.join();
+  std::lock_guard<std::mutex> lock(g_watchdog.mutex);
+  g_watchdog.running = false;
+  g_watchdog.stopping = false;
+}
+
+static uint64_t FfiNativeNameHash(const char* name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (; *name != '\0'; ++name) {
+    hash = (hash ^ static_cast<uint8_t>(*name)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static uint64_t FfiNativeSeededHash(uint64_t hash, uint32_t seed) {
+  uint64_t x = hash ^ (seed * 0x9E3779B97F4A7C15ull);
+  x = (x ^ (x >> 33)) * 0xFF51AFD7ED558CCDull;
+  x = (x ^ (x >> 33)) * 0xC4CEB9FE1A85EC53ull;
+  return x ^ (x >> 33);
+}
+
+static void* ResolveFfiNative(const char* name, uintptr_t args_n) {
+  if (name == nullptr) {
+    return nullptr;
+  }
+  // Embedder natives, so statically linked hosts need not export them.
+  if (args_n == 1 && strcmp(name, "DartVmEmbed_LookupNativeSendPort") == 0) {
+    return reinterpret_cast<void*>(&DartVmEmbed_LookupNativeSendPort);
+  }
+  const FfiNativeTable& table = g_ffi_natives;
+  if (table.slots.empty()) {
+    return nullptr;
+  }
+  const uint64_t hash = FfiNativeNameHash(name);
+  const uint32_t seed =
+      table.seeds[FfiNativeSeededHash(hash, 0) % table.seeds.size()];
+  const FfiNativeSlot& slot =
+      table.slots[FfiNativeSeededHash(hash, seed) % table.slots.size()];
+  if (slot.name == name) {
+    if (slot.args_n >= 0 && static_cast<uintptr_t>(slot.args_n) != args_n) {
+      return nullptr;
+    }
+    return slot.function;
+  }
+  return nullptr;
+}
+
+void* DartVmEmbed_LookupFfiNative(const char* name, intptr_t args_n) {
+  if (args_n < 0) {
+    return nullptr;
+  }
+  return ResolveFfiNative(name, static_cast<uintptr_t>(args_n));
+}
+
+// Points every non-SDK library loaded so far at the embedder's natives and
+// the static table. Libraries belong to the group, so this runs once per
+// group.
+static Dart_Handle InstallFfiNativeResolver() {
+  Dart_Handle libraries = Dart_GetLoadedLibraries();
+  if (Dart_IsError(libraries)) {
+    return libraries;
+  }
+  intptr_t length = 0;
+  Dart_Handle result = Dart_ListLength(libraries, &length);
+  if (Dart_IsError(result)) {
+    return result;
+  }
+  for (intptr_t i = 0; i < length; ++i) {
+    Dart_Handle library = Dart_ListGetAt(libraries, i);
+    if (Dart_IsError(library)) {
+      return library;
+    }
+    const char* url = nullptr;
+    result = Dart_StringToCString(Dart_LibraryUrl(library), &url);
+    if (Dart_IsError(result)) {
+      return result;
+    }
+    if (strncmp(url, "dart:", 5) == 0) {
+      continue;
+    }
+    result = Dart_SetFfiNativeResolver(library, ResolveFfiNative);
+    if (Dart_IsError(result)) {
+      return result;
+    }
+  }
+  return Dart_Null();
+}
+
+// |group_cache| is the group's cached setup when initializing a spawned
+// isolate: the package config is taken already resolved, and native
+// resolvers, which live on the group's shared libraries, are not reinstalled.
 static Dart_Handle SetupCoreLibraries(Dart_Isolate isolate,
                                       dart::bin::IsolateData* isolate_data,
                                       bool is_isolate_group_start,
                                       bool is_kernel_isolate,
-                                      const char** resolved_packages_config) {
+                                      const char** resolved_packages_config,
+                                      const GroupSetupCache* group_cache) {
   (void)isolate;
   auto* isolate_group_data = isolate_data->isolate_group_data();
   const char* packages_file = isolate_data->packages_file();
   const char* script_uri = isolate_group_data->script_url;
+  if (group_cache != nullptr &&
+      !group_cache->resolved_packages_config.empty()) {
+    packages_file = group_cache->resolved_packages_config.c_str();
+  }
 
   Dart_Handle result =
       dart::bin::DartUtils::PrepareForScriptLoading(false, false);
@@ -301,10 +2177,12 @@ static Dart_Handle SetupCoreLibraries(Dart_Isolate isolate,
     return result;
   }
 
-  dart::bin::Builtin::SetNativeResolver(dart::bin::Builtin::kBuiltinLibrary);
-  dart::bin::Builtin::SetNativeResolver(dart::bin::Builtin::kIOLibrary);
-  dart::bin::Builtin::SetNativeResolver(dart::bin::Builtin::kCLILibrary);
-  dart::bin::VmService::SetNativeResolver();
+  if (group_cache == nullptr) {
+    dart::bin::Builtin::SetNativeResolver(dart::bin::Builtin::kBuiltinLibrary);
+    dart::bin::Builtin::SetNativeResolver(dart::bin::Builtin::kIOLibrary);
+    dart::bin::Builtin::SetNativeResolver(dart::bin::Builtin::kCLILibrary);
+    dart::bin::VmService::SetNativeResolver();
+  }
 
   const char* namespc = is_kernel_isolate ? nullptr : nullptr;
   result = dart::bin::DartUtils::SetupIOLibrary(namespc, script_uri, false);
@@ -349,12 +2227,17 @@ static bool SetupRootIsolateAndMakeRunnable(Dart_Isolate isolate,
   result = SetupCoreLibraries(isolate, isolate_data,
                               /*is_isolate_group_start=*/true,
                               /*is_kernel_isolate=*/false,
-                              &resolved_packages_config);
+                              &resolved_packages_config,
+                              /*group_cache=*/nullptr);
   if (SetErrorFromHandle(result, error)) {
     Dart_ExitScope();
     Dart_ShutdownIsolate();
     return false;
   }
+  GroupSetupCache group_cache;
+  if (resolved_packages_config != nullptr) {
+    group_cache.resolved_packages_config = resolved_packages_config;
+  }
 
 #if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
   auto* isolate_group_data = isolate_data->isolate_group_data();
@@ -391,6 +2274,7 @@ static bool SetupRootIsolateAndMakeRunnable(Dart_Isolate isolate,
       Dart_ShutdownIsolate();
       return false;
     }
+    group_cache.resolved_script_uri = resolved_script_uri;
   }
 #endif
 
@@ -403,14 +2287,28 @@ static bool SetupRootIsolateAndMakeRunnable(Dart_Isolate isolate,
     }
   }
 
+  result = InstallFfiNativeResolver();
+  if (SetErrorFromHandle(result, error)) {
+    Dart_ExitScope();
+    Dart_ShutdownIsolate();
+    return false;
+  }
+
   Dart_ExitScope();
   Dart_ExitIsolate();
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_group_setup_caches[isolate_data->isolate_group_data()] =
+        std::move(group_cache);
+  }
 
   char* make_runnable_error = Dart_IsolateMakeRunnable(isolate);
   if (make_runnable_error != nullptr) {
     if (error != nullptr) {
       *error = make_runnable_error;
     } else {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED,
+                         make_runnable_error);
       free(make_runnable_error);
     }
     Dart_EnterIsolate(isolate);
@@ -418,6 +2316,7 @@ static bool SetupRootIsolateAndMakeRunnable(Dart_Isolate isolate,
     return false;
   }
 
+  RecordIsolatePlacement(isolate);
   return true;
 }
 
@@ -441,6 +2340,18 @@ static bool OnIsolateInitialize(void** child_callback_data, char** error) {
     *child_callback_data = isolate_data;
   }
 
+  const int64_t start_ns = MonotonicNowNs();
+  // The entry outlives this call: the group cannot be cleaned up while one of
+  // its isolates is initializing, and map nodes do not move on rehash.
+  const GroupSetupCache* group_cache = nullptr;
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    auto it = g_group_setup_caches.find(isolate_group_data);
+    if (it != g_group_setup_caches.end()) {
+      group_cache = &it->second;
+    }
+  }
+
   Dart_EnterScope();
   const char* script_uri = isolate_group_data->script_url;
   if (script_uri == nullptr) {
@@ -451,7 +2362,7 @@ static bool OnIsolateInitialize(void** child_callback_data, char** error) {
       Dart_CurrentIsolate(), isolate_data,
       /*is_isolate_group_start=*/false,
       /*is_kernel_isolate=*/false,
-      /*resolved_packages_config=*/nullptr);
+      /*resolved_packages_config=*/nullptr, group_cache);
   if (SetErrorFromHandle(result, error)) {
     Dart_ExitScope();
     if (child_callback_data != nullptr) {
@@ -471,8 +2382,10 @@ static bool OnIsolateInitialize(void** child_callback_data, char** error) {
       delete isolate_data;
       return false;
     }
-  } else {
-    result = dart::bin::DartUtils::ResolveScript(Dart_NewStringFromCString(script_uri));
+  } else if (group_cache != nullptr &&
+             !group_cache->resolved_script_uri.empty()) {
+    result = dart::bin::Loader::InitForSnapshot(
+        group_cache->resolved_script_uri.c_str(), isolate_data);
     if (SetErrorFromHandle(result, error)) {
       Dart_ExitScope();
       if (child_callback_data != nullptr) {
@@ -481,10 +2394,20 @@ static bool OnIsolateInitialize(void** child_callback_data, char** error) {
       delete isolate_data;
       return false;
     }
-
-    if (isolate_group_data->kernel_buffer() != nullptr) {
-      const char* resolved_script_uri = nullptr;
-      result = Dart_StringToCString(result, &resolved_script_uri);
+  } else {
+    result = dart::bin::DartUtils::ResolveScript(Dart_NewStringFromCString(script_uri));
+    if (SetErrorFromHandle(result, error)) {
+      Dart_ExitScope();
+      if (child_callback_data != nullptr) {
+        *child_callback_data = nullptr;
+      }
+      delete isolate_data;
+      return false;
+    }
+
+    if (isolate_group_data->kernel_buffer() != nullptr) {
+      const char* resolved_script_uri = nullptr;
+      result = Dart_StringToCString(result, &resolved_script_uri);
       if (SetErrorFromHandle(result, error)) {
         Dart_ExitScope();
         if (child_callback_data != nullptr) {
@@ -506,14 +2429,56 @@ static bool OnIsolateInitialize(void** child_callback_data, char** error) {
     }
   }
 
+  if (group_cache == nullptr) {
+    result = InstallFfiNativeResolver();
+    if (SetErrorFromHandle(result, error)) {
+      Dart_ExitScope();
+      if (child_callback_data != nullptr) {
+        *child_callback_data = nullptr;
+      }
+      delete isolate_data;
+      return false;
+    }
+  }
+
   Dart_ExitScope();
-  g_callback_owned_isolate_data.insert(isolate_data);
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_callback_owned_isolate_data.insert(isolate_data);
+  }
+  AddMetric(kMetricIsolateSpawns, 1);
+  AddMetric(kMetricIsolateSpawnSetupNs, MonotonicNowNs() - start_ns);
   return true;
 }
 
+// Releases the closures of calls taken off an isolate record. Persistent
+// handles must be deleted while the isolate is entered.
+static void DetachPreparedCalls(
+    const std::vector<DartVmEmbedPreparedCall*>& calls) {
+  for (DartVmEmbedPreparedCall* call : calls) {
+    Dart_DeletePersistentHandle(call->closure);
+    call->closure = nullptr;
+  }
+}
+
 static void OnIsolateShutdown(void* isolate_group_data, void* isolate_data) {
   (void)isolate_group_data;
   (void)isolate_data;
+  // Covers every way an isolate dies, not just DartVmEmbed_ShutdownIsolate.
+  Dart_Isolate isolate = Dart_CurrentIsolate();
+  CloseOwnedNativePorts(isolate);
+  std::vector<DartVmEmbedPreparedCall*> prepared_calls;
+  std::shared_ptr<TenantIsolateLink> tenant_link;
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    auto it = g_isolate_records.find(isolate);
+    if (it != g_isolate_records.end()) {
+      prepared_calls.swap(it->second.prepared_calls);
+      tenant_link.swap(it->second.tenant_link);
+    }
+  }
+  DetachPreparedCalls(prepared_calls);
+  UnlinkTenantIsolate(tenant_link);
   Dart_EnterScope();
   Dart_Handle sticky_error = Dart_GetStickyError();
   if (!Dart_IsNull(sticky_error) && !Dart_IsFatalError(sticky_error)) {
@@ -522,13 +2487,30 @@ static void OnIsolateShutdown(void* isolate_group_data, void* isolate_data) {
   Dart_ExitScope();
 }
 
+#if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+// Hands |snapshot| to |isolate|'s group; CleanupGroup deletes it.
+static void AttachGroupSnapshot(Dart_Isolate isolate,
+                                dart::bin::AppSnapshot* snapshot,
+                                bool from_app_jit_cache) {
+  auto* group_data =
+      static_cast<dart::bin::IsolateGroupData*>(Dart_IsolateGroupData(isolate));
+  std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+  g_group_snapshots[group_data] = GroupSnapshot{snapshot, from_app_jit_cache};
+}
+#endif
+
 static void CleanupIsolate(void* isolate_group_data, void* callback_data) {
   (void)isolate_group_data;
   auto* isolate_data = reinterpret_cast<dart::bin::IsolateData*>(callback_data);
   if (isolate_data == nullptr) {
     return;
   }
-  if (g_callback_owned_isolate_data.erase(isolate_data) > 0) {
+  size_t erased = 0;
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    erased = g_callback_owned_isolate_data.erase(isolate_data);
+  }
+  if (erased > 0) {
     delete isolate_data;
   }
 }
@@ -539,7 +2521,20 @@ static void CleanupGroup(void* callback_data) {
   if (group_data == nullptr) {
     return;
   }
-  if (g_callback_owned_group_data.erase(group_data) > 0) {
+  size_t erased = 0;
+  dart::bin::AppSnapshot* snapshot = nullptr;
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_group_setup_caches.erase(group_data);
+    erased = g_callback_owned_group_data.erase(group_data);
+    auto it = g_group_snapshots.find(group_data);
+    if (it != g_group_snapshots.end()) {
+      snapshot = it->second.snapshot;
+      g_group_snapshots.erase(it);
+    }
+  }
+  delete snapshot;
+  if (erased > 0) {
     delete group_data;
   }
 }
@@ -577,6 +2572,12 @@ static Dart_Isolate OnCreateIsolateGroup(const char* script_uri,
 
 #if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
   if (strcmp(script_uri, DART_KERNEL_ISOLATE_NAME) == 0) {
+    if (!WaitForKernelServiceStart()) {
+      SetErrorIfUnset(error,
+                      "OnCreateIsolateGroup: VM shut down before the kernel "
+                      "isolate started.");
+      return nullptr;
+    }
     const char* kernel_snapshot_uri = dart::bin::dfe.frontend_filename();
     const char* uri =
         (kernel_snapshot_uri != nullptr) ? kernel_snapshot_uri : script_uri;
@@ -614,13 +2615,30 @@ static Dart_Isolate OnCreateIsolateGroup(const char* script_uri,
                                          error)) {
       return nullptr;
     }
-    g_callback_owned_isolate_data.insert(child_isolate_data);
-    g_callback_owned_group_data.insert(group_data);
+    {
+      std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+      g_callback_owned_isolate_data.insert(child_isolate_data);
+      g_callback_owned_group_data.insert(group_data);
+    }
+    g_kernel_service.ready_ns.store(MonotonicNowNs(),
+                                    std::memory_order_relaxed);
     return isolate;
   }
 #endif
 
   if (strcmp(script_uri, DART_VM_SERVICE_ISOLATE_NAME) == 0) {
+    if (!g_service_isolate_enabled) {
+      SetErrorIfUnset(error,
+                      "OnCreateIsolateGroup: the service isolate is disabled "
+                      "(DartVmEmbedInitConfig::enable_service_isolate).");
+      return nullptr;
+    }
+    if (!WaitForServiceIsolateGate()) {
+      SetErrorIfUnset(error,
+                      "OnCreateIsolateGroup: VM shut down before the service "
+                      "isolate started.");
+      return nullptr;
+    }
     flags->load_vmservice_library = true;
     flags->null_safety = true;
     flags->is_service_isolate = true;
@@ -663,8 +2681,8 @@ static Dart_Isolate OnCreateIsolateGroup(const char* script_uri,
             /*deterministic=*/false,
             /*enable_service_port_fallback=*/true,
             /*wait_for_dds_to_advertise_service=*/false,
-            /*serve_devtools=*/true,
-            /*serve_observatory=*/true,
+            /*serve_devtools=*/g_vm_service_serve_devtools,
+            /*serve_observatory=*/g_vm_service_serve_observatory,
             /*print_dtd=*/false,
             /*should_use_resident_compiler=*/false,
             /*resident_compiler_info_file_path=*/nullptr)) {
@@ -684,7 +2702,10 @@ static Dart_Isolate OnCreateIsolateGroup(const char* script_uri,
 
     Dart_ExitScope();
     Dart_ExitIsolate();
-    g_callback_owned_group_data.insert(group_data);
+    {
+      std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+      g_callback_owned_group_data.insert(group_data);
+    }
     return isolate;
   }
 
@@ -699,6 +2720,9 @@ static Dart_Isolate OnCreateIsolateGroup(const char* script_uri,
   intptr_t kernel_buffer_size = 0;
   char* compile_error = nullptr;
   int compile_exit_code = 0;
+  if (ScriptNeedsKernelService(sanitized_script_uri)) {
+    EnsureKernelServiceStarted();
+  }
   dart::bin::dfe.CompileAndReadScript(
       sanitized_script_uri, &kernel_buffer, &kernel_buffer_size, &compile_error,
       &compile_exit_code,
@@ -722,11 +2746,8 @@ static Dart_Isolate OnCreateIsolateGroup(const char* script_uri,
 
   const uint8_t* platform_kernel_buffer = nullptr;
   intptr_t platform_kernel_buffer_size = 0;
-  dart::bin::dfe.LoadPlatform(&platform_kernel_buffer, &platform_kernel_buffer_size);
-  if (platform_kernel_buffer == nullptr || platform_kernel_buffer_size == 0) {
-    platform_kernel_buffer = kernel_buffer;
-    platform_kernel_buffer_size = kernel_buffer_size;
-  }
+  SelectPlatformKernel(kernel_buffer, kernel_buffer_size, &platform_kernel_buffer,
+                       &platform_kernel_buffer_size);
 
   isolate = Dart_CreateIsolateGroupFromKernel(
       sanitized_script_uri, effective_name, platform_kernel_buffer,
@@ -749,8 +2770,11 @@ static Dart_Isolate OnCreateIsolateGroup(const char* script_uri,
     return nullptr;
   }
 
-  g_callback_owned_isolate_data.insert(child_isolate_data);
-  g_callback_owned_group_data.insert(group_data);
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_callback_owned_isolate_data.insert(child_isolate_data);
+    g_callback_owned_group_data.insert(group_data);
+  }
   return isolate;
 }
 
@@ -771,21 +2795,50 @@ bool DartVmEmbed_Initialize(const DartVmEmbedInitConfig* config, char** error) {
     }
   }
   if (const char* port = getenv("DARTVM_EMBED_VM_SERVICE_PORT")) {
+    // A negative port keeps the service isolate in-process only: no HTTP
+    // server is started, but Dart_InvokeVMServiceMethod still works.
     const int value = atoi(port);
-    if (value > 0) {
+    if (value != 0) {
       g_vm_service_port = value;
     }
   }
   if (const char* auth = getenv("DARTVM_EMBED_VM_SERVICE_AUTH_CODES_DISABLED")) {
     g_vm_service_auth_codes_disabled = (strcmp(auth, "0") != 0);
   }
+  if (const char* devtools = getenv("DARTVM_EMBED_VM_SERVICE_SERVE_DEVTOOLS")) {
+    g_vm_service_serve_devtools = (strcmp(devtools, "0") != 0);
+  }
+  if (const char* observatory =
+          getenv("DARTVM_EMBED_VM_SERVICE_SERVE_OBSERVATORY")) {
+    g_vm_service_serve_observatory = (strcmp(observatory, "0") != 0);
+  }
+  bool defer_service_isolate = true;
+  if (const char* defer = getenv("DARTVM_EMBED_VM_SERVICE_DEFER")) {
+    defer_service_isolate = (strcmp(defer, "0") != 0);
+  }
+  ResetServiceIsolateGate(defer_service_isolate);
+  g_service_isolate_enabled =
+      (config == nullptr || config->enable_service_isolate);
+  if (const char* service = getenv("DARTVM_EMBED_VM_SERVICE")) {
+    g_service_isolate_enabled = (strcmp(service, "0") != 0);
+  }
+  // Reloads are requested through the service isolate.
+  if (ShouldEnableVmService()) {
+    g_service_isolate_enabled = true;
+  }
+
+  if (!ResolvePlacement(config != nullptr ? &config->vm_thread_placement
+                                           : nullptr,
+                        &g_vm_thread_placement, error)) {
+    return false;
+  }
+  g_vm_threads_placed.store(0, std::memory_order_relaxed);
+  ResetNativePortPool(config != nullptr ? config->native_port_threads : 0);
 
   char* embedder_error = nullptr;
   if (!dart::embedder::InitOnce(&embedder_error)) {
-    if (error != nullptr) {
-      *error = DupMessage(embedder_error);
-    }
-    free(embedder_error);
+    TakeVmError(error, DARTVM_EMBED_STATUS_VM_INIT_FAILED, embedder_error,
+                "dart::embedder::InitOnce failed.");
     return false;
   }
   dart::bin::Loader::InitOnce();
@@ -808,10 +2861,8 @@ bool DartVmEmbed_Initialize(const DartVmEmbedInitConfig* config, char** error) {
   char* vm_flag_error =
       Dart_SetVMFlags(static_cast<int>(vm_flags.size()), vm_flags_ptr);
   if (vm_flag_error != nullptr) {
-    if (error != nullptr) {
-      *error = DupMessage(vm_flag_error);
-    }
-    free(vm_flag_error);
+    TakeVmError(error, DARTVM_EMBED_STATUS_VM_INIT_FAILED, vm_flag_error,
+                nullptr);
     return false;
   }
 
@@ -821,6 +2872,10 @@ bool DartVmEmbed_Initialize(const DartVmEmbedInitConfig* config, char** error) {
   dart::bin::dfe.Init();
   dart::bin::dfe.set_use_dfe();
   dart::bin::dfe.set_use_incremental_compiler(true);
+  if (!LoadSharedPlatformKernel(
+          config != nullptr ? config->platform_kernel_path : nullptr, error)) {
+    return false;
+  }
 #endif
 
   Dart_InitializeParams params;
@@ -837,8 +2892,20 @@ bool DartVmEmbed_Initialize(const DartVmEmbedInitConfig* config, char** error) {
 #if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
   params.start_kernel_isolate = false;
 #else
-  params.start_kernel_isolate =
+  const bool want_kernel_service =
       (config == nullptr) ? true : config->start_kernel_isolate;
+  const bool lazy_kernel_service =
+      want_kernel_service &&
+      ((config == nullptr) ? true : config->lazy_kernel_isolate);
+  params.start_kernel_isolate = want_kernel_service;
+  // Before Dart_Initialize, which requests the kernel isolate.
+  KernelServiceMode kernel_service_mode = kKernelServiceDisabled;
+  if (lazy_kernel_service) {
+    kernel_service_mode = kKernelServiceLazy;
+  } else if (want_kernel_service) {
+    kernel_service_mode = kKernelServiceStarted;
+  }
+  ResetKernelService(kernel_service_mode, lazy_kernel_service);
 #endif
   params.initialize_isolate = OnIsolateInitialize;
   params.create_group = OnCreateIsolateGroup;
@@ -850,14 +2917,15 @@ bool DartVmEmbed_Initialize(const DartVmEmbedInitConfig* config, char** error) {
   params.file_write = dart::bin::DartUtils::WriteFile;
   params.file_close = dart::bin::DartUtils::CloseFile;
   params.entropy_source = dart::bin::DartUtils::EntropySource;
+  params.thread_start = OnVmThreadStart;
 
   char* init_error = Dart_Initialize(&params);
   if (init_error != nullptr) {
+    ResetKernelService(kKernelServiceDisabled, false);
+    ReleaseSharedPlatformKernel();
     dart::embedder::Cleanup();
-    if (error != nullptr) {
-      *error = DupMessage(init_error);
-    }
-    free(init_error);
+    TakeVmError(error, DARTVM_EMBED_STATUS_VM_INIT_FAILED, init_error,
+                nullptr);
     return false;
   }
 
@@ -865,19 +2933,25 @@ bool DartVmEmbed_Initialize(const DartVmEmbedInitConfig* config, char** error) {
                                  &ServiceStreamCancelCallback);
   char* file_modified_error = Dart_SetFileModifiedCallback(FileModifiedCallbackTrampoline);
   if (file_modified_error != nullptr) {
-    if (error != nullptr) {
-      *error = DupMessage(file_modified_error);
-    }
-    free(file_modified_error);
+    TakeVmError(error, DARTVM_EMBED_STATUS_VM_INIT_FAILED,
+                file_modified_error, nullptr);
+    ResetKernelService(kKernelServiceDisabled, false);
+    CloseServiceIsolateGateForShutdown();
     char* cleanup_error = Dart_Cleanup();
     if (cleanup_error != nullptr) {
       free(cleanup_error);
     }
+    ReleaseSharedPlatformKernel();
     dart::embedder::Cleanup();
     return false;
   }
 
   g_vm_initialized = true;
+#if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  if (ShouldEnableVmService() && !defer_service_isolate) {
+    EnsureKernelServiceStarted();
+  }
+#endif
   return true;
 }
 
@@ -890,6 +2964,10 @@ bool DartVmEmbed_Cleanup(char** error) {
     return true;
   }
 
+  ResetKernelService(kKernelServiceDisabled, false);
+  CloseServiceIsolateGateForShutdown();
+  CloseOwnedNativePorts(nullptr);
+  StopNativePortPool();
   char* cleanup_error = Dart_Cleanup();
   if (cleanup_error != nullptr) {
     if (error != nullptr) {
@@ -900,24 +2978,33 @@ bool DartVmEmbed_Cleanup(char** error) {
   }
 
   g_vm_initialized = false;
+  StopWatchdog();
+  {
+    std::lock_guard<std::mutex> lock(g_heap_sampling.mutex);
+    g_heap_sampling.active = false;
+  }
+  // Isolate groups reference the platform kernel and any preloaded program
+  // until Dart_Cleanup returns.
+  ReleaseSharedPlatformKernel();
+  ReleasePreloadedPrograms();
   dart::embedder::Cleanup();
   return true;
 }
 
-Dart_Isolate DartVmEmbed_CreateIsolateFromKernel(const char* script_uri,
-                                                 const char* name,
-                                                 const uint8_t* kernel_buffer,
-                                                 intptr_t kernel_buffer_size,
-                                                 void* isolate_group_data,
-                                                 void* isolate_data,
-                                                 char** error) {
-  if (error != nullptr) {
-    *error = nullptr;
-  }
+// |copy_kernel| = false is only valid for buffers that outlive the isolate
+// group, such as program bytes embedded into the executable.
+static Dart_Isolate CreateIsolateFromKernelBuffer(const char* script_uri,
+                                                  const char* name,
+                                                  const uint8_t* kernel_buffer,
+                                                  intptr_t kernel_buffer_size,
+                                                  void* isolate_group_data,
+                                                  void* isolate_data,
+                                                  bool copy_kernel,
+                                                  char** error) {
   if (script_uri == nullptr || name == nullptr || kernel_buffer == nullptr ||
       kernel_buffer_size <= 0) {
-    SetErrorIfUnset(error,
-                    "DartVmEmbed_CreateIsolateFromKernel: invalid argument.");
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                     "DartVmEmbed_CreateIsolateFromKernel: invalid argument.");
     return nullptr;
   }
   std::string sanitized_script_uri_storage;
@@ -939,14 +3026,18 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromKernel(const char* script_uri,
     owned.owns_group = true;
   }
 
-  if (group_data->kernel_buffer() == nullptr) {
+  if (group_data->kernel_buffer() == nullptr && !copy_kernel) {
+    group_data->SetKernelBufferUnowned(const_cast<uint8_t*>(kernel_buffer),
+                                       kernel_buffer_size);
+  } else if (group_data->kernel_buffer() == nullptr) {
     uint8_t* copied_kernel = reinterpret_cast<uint8_t*>(malloc(kernel_buffer_size));
     if (copied_kernel == nullptr) {
       if (owned.owns_group) {
         delete owned.isolate_group_data;
       }
-      SetErrorIfUnset(error,
-                      "DartVmEmbed_CreateIsolateFromKernel: OOM while copying kernel.");
+      SetStatusIfUnset(
+          error, DARTVM_EMBED_STATUS_OUT_OF_MEMORY,
+          "DartVmEmbed_CreateIsolateFromKernel: OOM while copying kernel.");
       return nullptr;
     }
     memcpy(copied_kernel, kernel_buffer, static_cast<size_t>(kernel_buffer_size));
@@ -974,20 +3065,16 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromKernel(const char* script_uri,
 
   const uint8_t* platform_kernel_buffer = nullptr;
   intptr_t platform_kernel_buffer_size = 0;
-#if !defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
-  dart::bin::dfe.LoadPlatform(&platform_kernel_buffer, &platform_kernel_buffer_size);
-#endif
-  if (platform_kernel_buffer == nullptr || platform_kernel_buffer_size == 0) {
-    platform_kernel_buffer = kernel_buffer;
-    platform_kernel_buffer_size = kernel_buffer_size;
-  }
+  SelectPlatformKernel(kernel_buffer, kernel_buffer_size, &platform_kernel_buffer,
+                       &platform_kernel_buffer_size);
 
+  char* create_error = nullptr;
   Dart_Isolate isolate = Dart_CreateIsolateGroupFromKernel(
       sanitized_script_uri, name, platform_kernel_buffer, platform_kernel_buffer_size,
-      &flags, actual_group_data, actual_isolate_data, error);
+      &flags, actual_group_data, actual_isolate_data, &create_error);
   if (isolate == nullptr) {
-    SetErrorIfUnset(error,
-                    "Dart_CreateIsolateGroupFromKernel returned null.");
+    TakeVmError(error, DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED, create_error,
+                "Dart_CreateIsolateGroupFromKernel returned null.");
     if (owned.owns_isolate) {
       delete owned.isolate_data;
     }
@@ -1010,13 +3097,30 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromKernel(const char* script_uri,
   }
 
   if (owned.owns_isolate || owned.owns_group) {
-    g_owned_isolates[isolate] = owned;
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_isolate_records[isolate].owned = owned;
   }
 
   return isolate;
 }
 
-Dart_Isolate DartVmEmbed_CreateIsolateFromAppSnapshot(
+Dart_Isolate DartVmEmbed_CreateIsolateFromKernel(const char* script_uri,
+                                                 const char* name,
+                                                 const uint8_t* kernel_buffer,
+                                                 intptr_t kernel_buffer_size,
+                                                 void* isolate_group_data,
+                                                 void* isolate_data,
+                                                 char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+  CreationMetricsScope metrics;
+  return metrics.Finish(CreateIsolateFromKernelBuffer(
+      script_uri, name, kernel_buffer, kernel_buffer_size, isolate_group_data,
+      isolate_data, /*copy_kernel=*/true, error));
+}
+
+static Dart_Isolate CreateIsolateFromAppSnapshotImpl(
     const char* script_uri,
     const char* name,
     const uint8_t* isolate_snapshot_data,
@@ -1029,8 +3133,9 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromAppSnapshot(
   }
   if (script_uri == nullptr || name == nullptr || isolate_snapshot_data == nullptr ||
       isolate_snapshot_instructions == nullptr) {
-    SetErrorIfUnset(
-        error, "DartVmEmbed_CreateIsolateFromAppSnapshot: invalid argument.");
+    SetStatusIfUnset(
+        error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+        "DartVmEmbed_CreateIsolateFromAppSnapshot: invalid argument.");
     return nullptr;
   }
   std::string sanitized_script_uri_storage;
@@ -1071,12 +3176,14 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromAppSnapshot(
   void* actual_isolate_data =
       isolate_data != nullptr ? isolate_data : owned.isolate_data;
 
+  char* create_error = nullptr;
   Dart_Isolate isolate = Dart_CreateIsolateGroup(
       sanitized_script_uri, name, isolate_snapshot_data,
       isolate_snapshot_instructions,
-      &flags, actual_group_data, actual_isolate_data, error);
+      &flags, actual_group_data, actual_isolate_data, &create_error);
   if (isolate == nullptr) {
-    SetErrorIfUnset(error, "Dart_CreateIsolateGroup returned null.");
+    TakeVmError(error, DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED, create_error,
+                "Dart_CreateIsolateGroup returned null.");
     if (owned.owns_isolate) {
       delete owned.isolate_data;
     }
@@ -1099,18 +3206,230 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromAppSnapshot(
   }
 
   if (owned.owns_isolate || owned.owns_group) {
-    g_owned_isolates[isolate] = owned;
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_isolate_records[isolate].owned = owned;
   }
 
   return isolate;
 }
 
-Dart_Isolate DartVmEmbed_CreateIsolateFromSource(const char* script_path,
-                                                 const char* script_uri,
-                                                 const char* name,
-                                                 void* isolate_group_data,
-                                                 void* isolate_data,
-                                                 char** error) {
+Dart_Isolate DartVmEmbed_CreateIsolateFromAppSnapshot(
+    const char* script_uri,
+    const char* name,
+    const uint8_t* isolate_snapshot_data,
+    const uint8_t* isolate_snapshot_instructions,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error) {
+  CreationMetricsScope metrics;
+  return metrics.Finish(CreateIsolateFromAppSnapshotImpl(
+      script_uri, name, isolate_snapshot_data, isolate_snapshot_instructions,
+      isolate_group_data, isolate_data, error));
+}
+
+bool DartVmEmbed_SaveAppJitSnapshot(Dart_Isolate isolate,
+                                    const char* cache_dir,
+                                    char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  (void)isolate;
+  (void)cache_dir;
+  SetErrorIfUnset(error,
+                  "DartVmEmbed_SaveAppJitSnapshot is unavailable in "
+                  "precompiled runtime.");
+  return false;
+#else
+  if (isolate == nullptr || cache_dir == nullptr) {
+    SetErrorIfUnset(error, "DartVmEmbed_SaveAppJitSnapshot: invalid argument.");
+    return false;
+  }
+
+  bool entered_isolate = false;
+  if (Dart_CurrentIsolate() == nullptr) {
+    Dart_EnterIsolate(isolate);
+    entered_isolate = true;
+  }
+
+  auto* group_data = reinterpret_cast<dart::bin::IsolateGroupData*>(
+      Dart_CurrentIsolateGroupData());
+  const uint8_t* kernel_buffer =
+      group_data != nullptr ? group_data->kernel_buffer().get() : nullptr;
+  const intptr_t kernel_buffer_size =
+      group_data != nullptr ? group_data->kernel_buffer_size() : 0;
+  if (kernel_buffer == nullptr || kernel_buffer_size <= 0) {
+    if (entered_isolate) {
+      Dart_ExitIsolate();
+    }
+    SetErrorIfUnset(error,
+                    "DartVmEmbed_SaveAppJitSnapshot: isolate group has no "
+                    "kernel to key the cache entry.");
+    return false;
+  }
+
+  Dart_EnterScope();
+  uint8_t* data = nullptr;
+  intptr_t data_size = 0;
+  uint8_t* instructions = nullptr;
+  intptr_t instructions_size = 0;
+  Dart_Handle result = Dart_CreateAppJITSnapshotAsBlobs(
+      &data, &data_size, &instructions, &instructions_size);
+  bool ok = !SetErrorFromHandle(result, error);
+  if (ok && (data_size <= 0 || instructions_size <= 0)) {
+    SetErrorIfUnset(error,
+                    "DartVmEmbed_SaveAppJitSnapshot: VM produced an empty "
+                    "snapshot.");
+    ok = false;
+  }
+
+  if (ok) {
+    if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+      SetErrorIfUnset(error,
+                      "DartVmEmbed_SaveAppJitSnapshot: failed to create "
+                      "cache_dir.");
+      ok = false;
+    }
+  }
+
+  if (ok) {
+    // Written to a temporary file and renamed into place, so concurrent
+    // starts never observe a partial entry.
+    const std::string path =
+        AppJitCachePath(cache_dir, kernel_buffer, kernel_buffer_size);
+    std::string tmp_path = path + ".XXXXXX";
+    const int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0) {
+      SetErrorIfUnset(error,
+                      "DartVmEmbed_SaveAppJitSnapshot: failed to create "
+                      "cache file.");
+      ok = false;
+    } else {
+      const bool written = WriteAppJitSnapshotFile(
+          fd, data, data_size, instructions, instructions_size);
+      const bool closed = close(fd) == 0;
+      if (!written || !closed) {
+        SetErrorIfUnset(error,
+                        "DartVmEmbed_SaveAppJitSnapshot: failed to write "
+                        "cache file.");
+        ok = false;
+      } else if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        SetErrorIfUnset(error,
+                        "DartVmEmbed_SaveAppJitSnapshot: failed to move the "
+                        "cache file into place.");
+        ok = false;
+      }
+      if (!ok) {
+        unlink(tmp_path.c_str());
+      }
+    }
+  }
+
+  // Snapshot blobs are scope allocated.
+  Dart_ExitScope();
+  if (entered_isolate) {
+    Dart_ExitIsolate();
+  }
+  return ok;
+#endif
+}
+
+static Dart_Isolate CreateIsolateFromAppJitCacheImpl(
+    const char* cache_dir,
+    const char* script_uri,
+    const char* name,
+    const uint8_t* kernel_buffer,
+    intptr_t kernel_buffer_size,
+    void* isolate_group_data,
+    void* isolate_data,
+    bool* out_cache_hit,
+    char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+  if (out_cache_hit != nullptr) {
+    *out_cache_hit = false;
+  }
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  (void)cache_dir;
+  (void)script_uri;
+  (void)name;
+  (void)kernel_buffer;
+  (void)kernel_buffer_size;
+  (void)isolate_group_data;
+  (void)isolate_data;
+  SetErrorIfUnset(error,
+                  "DartVmEmbed_CreateIsolateFromAppJitCache is unavailable in "
+                  "precompiled runtime.");
+  return nullptr;
+#else
+  if (cache_dir == nullptr || script_uri == nullptr || name == nullptr ||
+      kernel_buffer == nullptr || kernel_buffer_size <= 0) {
+    SetErrorIfUnset(error,
+                    "DartVmEmbed_CreateIsolateFromAppJitCache: invalid "
+                    "argument.");
+    return nullptr;
+  }
+
+  // Missing or malformed entries read as null: a miss like any other.
+  dart::bin::AppSnapshot* snapshot = dart::bin::Snapshot::TryReadAppSnapshot(
+      AppJitCachePath(cache_dir, kernel_buffer, kernel_buffer_size).c_str(),
+      /*force_load_from_memory=*/false, /*decode_uri=*/false);
+  if (snapshot != nullptr) {
+    const uint8_t* vm_data = nullptr;
+    const uint8_t* vm_instr = nullptr;
+    const uint8_t* iso_data = nullptr;
+    const uint8_t* iso_instr = nullptr;
+    snapshot->SetBuffers(&vm_data, &vm_instr, &iso_data, &iso_instr);
+    if (iso_data != nullptr && iso_instr != nullptr) {
+      char* snapshot_error = nullptr;
+      Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromAppSnapshot(
+          script_uri, name, iso_data, iso_instr, isolate_group_data,
+          isolate_data, &snapshot_error);
+      if (isolate != nullptr) {
+        AttachGroupSnapshot(isolate, snapshot, /*from_app_jit_cache=*/true);
+        if (out_cache_hit != nullptr) {
+          *out_cache_hit = true;
+        }
+        return isolate;
+      }
+      // The VM rejects snapshots from another SDK build or a differently
+      // configured VM; fall back to kernel like any other miss.
+      free(snapshot_error);
+    }
+    delete snapshot;
+  }
+
+  return DartVmEmbed_CreateIsolateFromKernel(script_uri, name, kernel_buffer,
+                                             kernel_buffer_size,
+                                             isolate_group_data, isolate_data,
+                                             error);
+#endif
+}
+
+Dart_Isolate DartVmEmbed_CreateIsolateFromAppJitCache(
+    const char* cache_dir,
+    const char* script_uri,
+    const char* name,
+    const uint8_t* kernel_buffer,
+    intptr_t kernel_buffer_size,
+    void* isolate_group_data,
+    void* isolate_data,
+    bool* out_cache_hit,
+    char** error) {
+  CreationMetricsScope metrics;
+  return metrics.Finish(CreateIsolateFromAppJitCacheImpl(
+      cache_dir, script_uri, name, kernel_buffer, kernel_buffer_size,
+      isolate_group_data, isolate_data, out_cache_hit, error));
+}
+
+static Dart_Isolate CreateIsolateFromSourceImpl(
+    const char* script_path,
+    const char* script_uri,
+    const char* name,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error) {
   if (error != nullptr) {
     *error = nullptr;
   }
@@ -1147,6 +3466,8 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromSource(const char* script_path,
   const char* sanitized_packages_config = SanitizePathLikeMain(
       effective_packages_config, &sanitized_packages_config_storage);
 
+  EnsureKernelServiceStarted();
+
   uint8_t* kernel_buffer = nullptr;
   intptr_t kernel_buffer_size = 0;
   char* compile_error = nullptr;
@@ -1213,11 +3534,8 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromSource(const char* script_path,
 
   const uint8_t* platform_kernel_buffer = nullptr;
   intptr_t platform_kernel_buffer_size = 0;
-  dart::bin::dfe.LoadPlatform(&platform_kernel_buffer, &platform_kernel_buffer_size);
-  if (platform_kernel_buffer == nullptr || platform_kernel_buffer_size == 0) {
-    platform_kernel_buffer = kernel_buffer;
-    platform_kernel_buffer_size = kernel_buffer_size;
-  }
+  SelectPlatformKernel(kernel_buffer, kernel_buffer_size, &platform_kernel_buffer,
+                       &platform_kernel_buffer_size);
 
   void* actual_group_data =
       isolate_group_data != nullptr ? isolate_group_data : owned.isolate_group_data;
@@ -1255,42 +3573,40 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromSource(const char* script_path,
   }
 
   if (owned.owns_isolate || owned.owns_group) {
-    g_owned_isolates[isolate] = owned;
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_isolate_records[isolate].owned = owned;
   }
   return isolate;
 #endif
 }
 
-Dart_Isolate DartVmEmbed_CreateIsolateFromProgramFile(
-    const char* program_path,
+Dart_Isolate DartVmEmbed_CreateIsolateFromSource(
+    const char* script_path,
     const char* script_uri,
+    const char* name,
     void* isolate_group_data,
     void* isolate_data,
     char** error) {
-  if (error != nullptr) {
-    *error = nullptr;
-  }
-  if (program_path == nullptr) {
-    SetErrorIfUnset(
-        error,
-        "DartVmEmbed_CreateIsolateFromProgramFile: program_path is null.");
-    return nullptr;
-  }
-
-  const char* actual_script_uri = script_uri != nullptr ? script_uri : program_path;
-  const char* isolate_name = "isolate";
+  CreationMetricsScope metrics;
+  return metrics.Finish(CreateIsolateFromSourceImpl(
+      script_path, script_uri, name, isolate_group_data, isolate_data, error));
+}
 
 #if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
-  DartVmEmbedAotElfHandle loaded_elf = nullptr;
-  const uint8_t* vm_data = nullptr;
-  const uint8_t* vm_instr = nullptr;
-  const uint8_t* iso_data = nullptr;
-  const uint8_t* iso_instr = nullptr;
-  if (!DartVmEmbed_LoadAotElf(program_path, 0, &loaded_elf, &vm_data, &vm_instr,
-                              &iso_data, &iso_instr, error)) {
-    return nullptr;
-  }
-
+// Initializes the VM from the ELF's VM snapshot when needed and creates the
+// root isolate. Takes ownership of |loaded_elf|: it is unloaded on failure or
+// when the isolate shuts down.
+static Dart_Isolate CreateIsolateFromLoadedAotElf(
+    DartVmEmbedAotElfHandle loaded_elf,
+    const uint8_t* vm_data,
+    const uint8_t* vm_instr,
+    const uint8_t* iso_data,
+    const uint8_t* iso_instr,
+    const char* script_uri,
+    const char* name,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error) {
   DartVmEmbedInitConfig config;
   config.start_kernel_isolate = false;
   config.vm_snapshot_data_override = vm_data;
@@ -1301,23 +3617,197 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromProgramFile(
   }
 
   Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromAppSnapshot(
-      actual_script_uri, isolate_name, iso_data, iso_instr, isolate_group_data,
-      isolate_data, error);
+      script_uri, name, iso_data, iso_instr, isolate_group_data, isolate_data,
+      error);
   if (isolate == nullptr) {
     DartVmEmbed_UnloadAotElf(loaded_elf);
     return nullptr;
   }
-  g_isolate_loaded_aot_elfs[isolate] = loaded_elf;
-  return isolate;
-#else
-  const char* vm_flags[] = {"--no-precompilation"};
-  DartVmEmbedInitConfig config;
-  config.vm_flag_count = 1;
-  config.vm_flags = vm_flags;
-  if (!DartVmEmbed_Initialize(&config, error)) {
-    return nullptr;
+  if (loaded_elf != nullptr) {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_isolate_records[isolate].aot_elf = loaded_elf;
   }
-
+  return isolate;
+}
+#endif
+
+static Dart_Isolate CreateIsolateFromPreloadedProgram(
+    const PreloadedProgram& program,
+    const char* script_uri,
+    const char* name,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error) {
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  // The ELF stays loaded for the life of the process.
+  return CreateIsolateFromLoadedAotElf(
+      /*loaded_elf=*/nullptr, program.vm_data, program.vm_instr,
+      program.iso_data, program.iso_instr, script_uri, name,
+      isolate_group_data, isolate_data, error);
+#else
+  const char* vm_flags[] = {"--no-precompilation"};
+  DartVmEmbedInitConfig config;
+  config.vm_flag_count = 1;
+  config.vm_flags = vm_flags;
+  config.vm_snapshot_data_override = program.vm_data;
+  config.vm_snapshot_instructions_override = program.vm_instr;
+  if (!DartVmEmbed_Initialize(&config, error)) {
+    return nullptr;
+  }
+  if (program.app_snapshot != nullptr) {
+    return DartVmEmbed_CreateIsolateFromAppSnapshot(
+        script_uri, name, program.iso_data, program.iso_instr,
+        isolate_group_data, isolate_data, error);
+  }
+  return CreateIsolateFromKernelBuffer(
+      script_uri, name, program.kernel.data(),
+      static_cast<intptr_t>(program.kernel.size()), isolate_group_data,
+      isolate_data, /*copy_kernel=*/false, error);
+#endif
+}
+
+// Returns 1 when |size| bytes were read, 0 on EOF before the first byte and
+// -1 on error or truncated input.
+static int ReadFully(int fd, void* buffer, size_t size) {
+  uint8_t* out = reinterpret_cast<uint8_t*>(buffer);
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t n = read(fd, out + done, size - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return -1;
+    }
+    if (n == 0) {
+      return done == 0 ? 0 : -1;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return 1;
+}
+
+static int64_t ForkWorkerProcess(DartVmEmbedForkWorkerMain worker_main,
+                                 void* user_data,
+                                 const uint8_t* request,
+                                 intptr_t request_size,
+                                 int close_fd_in_child,
+                                 char** error) {
+  if (worker_main == nullptr) {
+    SetErrorIfUnset(error, "DartVmEmbed_ForkWorker: worker_main is null.");
+    return -1;
+  }
+  if (g_vm_initialized) {
+    SetErrorIfUnset(error,
+                    "DartVmEmbed_ForkWorker: VM threads do not survive fork; "
+                    "fork before the VM is initialized.");
+    return -1;
+  }
+
+  fflush(nullptr);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    SetErrorIfUnset(error, "DartVmEmbed_ForkWorker: fork failed.");
+    return -1;
+  }
+  if (pid == 0) {
+    if (close_fd_in_child >= 0) {
+      close(close_fd_in_child);
+    }
+    const int exit_code = worker_main(user_data, request, request_size);
+    fflush(nullptr);
+    _exit(exit_code);
+  }
+  return static_cast<int64_t>(pid);
+}
+
+static Dart_Isolate CreateIsolateFromProgramFileImpl(
+    const char* program_path,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+  if (program_path == nullptr) {
+    SetStatusIfUnset(
+        error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+        "DartVmEmbed_CreateIsolateFromProgramFile: program_path is null.");
+    return nullptr;
+  }
+
+  const char* actual_script_uri = script_uri != nullptr ? script_uri : program_path;
+  const char* isolate_name = "isolate";
+
+  if (!g_preloaded_programs.empty()) {
+    auto preloaded_it = g_preloaded_programs.find(program_path);
+    if (preloaded_it != g_preloaded_programs.end()) {
+      return CreateIsolateFromPreloadedProgram(
+          preloaded_it->second, actual_script_uri, isolate_name,
+          isolate_group_data, isolate_data, error);
+    }
+  }
+
+  // Reject missing files before the snapshot readers allocate anything.
+  struct stat program_stat;
+  if (stat(program_path, &program_stat) != 0) {
+    SetStatusIfUnset(
+        error, DARTVM_EMBED_STATUS_IO_ERROR,
+        "DartVmEmbed_CreateIsolateFromProgramFile: program file not found.");
+    return nullptr;
+  }
+
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  DartVmEmbedAotElfHandle loaded_elf = nullptr;
+  const uint8_t* vm_data = nullptr;
+  const uint8_t* vm_instr = nullptr;
+  const uint8_t* iso_data = nullptr;
+  const uint8_t* iso_instr = nullptr;
+  if (!DartVmEmbed_LoadAotElf(program_path, 0, &loaded_elf, &vm_data, &vm_instr,
+                              &iso_data, &iso_instr, error)) {
+    return nullptr;
+  }
+  return CreateIsolateFromLoadedAotElf(loaded_elf, vm_data, vm_instr, iso_data,
+                                       iso_instr, actual_script_uri,
+                                       isolate_name, isolate_group_data,
+                                       isolate_data, error);
+#else
+  // AppJIT snapshots (for example from FLAVOR appjit) carry their own magic
+  // number; anything else is treated as kernel.
+  dart::bin::AppSnapshot* app_snapshot = dart::bin::Snapshot::TryReadAppSnapshot(
+      program_path, /*force_load_from_memory=*/false, /*decode_uri=*/false);
+  const uint8_t* vm_data = nullptr;
+  const uint8_t* vm_instr = nullptr;
+  const uint8_t* iso_data = nullptr;
+  const uint8_t* iso_instr = nullptr;
+  if (app_snapshot != nullptr) {
+    app_snapshot->SetBuffers(&vm_data, &vm_instr, &iso_data, &iso_instr);
+  }
+
+  const char* vm_flags[] = {"--no-precompilation"};
+  DartVmEmbedInitConfig config;
+  config.vm_flag_count = 1;
+  config.vm_flags = vm_flags;
+  config.vm_snapshot_data_override = vm_data;
+  config.vm_snapshot_instructions_override = vm_instr;
+  if (!DartVmEmbed_Initialize(&config, error)) {
+    delete app_snapshot;
+    return nullptr;
+  }
+
+  if (app_snapshot != nullptr) {
+    Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromAppSnapshot(
+        actual_script_uri, isolate_name, iso_data, iso_instr, isolate_group_data,
+        isolate_data, error);
+    if (isolate == nullptr) {
+      delete app_snapshot;
+      return nullptr;
+    }
+    AttachGroupSnapshot(isolate, app_snapshot, /*from_app_jit_cache=*/false);
+    return isolate;
+  }
+
   std::vector<uint8_t> kernel;
   if (!ReadProgramFile(program_path, &kernel, error)) {
     return nullptr;
@@ -1328,12 +3818,213 @@ Dart_Isolate DartVmEmbed_CreateIsolateFromProgramFile(
       static_cast<intptr_t>(kernel.size()), isolate_group_data, isolate_data,
       error);
   if (isolate != nullptr) {
-    g_isolate_kernel_buffers.emplace(isolate, std::move(kernel));
+    AddMetric(kMetricKernelBufferBytes, static_cast<int64_t>(kernel.size()));
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    g_isolate_records[isolate].kernel = std::move(kernel);
   }
   return isolate;
 #endif
 }
 
+Dart_Isolate DartVmEmbed_CreateIsolateFromProgramFile(
+    const char* program_path,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error) {
+  CreationMetricsScope metrics;
+  return metrics.Finish(CreateIsolateFromProgramFileImpl(
+      program_path, script_uri, isolate_group_data, isolate_data, error));
+}
+
+bool DartVmEmbed_ForkServerPreloadProgram(const char* program_path,
+                                          char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+  if (program_path == nullptr) {
+    SetErrorIfUnset(
+        error, "DartVmEmbed_ForkServerPreloadProgram: program_path is null.");
+    return false;
+  }
+  if (g_vm_initialized) {
+    SetErrorIfUnset(error,
+                    "DartVmEmbed_ForkServerPreloadProgram: must be called "
+                    "before the VM is initialized.");
+    return false;
+  }
+  if (g_preloaded_programs.find(program_path) != g_preloaded_programs.end()) {
+    return true;
+  }
+
+  PreloadedProgram program;
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  if (!DartVmEmbed_LoadAotElf(program_path, 0, &program.aot_elf,
+                              &program.vm_data, &program.vm_instr,
+                              &program.iso_data, &program.iso_instr, error)) {
+    return false;
+  }
+#else
+  program.app_snapshot = dart::bin::Snapshot::TryReadAppSnapshot(
+      program_path, /*force_load_from_memory=*/false, /*decode_uri=*/false);
+  if (program.app_snapshot != nullptr) {
+    program.app_snapshot->SetBuffers(&program.vm_data, &program.vm_instr,
+                                     &program.iso_data, &program.iso_instr);
+  } else if (!ReadProgramFile(program_path, &program.kernel, error)) {
+    return false;
+  }
+#endif
+  g_preloaded_programs.emplace(program_path, std::move(program));
+  return true;
+}
+
+int64_t DartVmEmbed_ForkWorker(DartVmEmbedForkWorkerMain worker_main,
+                               void* user_data,
+                               const uint8_t* request,
+                               intptr_t request_size,
+                               char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+  return ForkWorkerProcess(worker_main, user_data, request, request_size,
+                           /*close_fd_in_child=*/-1, error);
+}
+
+bool DartVmEmbed_ForkServerServe(int control_fd,
+                                 DartVmEmbedForkWorkerMain worker_main,
+                                 void* user_data,
+                                 char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+  if (control_fd < 0 || worker_main == nullptr) {
+    SetErrorIfUnset(error, "DartVmEmbed_ForkServerServe: invalid argument.");
+    return false;
+  }
+
+  // Only reap workers forked here; other children belong to the host.
+  std::unordered_set<pid_t> workers;
+  std::vector<uint8_t> request;
+  for (;;) {
+    for (auto it = workers.begin(); it != workers.end();) {
+      if (waitpid(*it, nullptr, WNOHANG) != 0) {
+        it = workers.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    uint32_t request_size = 0;
+    const int header_result =
+        ReadFully(control_fd, &request_size, sizeof(request_size));
+    if (header_result == 0) {
+      return true;
+    }
+    if (header_result < 0 || request_size > kForkServerMaxRequestSize) {
+      SetErrorIfUnset(error,
+                      "DartVmEmbed_ForkServerServe: malformed request header.");
+      return false;
+    }
+    request.resize(request_size);
+    if (request_size > 0 &&
+        ReadFully(control_fd, request.data(), request_size) != 1) {
+      SetErrorIfUnset(error,
+                      "DartVmEmbed_ForkServerServe: truncated request payload.");
+      return false;
+    }
+
+    // A failed fork is answered with -1; its reason is left in the thread
+    // status for DartVmEmbed_LastErrorMessage.
+    ResetThreadStatus();
+    const int64_t pid = ForkWorkerProcess(
+        worker_main, user_data, request.data(),
+        static_cast<intptr_t>(request_size), control_fd, /*error=*/nullptr);
+    if (pid > 0) {
+      workers.insert(static_cast<pid_t>(pid));
+    }
+    if (!WriteFully(control_fd, &pid, sizeof(pid))) {
+      SetErrorIfUnset(error, "DartVmEmbed_ForkServerServe: failed to reply.");
+      return false;
+    }
+  }
+}
+
+void DartVmEmbed_ForkServerReleasePrograms(void) {
+  if (g_vm_initialized) {
+    return;
+  }
+  ReleasePreloadedPrograms();
+}
+
+static Dart_Isolate CreateIsolateFromProgramBufferImpl(
+    const uint8_t* program,
+    intptr_t program_size,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+  if (program == nullptr || program_size <= 0 || script_uri == nullptr) {
+    SetStatusIfUnset(
+        error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+        "DartVmEmbed_CreateIsolateFromProgramBuffer: invalid argument.");
+    return nullptr;
+  }
+  const char* isolate_name = "isolate";
+
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  DartVmEmbedAotElfHandle loaded_elf = nullptr;
+  const uint8_t* vm_data = nullptr;
+  const uint8_t* vm_instr = nullptr;
+  const uint8_t* iso_data = nullptr;
+  const uint8_t* iso_instr = nullptr;
+  if (!DartVmEmbed_LoadAotElfFromMemory(
+          program, static_cast<uint64_t>(program_size), &loaded_elf, &vm_data,
+          &vm_instr, &iso_data, &iso_instr, error)) {
+    return nullptr;
+  }
+  return CreateIsolateFromLoadedAotElf(loaded_elf, vm_data, vm_instr, iso_data,
+                                       iso_instr, script_uri, isolate_name,
+                                       isolate_group_data, isolate_data, error);
+#else
+  if (dart::bin::DartUtils::SniffForMagicNumber(program, program_size) ==
+      dart::bin::DartUtils::kAppJITMagicNumber) {
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_UNSUPPORTED,
+                     "DartVmEmbed_CreateIsolateFromProgramBuffer: AppJIT "
+                     "snapshots need executable mappings; use "
+                     "DartVmEmbed_CreateIsolateFromProgramFile.");
+    return nullptr;
+  }
+
+  const char* vm_flags[] = {"--no-precompilation"};
+  DartVmEmbedInitConfig config;
+  config.vm_flag_count = 1;
+  config.vm_flags = vm_flags;
+  if (!DartVmEmbed_Initialize(&config, error)) {
+    return nullptr;
+  }
+  return CreateIsolateFromKernelBuffer(script_uri, isolate_name, program,
+                                       program_size, isolate_group_data,
+                                       isolate_data, /*copy_kernel=*/false,
+                                       error);
+#endif
+}
+
+Dart_Isolate DartVmEmbed_CreateIsolateFromProgramBuffer(
+    const uint8_t* program,
+    intptr_t program_size,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    char** error) {
+  CreationMetricsScope metrics;
+  return metrics.Finish(CreateIsolateFromProgramBufferImpl(
+      program, program_size, script_uri, isolate_group_data, isolate_data,
+      error));
+}
+
 bool DartVmEmbed_LoadAotElf(
     const char* path,
     int64_t file_offset,
@@ -1350,8 +4041,8 @@ bool DartVmEmbed_LoadAotElf(
       out_vm_snapshot_instructions == nullptr ||
       out_isolate_snapshot_data == nullptr ||
       out_isolate_snapshot_instructions == nullptr) {
-    SetErrorIfUnset(
-        error,
+    SetStatusIfUnset(
+        error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
         "DartVmEmbed_LoadAotElf: output pointers must not be null.");
     return false;
   }
@@ -1363,12 +4054,12 @@ bool DartVmEmbed_LoadAotElf(
                    out_vm_snapshot_instructions, out_isolate_snapshot_data,
                    out_isolate_snapshot_instructions);
   if (loaded == nullptr) {
-    if (error != nullptr) {
-      *error = DupMessage(load_error != nullptr ? load_error : "Dart_LoadELF failed.");
-    }
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_PROGRAM,
+                     load_error != nullptr ? load_error : "Dart_LoadELF failed.");
     return false;
   }
   *out_handle = reinterpret_cast<DartVmEmbedAotElfHandle>(loaded);
+  AddMetric(kMetricLoadedAotElfs, 1);
   return true;
 #else
   (void)path;
@@ -1378,19 +4069,71 @@ bool DartVmEmbed_LoadAotElf(
   (void)out_vm_snapshot_instructions;
   (void)out_isolate_snapshot_data;
   (void)out_isolate_snapshot_instructions;
-  SetErrorIfUnset(
-      error,
+  SetStatusIfUnset(
+      error, DARTVM_EMBED_STATUS_UNSUPPORTED,
       "DartVmEmbed_LoadAotElf is only available in AOT runtime flavor.");
   return false;
 #endif
 }
 
+bool DartVmEmbed_LoadAotElfFromMemory(
+    const uint8_t* snapshot,
+    uint64_t snapshot_size,
+    DartVmEmbedAotElfHandle* out_handle,
+    const uint8_t** out_vm_snapshot_data,
+    const uint8_t** out_vm_snapshot_instructions,
+    const uint8_t** out_isolate_snapshot_data,
+    const uint8_t** out_isolate_snapshot_instructions,
+    char** error) {
+  if (error != nullptr) {
+    *error = nullptr;
+  }
+  if (out_handle == nullptr || out_vm_snapshot_data == nullptr ||
+      out_vm_snapshot_instructions == nullptr ||
+      out_isolate_snapshot_data == nullptr ||
+      out_isolate_snapshot_instructions == nullptr) {
+    SetStatusIfUnset(
+        error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+        "DartVmEmbed_LoadAotElfFromMemory: output pointers must not be null.");
+    return false;
+  }
+  if (snapshot == nullptr || snapshot_size == 0) {
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                     "DartVmEmbed_LoadAotElfFromMemory: snapshot is empty.");
+    return false;
+  }
+
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  const char* load_error = nullptr;
+  Dart_LoadedElf* loaded = Dart_LoadELF_Memory(
+      snapshot, snapshot_size, &load_error, out_vm_snapshot_data,
+      out_vm_snapshot_instructions, out_isolate_snapshot_data,
+      out_isolate_snapshot_instructions);
+  if (loaded == nullptr) {
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_PROGRAM,
+                     load_error != nullptr ? load_error
+                                           : "Dart_LoadELF_Memory failed.");
+    return false;
+  }
+  *out_handle = reinterpret_cast<DartVmEmbedAotElfHandle>(loaded);
+  AddMetric(kMetricLoadedAotElfs, 1);
+  return true;
+#else
+  SetStatusIfUnset(
+      error, DARTVM_EMBED_STATUS_UNSUPPORTED,
+      "DartVmEmbed_LoadAotElfFromMemory is only available in AOT runtime "
+      "flavor.");
+  return false;
+#endif
+}
+
 void DartVmEmbed_UnloadAotElf(DartVmEmbedAotElfHandle handle) {
 #if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
   if (handle == nullptr) {
     return;
   }
   Dart_UnloadELF(reinterpret_cast<Dart_LoadedElf*>(handle));
+  AddMetric(kMetricLoadedAotElfs, -1);
 #else
   (void)handle;
 #endif
@@ -1443,13 +4186,7 @@ bool DartVmEmbed_RunRootEntryChecked(const char* entry_name, char** error) {
     *error = nullptr;
   }
   Dart_Handle result = DartVmEmbed_RunRootEntry(entry_name);
-  if (Dart_IsError(result)) {
-    if (error != nullptr) {
-      *error = DupMessage(Dart_GetError(result));
-    }
-    return false;
-  }
-  return true;
+  return !SetErrorFromHandle(result, error);
 }
 
 bool DartVmEmbed_RunRootEntryOnIsolate(Dart_Isolate isolate,
@@ -1459,13 +4196,14 @@ bool DartVmEmbed_RunRootEntryOnIsolate(Dart_Isolate isolate,
     *error = nullptr;
   }
   if (isolate == nullptr) {
-    SetErrorIfUnset(error,
-                    "DartVmEmbed_RunRootEntryOnIsolate: isolate is null.");
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                     "DartVmEmbed_RunRootEntryOnIsolate: isolate is null.");
     return false;
   }
 
   bool entered_isolate = false;
   if (Dart_CurrentIsolate() == nullptr) {
+    ApplyIsolatePlacement(isolate);
     Dart_EnterIsolate(isolate);
     entered_isolate = true;
   }
@@ -1527,60 +4265,2279 @@ bool DartVmEmbed_RunLoopOnIsolate(Dart_Isolate isolate, char** error) {
     *error = nullptr;
   }
   if (isolate == nullptr) {
-    SetErrorIfUnset(error, "DartVmEmbed_RunLoopOnIsolate: isolate is null.");
+    SetStatusIfUnset(error, DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                     "DartVmEmbed_RunLoopOnIsolate: isolate is null.");
     return false;
   }
 
   bool entered_isolate = false;
   if (Dart_CurrentIsolate() == nullptr) {
+    ApplyIsolatePlacement(isolate);
     Dart_EnterIsolate(isolate);
     entered_isolate = true;
   }
 
   Dart_EnterScope();
-  Dart_Handle result = Dart_RunLoop();
+  // The error text lives in the scope, so report it before leaving.
+  const bool ok = !SetErrorFromHandle(Dart_RunLoop(), error);
   Dart_ExitScope();
 
   if (entered_isolate) {
     Dart_ExitIsolate();
   }
-
-  if (Dart_IsError(result)) {
-    SetErrorIfUnset(error, Dart_GetError(result));
-    return false;
-  }
-  return true;
+  return ok;
 }
 
-void DartVmEmbed_ShutdownIsolate(void) {
-  Dart_Isolate isolate = Dart_CurrentIsolate();
-  if (isolate != nullptr) {
-    Dart_ShutdownIsolate();
-  }
-
-  if (isolate != nullptr) {
-    g_vmservice_warmed_isolates.erase(isolate);
+DartVmEmbedStatus DartVmEmbed_LastStatus(void) {
+  return t_status.code;
+}
 
-    auto aot_it = g_isolate_loaded_aot_elfs.find(isolate);
-    if (aot_it != g_isolate_loaded_aot_elfs.end()) {
-      DartVmEmbed_UnloadAotElf(aot_it->second);
-      g_isolate_loaded_aot_elfs.erase(aot_it);
-    }
+const char* DartVmEmbed_LastErrorMessage(void) {
+  return t_status.message;
+}
 
-    g_isolate_kernel_buffers.erase(isolate);
+const char* DartVmEmbed_StatusName(DartVmEmbedStatus status) {
+  switch (status) {
+    case DARTVM_EMBED_STATUS_OK:
+      return "ok";
+    case DARTVM_EMBED_STATUS_INVALID_ARGUMENT:
+      return "invalid argument";
+    case DARTVM_EMBED_STATUS_UNSUPPORTED:
+      return "unsupported in this runtime flavor";
+    case DARTVM_EMBED_STATUS_IO_ERROR:
+      return "i/o error";
+    case DARTVM_EMBED_STATUS_INVALID_PROGRAM:
+      return "invalid program";
+    case DARTVM_EMBED_STATUS_OUT_OF_MEMORY:
+      return "out of memory";
+    case DARTVM_EMBED_STATUS_VM_INIT_FAILED:
+      return "VM initialization failed";
+    case DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED:
+      return "isolate creation failed";
+    case DARTVM_EMBED_STATUS_COMPILE_ERROR:
+      return "compilation error";
+    case DARTVM_EMBED_STATUS_UNHANDLED_EXCEPTION:
+      return "unhandled exception";
+    case DARTVM_EMBED_STATUS_DART_ERROR:
+      return "Dart API error";
+    case DARTVM_EMBED_STATUS_FAILED:
+      return "failed";
+    case DARTVM_EMBED_STATUS_TIMEOUT:
+      return "timed out";
+    case DARTVM_EMBED_STATUS_QUOTA_EXCEEDED:
+      return "quota exceeded";
+  }
+  return "unknown status";
+}
 
-    auto owned_it = g_owned_isolates.find(isolate);
-    if (owned_it != g_owned_isolates.end()) {
-      if (owned_it->second.owns_isolate) {
-        delete owned_it->second.isolate_data;
-      }
-      if (owned_it->second.owns_group) {
-        delete owned_it->second.isolate_group_data;
-      }
-      g_owned_isolates.erase(owned_it);
+DartVmEmbedStatus DartVmEmbed_CreateIsolateFromKernelEx(
+    const char* script_uri,
+    const char* name,
+    const uint8_t* kernel_buffer,
+    intptr_t kernel_buffer_size,
+    void* isolate_group_data,
+    void* isolate_data,
+    Dart_Isolate* out_isolate) {
+  ResetThreadStatus();
+  if (out_isolate == nullptr) {
+    AddMetric(kMetricIsolateCreationFailures, 1);
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_CreateIsolateFromKernelEx: out_isolate is "
+                       "null.");
+    return t_status.code;
+  }
+  *out_isolate = DartVmEmbed_CreateIsolateFromKernel(
+      script_uri, name, kernel_buffer, kernel_buffer_size, isolate_group_data,
+      isolate_data, /*error=*/nullptr);
+  return FinishThreadStatus(*out_isolate != nullptr,
+                            DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED);
+}
+
+DartVmEmbedStatus DartVmEmbed_CreateIsolateFromAppSnapshotEx(
+    const char* script_uri,
+    const char* name,
+    const uint8_t* isolate_snapshot_data,
+    const uint8_t* isolate_snapshot_instructions,
+    void* isolate_group_data,
+    void* isolate_data,
+    Dart_Isolate* out_isolate) {
+  ResetThreadStatus();
+  if (out_isolate == nullptr) {
+    AddMetric(kMetricIsolateCreationFailures, 1);
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_CreateIsolateFromAppSnapshotEx: "
+                       "out_isolate is null.");
+    return t_status.code;
+  }
+  *out_isolate = DartVmEmbed_CreateIsolateFromAppSnapshot(
+      script_uri, name, isolate_snapshot_data, isolate_snapshot_instructions,
+      isolate_group_data, isolate_data, /*error=*/nullptr);
+  return FinishThreadStatus(*out_isolate != nullptr,
+                            DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED);
+}
+
+DartVmEmbedStatus DartVmEmbed_CreateIsolateFromProgramFileEx(
+    const char* program_path,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    Dart_Isolate* out_isolate) {
+  ResetThreadStatus();
+  if (out_isolate == nullptr) {
+    AddMetric(kMetricIsolateCreationFailures, 1);
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_CreateIsolateFromProgramFileEx: "
+                       "out_isolate is null.");
+    return t_status.code;
+  }
+  *out_isolate = DartVmEmbed_CreateIsolateFromProgramFile(
+      program_path, script_uri, isolate_group_data, isolate_data,
+      /*error=*/nullptr);
+  return FinishThreadStatus(*out_isolate != nullptr,
+                            DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED);
+}
+
+DartVmEmbedStatus DartVmEmbed_CreateIsolateFromProgramBufferEx(
+    const uint8_t* program,
+    intptr_t program_size,
+    const char* script_uri,
+    void* isolate_group_data,
+    void* isolate_data,
+    Dart_Isolate* out_isolate) {
+  ResetThreadStatus();
+  if (out_isolate == nullptr) {
+    AddMetric(kMetricIsolateCreationFailures, 1);
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_CreateIsolateFromProgramBufferEx: "
+                       "out_isolate is null.");
+    return t_status.code;
+  }
+  *out_isolate = DartVmEmbed_CreateIsolateFromProgramBuffer(
+      program, program_size, script_uri, isolate_group_data, isolate_data,
+      /*error=*/nullptr);
+  return FinishThreadStatus(*out_isolate != nullptr,
+                            DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED);
+}
+
+DartVmEmbedStatus DartVmEmbed_RunRootEntryOnIsolateEx(Dart_Isolate isolate,
+                                                      const char* entry_name) {
+  ResetThreadStatus();
+  const bool ok =
+      DartVmEmbed_RunRootEntryOnIsolate(isolate, entry_name, /*error=*/nullptr);
+  return FinishThreadStatus(ok, DARTVM_EMBED_STATUS_DART_ERROR);
+}
+
+DartVmEmbedStatus DartVmEmbed_RunLoopOnIsolateEx(Dart_Isolate isolate) {
+  ResetThreadStatus();
+  const bool ok = DartVmEmbed_RunLoopOnIsolate(isolate, /*error=*/nullptr);
+  return FinishThreadStatus(ok, DARTVM_EMBED_STATUS_DART_ERROR);
+}
+
+// Returns a reference to the isolate's pump. Records a status naming |api|
+// on failure.
+static std::shared_ptr<MessagePump> LookupMessagePump(Dart_Isolate isolate,
+                                                      const char* api) {
+  char message[160];
+  if (isolate == nullptr) {
+    snprintf(message, sizeof(message), "%s: isolate is null.", api);
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT, message);
+    return nullptr;
+  }
+  Dart_Isolate current = Dart_CurrentIsolate();
+  if (current != nullptr && current != isolate) {
+    snprintf(message, sizeof(message),
+             "%s: another isolate is entered on this thread.", api);
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT, message);
+    return nullptr;
+  }
+  std::shared_lock<std::shared_mutex> lock(g_message_pump_mutex);
+  auto it = g_message_pumps.find(isolate);
+  if (it == g_message_pumps.end()) {
+    snprintf(message, sizeof(message),
+             "%s: isolate was not created through the embedder.", api);
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT, message);
+    return nullptr;
+  }
+  return it->second;
+}
+
+// Handles up to max_messages (<= 0: all pending) of the pump's pending
+// messages, stopping early at deadline_ns (<= 0: none). The deadline is
+// checked between messages; a single long handler is not interrupted.
+static void HandlePumpMessages(Dart_Isolate isolate,
+                               MessagePump* pump,
+                               int64_t deadline_ns,
+                               int64_t max_messages) {
+  if (pump->pending.load(std::memory_order_relaxed) <= 0) {
+    return;
+  }
+  const bool entered = Dart_CurrentIsolate() == nullptr;
+  if (entered) {
+    ApplyIsolatePlacement(isolate);
+    Dart_EnterIsolate(isolate);
+  }
+  Dart_EnterScope();
+  int64_t handled = 0;
+  while (pump->pending.load(std::memory_order_relaxed) > 0 &&
+         (max_messages <= 0 || handled < max_messages) &&
+         (deadline_ns <= 0 || handled == 0 || MonotonicNowNs() < deadline_ns)) {
+    // A surplus count (an OOB message drained with an earlier call, or a
+    // message handled by Dart_RunLoop) makes Dart_HandleMessage a no-op.
+    pump->pending.fetch_sub(1, std::memory_order_relaxed);
+    ++handled;
+    if (SetErrorFromHandle(Dart_HandleMessage(), /*error=*/nullptr)) {
+      break;
+    }
+  }
+  Dart_ExitScope();
+  if (entered) {
+    Dart_ExitIsolate();
+  }
+}
+
+int DartVmEmbed_GetMessageNotifyFd(Dart_Isolate isolate) {
+  ResetThreadStatus();
+#if defined(__linux__)
+  std::shared_ptr<MessagePump> pump =
+      LookupMessagePump(isolate, "DartVmEmbed_GetMessageNotifyFd");
+  if (pump == nullptr) {
+    return -1;
+  }
+  int fd = pump->notify_fd.load(std::memory_order_acquire);
+  if (fd >= 0) {
+    return fd;
+  }
+  const int new_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (new_fd < 0) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_IO_ERROR,
+                       "DartVmEmbed_GetMessageNotifyFd: eventfd failed.");
+    return -1;
+  }
+  if (!pump->notify_fd.compare_exchange_strong(fd, new_fd,
+                                               std::memory_order_acq_rel)) {
+    // Another thread won the race.
+    close(new_fd);
+    return fd;
+  }
+  // Posts counted before the fd was published did not signal it.
+  if (pump->pending.load(std::memory_order_relaxed) > 0) {
+    const uint64_t one = 1;
+    ssize_t written = write(new_fd, &one, sizeof(one));
+    (void)written;
+  }
+  return new_fd;
+#else
+  (void)isolate;
+  RecordThreadStatus(DARTVM_EMBED_STATUS_UNSUPPORTED,
+                     "DartVmEmbed_GetMessageNotifyFd requires eventfd "
+                     "(Linux).");
+  return -1;
+#endif
+}
+
+DartVmEmbedStatus DartVmEmbed_HandlePendingMessages(Dart_Isolate isolate) {
+  ResetThreadStatus();
+  std::shared_ptr<MessagePump> pump;
+  if (isolate != nullptr) {
+    std::shared_lock<std::shared_mutex> lock(g_message_pump_mutex);
+    auto it = g_message_pumps.find(isolate);
+    if (it != g_message_pumps.end()) {
+      pump = it->second;
+    }
+  }
+  const int fd = pump != nullptr
+                     ? pump->notify_fd.load(std::memory_order_acquire)
+                     : -1;
+  if (fd < 0) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_HandlePendingMessages: isolate has no "
+                       "notification fd (call DartVmEmbed_GetMessageNotifyFd).");
+    return t_status.code;
+  }
+  Dart_Isolate current = Dart_CurrentIsolate();
+  if (current != nullptr && current != isolate) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_HandlePendingMessages: another isolate "
+                       "is entered on this thread.");
+    return t_status.code;
+  }
+  // Reading resets the fd before handling, so a message posted while
+  // handling re-arms it instead of being missed.
+  uint64_t signalled = 0;
+  ssize_t drained = read(fd, &signalled, sizeof(signalled));
+  (void)drained;
+  // Bounded by what is pending now, so a steady stream of posts cannot keep
+  // the reactor thread here.
+  HandlePumpMessages(isolate, pump.get(), /*deadline_ns=*/0,
+                     pump->pending.load(std::memory_order_relaxed));
+  return t_status.code;
+}
+
+DartVmEmbedStatus DartVmEmbed_PumpMessages(Dart_Isolate isolate,
+                                           int64_t budget_ns,
+                                           int64_t max_messages,
+                                           int64_t* out_remaining) {
+  ResetThreadStatus();
+  const int64_t start_ns = MonotonicNowNs();
+  if (out_remaining != nullptr) {
+    *out_remaining = 0;
+  }
+  std::shared_ptr<MessagePump> pump =
+      LookupMessagePump(isolate, "DartVmEmbed_PumpMessages");
+  if (pump == nullptr) {
+    return t_status.code;
+  }
+  HandlePumpMessages(isolate, pump.get(),
+                     budget_ns > 0 ? start_ns + budget_ns : 0, max_messages);
+  if (out_remaining != nullptr) {
+    *out_remaining =
+        std::max<int64_t>(0, pump->pending.load(std::memory_order_relaxed));
+  }
+  return t_status.code;
+}
+
+DartVmEmbedStatus DartVmEmbed_PostCObjectBatch(int64_t port,
+                                              Dart_CObject** objects,
+                                              intptr_t count) {
+  ResetThreadStatus();
+  if (port == ILLEGAL_PORT || count < 0 ||
+      (count > 0 && objects == nullptr)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_PostCObjectBatch: invalid argument.");
+    return t_status.code;
+  }
+  // Dart_PostCObject serializes the graph synchronously, so the wrapper can
+  // live on the stack.
+  Dart_CObject batch;
+  batch.type = Dart_CObject_kArray;
+  batch.value.as_array.length = count;
+  batch.value.as_array.values = objects;
+  if (!Dart_PostCObject(port, &batch)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_PostCObjectBatch: port is closed or the "
+                       "batch could not be serialized.");
+  }
+  return t_status.code;
+}
+
+DartVmEmbedStatus DartVmEmbed_RunRootEntryOnIsolateWithDeadline(
+    Dart_Isolate isolate,
+    const char* entry_name,
+    int64_t budget_ns) {
+  ResetThreadStatus();
+  if (isolate == nullptr || budget_ns <= 0) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_RunRootEntryOnIsolateWithDeadline: "
+                       "invalid argument.");
+    return t_status.code;
+  }
+  WatchdogTimer timer;
+  ArmWatchdog(&timer, isolate, budget_ns);
+  const bool ok =
+      DartVmEmbed_RunRootEntryOnIsolate(isolate, entry_name, /*error=*/nullptr);
+  if (DisarmWatchdog(&timer)) {
+    ResetThreadStatus();
+    RecordThreadStatus(DARTVM_EMBED_STATUS_TIMEOUT,
+                       "DartVmEmbed_RunRootEntryOnIsolateWithDeadline: run "
+                       "budget expired; the isolate was killed.");
+    return t_status.code;
+  }
+  return FinishThreadStatus(ok, DARTVM_EMBED_STATUS_DART_ERROR);
+}
+
+DartVmEmbedStatus DartVmEmbed_RunLoopOnIsolateWithDeadline(Dart_Isolate isolate,
+                                                           int64_t budget_ns) {
+  ResetThreadStatus();
+  if (isolate == nullptr || budget_ns <= 0) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_RunLoopOnIsolateWithDeadline: invalid "
+                       "argument.");
+    return t_status.code;
+  }
+  WatchdogTimer timer;
+  ArmWatchdog(&timer, isolate, budget_ns);
+  const bool ok = DartVmEmbed_RunLoopOnIsolate(isolate, /*error=*/nullptr);
+  if (DisarmWatchdog(&timer)) {
+    ResetThreadStatus();
+    RecordThreadStatus(DARTVM_EMBED_STATUS_TIMEOUT,
+                       "DartVmEmbed_RunLoopOnIsolateWithDeadline: run budget "
+                       "expired; the isolate was killed.");
+    return t_status.code;
+  }
+  return FinishThreadStatus(ok, DARTVM_EMBED_STATUS_DART_ERROR);
+}
+
+static const intptr_t kMaxBatchArgs = 16;
+static const intptr_t kDefaultBatchScopeInterval = 256;
+
+static Dart_Handle NewHandleFromValue(const DartVmEmbedValue& value) {
+  switch (value.type) {
+    case DARTVM_EMBED_VALUE_NULL:
+      return Dart_Null();
+    case DARTVM_EMBED_VALUE_BOOL:
+      return Dart_NewBoolean(value.as_bool);
+    case DARTVM_EMBED_VALUE_INT64:
+      return Dart_NewInteger(value.as_int64);
+    case DARTVM_EMBED_VALUE_DOUBLE:
+      return Dart_NewDouble(value.as_double);
+  }
+  return Dart_NewApiError("DartVmEmbed_InvokeBatch: unknown argument type.");
+}
+
+static bool ValueFromHandle(Dart_Handle handle, DartVmEmbedValue* out) {
+  if (Dart_IsNull(handle)) {
+    out->type = DARTVM_EMBED_VALUE_NULL;
+    out->as_int64 = 0;
+    return true;
+  }
+  if (Dart_IsBoolean(handle)) {
+    out->type = DARTVM_EMBED_VALUE_BOOL;
+    return !Dart_IsError(Dart_BooleanValue(handle, &out->as_bool));
+  }
+  if (Dart_IsInteger(handle)) {
+    out->type = DARTVM_EMBED_VALUE_INT64;
+    return !Dart_IsError(Dart_IntegerToInt64(handle, &out->as_int64));
+  }
+  if (Dart_IsDouble(handle)) {
+    out->type = DARTVM_EMBED_VALUE_DOUBLE;
+    return !Dart_IsError(Dart_DoubleValue(handle, &out->as_double));
+  }
+  return false;
+}
+
+DartVmEmbedStatus DartVmEmbed_InvokeBatch(Dart_Isolate isolate,
+                                          const char* function_name,
+                                          const DartVmEmbedValue* args,
+                                          intptr_t arg_count,
+                                          intptr_t call_count,
+                                          DartVmEmbedValue* results,
+                                          intptr_t scope_recycle_interval,
+                                          intptr_t* out_completed) {
+  ResetThreadStatus();
+  if (out_completed != nullptr) {
+    *out_completed = 0;
+  }
+  if (isolate == nullptr || function_name == nullptr || call_count < 0 ||
+      arg_count < 0 || arg_count > kMaxBatchArgs ||
+      (arg_count > 0 && args == nullptr) ||
+      (call_count > 0 && results == nullptr)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_InvokeBatch: invalid argument.");
+    return t_status.code;
+  }
+  const intptr_t interval = scope_recycle_interval > 0
+                                ? scope_recycle_interval
+                                : kDefaultBatchScopeInterval;
+
+  bool entered_isolate = false;
+  if (Dart_CurrentIsolate() == nullptr) {
+    ApplyIsolatePlacement(isolate);
+    Dart_EnterIsolate(isolate);
+    entered_isolate = true;
+  }
+
+  // Handles created by each call are released every |interval| calls; the
+  // library and name handles are re-created with each scope.
+  bool ok = true;
+  intptr_t completed = 0;
+  Dart_Handle argv[kMaxBatchArgs];
+  while (ok && completed < call_count) {
+    Dart_EnterScope();
+    Dart_Handle library = Dart_RootLibrary();
+    Dart_Handle name = Dart_NewStringFromCString(function_name);
+    ok = !SetErrorFromHandle(library, nullptr) &&
+         !SetErrorFromHandle(name, nullptr);
+    const intptr_t scope_end =
+        call_count - completed > interval ? completed + interval : call_count;
+    while (ok && completed < scope_end) {
+      const DartVmEmbedValue* row = args + completed * arg_count;
+      for (intptr_t i = 0; ok && i < arg_count; ++i) {
+        argv[i] = NewHandleFromValue(row[i]);
+        ok = !SetErrorFromHandle(argv[i], nullptr);
+      }
+      if (!ok) {
+        break;
+      }
+      Dart_Handle result =
+          Dart_Invoke(library, name, static_cast<int>(arg_count), argv);
+      if (SetErrorFromHandle(result, nullptr)) {
+        ok = false;
+        break;
+      }
+      if (!ValueFromHandle(result, &results[completed])) {
+        RecordThreadStatus(DARTVM_EMBED_STATUS_UNSUPPORTED,
+                           "DartVmEmbed_InvokeBatch: result is not null, "
+                           "bool, int or double.");
+        ok = false;
+        break;
+      }
+      ++completed;
+    }
+    Dart_ExitScope();
+  }
+
+  if (entered_isolate) {
+    Dart_ExitIsolate();
+  }
+  if (out_completed != nullptr) {
+    *out_completed = completed;
+  }
+  return FinishThreadStatus(ok, DARTVM_EMBED_STATUS_DART_ERROR);
+}
+
+DartVmEmbedStatus DartVmEmbed_SetThreadPlacement(
+    const DartVmEmbedPlacement* placement) {
+  ResetThreadStatus();
+  ThreadPlacement resolved;
+  if (!ResolvePlacement(placement, &resolved, /*error=*/nullptr)) {
+    return t_status.code;
+  }
+  if (!ApplyThreadPlacement(resolved)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_SetThreadPlacement: failed to set CPU "
+                       "affinity or memory policy.");
+    return t_status.code;
+  }
+  t_thread_placement = resolved;
+  t_placed_for_isolate = nullptr;
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_GetIsolatePlacement(
+    Dart_Isolate isolate,
+    DartVmEmbedPlacementReport* out_report) {
+  ResetThreadStatus();
+  if (isolate == nullptr || out_report == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_GetIsolatePlacement: invalid argument.");
+    return t_status.code;
+  }
+  *out_report = DartVmEmbedPlacementReport();
+  out_report->vm_threads_placed =
+      g_vm_threads_placed.load(std::memory_order_relaxed);
+  std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+  auto it = g_isolate_records.find(isolate);
+  if (it != g_isolate_records.end() && it->second.has_placement) {
+    const IsolatePlacement& record = it->second.placement;
+    out_report->numa_node = record.placement.numa_node;
+    out_report->cpu_count = static_cast<int>(record.placement.cpus.size());
+    out_report->last_cpu = record.last_cpu;
+    out_report->last_numa_node = record.last_numa_node;
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_PrepareCall(Dart_Isolate isolate,
+                                          const char* library_uri,
+                                          const char* function_name,
+                                          DartVmEmbedPreparedCall** out_call) {
+  ResetThreadStatus();
+  if (out_call != nullptr) {
+    *out_call = nullptr;
+  }
+  if (isolate == nullptr || function_name == nullptr || out_call == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_PrepareCall: invalid argument.");
+    return t_status.code;
+  }
+
+  bool entered_isolate = false;
+  if (Dart_CurrentIsolate() == nullptr) {
+    ApplyIsolatePlacement(isolate);
+    Dart_EnterIsolate(isolate);
+    entered_isolate = true;
+  }
+
+  Dart_EnterScope();
+  Dart_Handle library =
+      library_uri != nullptr
+          ? Dart_LookupLibrary(Dart_NewStringFromCString(library_uri))
+          : Dart_RootLibrary();
+  bool ok = !SetErrorFromHandle(library, nullptr);
+  Dart_Handle closure = nullptr;
+  if (ok) {
+    // A top-level function read as a field yields its tear-off closure. AOT
+    // only retains tear-offs of functions marked
+    // @pragma('vm:entry-point') or @pragma('vm:entry-point', 'get').
+    closure = Dart_GetField(library, Dart_NewStringFromCString(function_name));
+    ok = !SetErrorFromHandle(closure, nullptr);
+  }
+  if (ok && !Dart_IsClosure(closure)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_PrepareCall: target is not a function.");
+    ok = false;
+  }
+  if (ok) {
+    // The record detaches the call when the isolate shuts down, so only
+    // isolates the embedder tracks can hold prepared calls.
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    auto it = g_isolate_records.find(isolate);
+    if (it == g_isolate_records.end()) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                         "DartVmEmbed_PrepareCall: isolate was not created "
+                         "through the embedder.");
+      ok = false;
+    } else {
+      auto* call = new DartVmEmbedPreparedCall();
+      call->isolate = isolate;
+      call->closure = Dart_NewPersistentHandle(closure);
+      it->second.prepared_calls.push_back(call);
+      *out_call = call;
+    }
+  }
+  Dart_ExitScope();
+
+  if (entered_isolate) {
+    Dart_ExitIsolate();
+  }
+  return FinishThreadStatus(ok, DARTVM_EMBED_STATUS_DART_ERROR);
+}
+
+DartVmEmbedStatus DartVmEmbed_InvokePrepared(DartVmEmbedPreparedCall* call,
+                                             const DartVmEmbedValue* args,
+                                             intptr_t arg_count,
+                                             DartVmEmbedValue* out_result) {
+  ResetThreadStatus();
+  if (call == nullptr || arg_count < 0 || arg_count > kMaxBatchArgs ||
+      (arg_count > 0 && args == nullptr)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_InvokePrepared: invalid argument.");
+    return t_status.code;
+  }
+  if (call->closure == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_InvokePrepared: isolate has shut down.");
+    return t_status.code;
+  }
+
+  bool entered_isolate = false;
+  if (Dart_CurrentIsolate() == nullptr) {
+    ApplyIsolatePlacement(call->isolate);
+    Dart_EnterIsolate(call->isolate);
+    entered_isolate = true;
+  }
+
+  Dart_EnterScope();
+  Dart_Handle argv[kMaxBatchArgs];
+  bool ok = true;
+  for (intptr_t i = 0; ok && i < arg_count; ++i) {
+    argv[i] = NewHandleFromValue(args[i]);
+    ok = !SetErrorFromHandle(argv[i], nullptr);
+  }
+  if (ok) {
+    Dart_Handle result =
+        Dart_InvokeClosure(Dart_HandleFromPersistent(call->closure),
+                           static_cast<int>(arg_count), argv);
+    ok = !SetErrorFromHandle(result, nullptr);
+    if (ok && out_result != nullptr && !ValueFromHandle(result, out_result)) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_UNSUPPORTED,
+                         "DartVmEmbed_InvokePrepared: result is not null, "
+                         "bool, int or double.");
+      ok = false;
+    }
+  }
+  Dart_ExitScope();
+
+  if (entered_isolate) {
+    Dart_ExitIsolate();
+  }
+  return FinishThreadStatus(ok, DARTVM_EMBED_STATUS_DART_ERROR);
+}
+
+void DartVmEmbed_ReleasePreparedCall(DartVmEmbedPreparedCall* call) {
+  if (call == nullptr) {
+    return;
+  }
+  // Detaching under the lock decides the race with isolate shutdown: only
+  // one side sees the call attached and deletes its handle.
+  bool attached = false;
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    auto it = g_isolate_records.find(call->isolate);
+    if (it != g_isolate_records.end()) {
+      auto& calls = it->second.prepared_calls;
+      auto call_it = std::find(calls.begin(), calls.end(), call);
+      if (call_it != calls.end()) {
+        calls.erase(call_it);
+        attached = true;
+      }
+    }
+  }
+  if (attached) {
+    bool entered_isolate = false;
+    if (Dart_CurrentIsolate() == nullptr) {
+      Dart_EnterIsolate(call->isolate);
+      entered_isolate = true;
+    }
+    Dart_DeletePersistentHandle(call->closure);
+    if (entered_isolate) {
+      Dart_ExitIsolate();
+    }
+  }
+  delete call;
+}
+
+}  // extern "C"
+
+// One registered tenant: its program, quota and current isolate (null while
+// evicted). Idle resident tenants are kept on the manager's LRU list.
+struct TenantEntry {
+  std::string tenant_id;
+  std::string program_path;
+  std::string script_uri;
+  int64_t heap_quota_bytes = 0;
+  Dart_Isolate isolate = nullptr;
+  Dart_IsolateGroup group = nullptr;
+  std::shared_ptr<TenantIsolateLink> link;
+  bool busy = false;
+  // Set while the acquiring thread creates the isolate outside the lock.
+  bool creating = false;
+  bool in_lru = false;
+  std::list<TenantEntry*>::iterator lru_it;
+  int64_t evictions = 0;
+  int64_t quota_kills = 0;
+  int64_t creations = 0;
+};
+
+// |mutex| guards the tenant table and LRU only; isolates are created, set up
+// and shut down without it so one cold start does not stall other tenants.
+struct DartVmEmbedTenantManager {
+  std::mutex mutex;
+  DartVmEmbedTenantManagerConfig config;
+  std::unordered_map<std::string, TenantEntry*> tenants;
+  // Front is least recently released.
+  std::list<TenantEntry*> idle_lru;
+};
+
+static int64_t ProcessRssBytes() {
+#if defined(__linux__)
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f == nullptr) {
+    return -1;
+  }
+  long pages_total = 0;
+  long pages_resident = 0;
+  const int fields = fscanf(f, "%ld %ld", &pages_total, &pages_resident);
+  fclose(f);
+  if (fields != 2) {
+    return -1;
+  }
+  return static_cast<int64_t>(pages_resident) * sysconf(_SC_PAGESIZE);
+#else
+  return -1;
+#endif
+}
+
+static int64_t TenantHeapUsedBytes(const TenantEntry& tenant) {
+  if (tenant.group == nullptr) {
+    return 0;
+  }
+  return Dart_IsolateGroupHeapOldUsedMetric(tenant.group) +
+         Dart_IsolateGroupHeapNewUsedMetric(tenant.group) +
+         Dart_IsolateGroupHeapOldExternalMetric(tenant.group) +
+         Dart_IsolateGroupHeapNewExternalMetric(tenant.group);
+}
+
+static void RemoveFromTenantLru(DartVmEmbedTenantManager* manager,
+                                TenantEntry* tenant) {
+  if (tenant->in_lru) {
+    manager->idle_lru.erase(tenant->lru_it);
+    tenant->in_lru = false;
+  }
+}
+
+// Forgets the tenant's isolate. Requires the manager lock.
+static void ClearTenantIsolate(DartVmEmbedTenantManager* manager,
+                               TenantEntry* tenant) {
+  RemoveFromTenantLru(manager, tenant);
+  if (tenant->link != nullptr) {
+    tenant->link->tenant = nullptr;
+    tenant->link.reset();
+  }
+  tenant->isolate = nullptr;
+  tenant->group = nullptr;
+}
+
+// Takes the tenant's isolate away under the manager lock; the caller shuts it
+// down with ShutdownTenantIsolates once the lock is released.
+static void DetachTenantIsolate(DartVmEmbedTenantManager* manager,
+                                TenantEntry* tenant,
+                                std::vector<Dart_Isolate>* detached) {
+  if (tenant->isolate != nullptr) {
+    detached->push_back(tenant->isolate);
+  }
+  ClearTenantIsolate(manager, tenant);
+}
+
+// Called while a tenant isolate shuts down, before its group is freed, so
+// the tenant never hands out or measures a dead isolate.
+static void UnlinkTenantIsolate(
+    const std::shared_ptr<TenantIsolateLink>& link) {
+  if (link == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(link->manager->mutex);
+  if (link->tenant != nullptr) {
+    ClearTenantIsolate(link->manager, link->tenant);
+  }
+}
+
+static void ShutdownTenantIsolates(const std::vector<Dart_Isolate>& isolates) {
+  for (Dart_Isolate isolate : isolates) {
+    DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  }
+}
+
+// Evicts idle tenants, least recently used first, until the heap they held
+// covers how far the process RSS is above the configured watermark. RSS is
+// read once: freed heap pages are not returned to the OS right away, so
+// re-reading it after each eviction would empty the whole LRU.
+static void EvictTenantsToWatermark(DartVmEmbedTenantManager* manager,
+                                    std::vector<Dart_Isolate>* detached) {
+  const int64_t watermark = manager->config.rss_watermark_bytes;
+  if (watermark <= 0 || manager->idle_lru.empty()) {
+    return;
+  }
+  const int64_t rss = ProcessRssBytes();
+  if (rss < 0 || rss <= watermark) {
+    return;
+  }
+  int64_t deficit = rss - watermark;
+  while (deficit > 0 && !manager->idle_lru.empty()) {
+    TenantEntry* victim = manager->idle_lru.front();
+    deficit -= TenantHeapUsedBytes(*victim);
+    DetachTenantIsolate(manager, victim, detached);
+    ++victim->evictions;
+  }
+}
+
+extern "C" {
+
+DartVmEmbedStatus DartVmEmbed_TenantManagerCreate(
+    const DartVmEmbedTenantManagerConfig* config,
+    DartVmEmbedTenantManager** out_manager) {
+  ResetThreadStatus();
+  if (out_manager == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantManagerCreate: out_manager is null.");
+    return t_status.code;
+  }
+  auto* manager = new DartVmEmbedTenantManager();
+  if (config != nullptr) {
+    manager->config = *config;
+  }
+  *out_manager = manager;
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+void DartVmEmbed_TenantManagerDestroy(DartVmEmbedTenantManager* manager) {
+  if (manager == nullptr) {
+    return;
+  }
+  std::vector<Dart_Isolate> detached;
+  std::unordered_map<std::string, TenantEntry*> tenants;
+  {
+    std::lock_guard<std::mutex> lock(manager->mutex);
+    for (auto& entry : manager->tenants) {
+      DetachTenantIsolate(manager, entry.second, &detached);
+    }
+    tenants.swap(manager->tenants);
+  }
+  ShutdownTenantIsolates(detached);
+  for (auto& entry : tenants) {
+    delete entry.second;
+  }
+  delete manager;
+}
+
+DartVmEmbedStatus DartVmEmbed_TenantRegister(DartVmEmbedTenantManager* manager,
+                                             const char* tenant_id,
+                                             const char* program_path,
+                                             const char* script_uri,
+                                             int64_t heap_quota_bytes) {
+  ResetThreadStatus();
+  if (manager == nullptr || tenant_id == nullptr || program_path == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantRegister: invalid argument.");
+    return t_status.code;
+  }
+  std::lock_guard<std::mutex> lock(manager->mutex);
+  if (manager->tenants.find(tenant_id) != manager->tenants.end()) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantRegister: tenant already exists.");
+    return t_status.code;
+  }
+  auto* tenant = new TenantEntry();
+  tenant->tenant_id = tenant_id;
+  tenant->program_path = program_path;
+  tenant->script_uri = script_uri != nullptr ? script_uri : program_path;
+  tenant->heap_quota_bytes = heap_quota_bytes > 0
+                                 ? heap_quota_bytes
+                                 : manager->config.default_heap_quota_bytes;
+  manager->tenants.emplace(tenant->tenant_id, tenant);
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_TenantUnregister(DartVmEmbedTenantManager* manager,
+                                               const char* tenant_id) {
+  ResetThreadStatus();
+  if (manager == nullptr || tenant_id == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantUnregister: invalid argument.");
+    return t_status.code;
+  }
+  if (Dart_CurrentIsolate() != nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantUnregister: exit the current "
+                       "isolate first.");
+    return t_status.code;
+  }
+  std::vector<Dart_Isolate> detached;
+  {
+    std::lock_guard<std::mutex> lock(manager->mutex);
+    auto it = manager->tenants.find(tenant_id);
+    if (it == manager->tenants.end() || it->second->busy) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                         "DartVmEmbed_TenantUnregister: unknown or busy "
+                         "tenant.");
+      return t_status.code;
+    }
+    DetachTenantIsolate(manager, it->second, &detached);
+    delete it->second;
+    manager->tenants.erase(it);
+  }
+  ShutdownTenantIsolates(detached);
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_TenantAcquire(DartVmEmbedTenantManager* manager,
+                                            const char* tenant_id,
+                                            Dart_Isolate* out_isolate) {
+  ResetThreadStatus();
+  if (out_isolate != nullptr) {
+    *out_isolate = nullptr;
+  }
+  if (manager == nullptr || tenant_id == nullptr || out_isolate == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantAcquire: invalid argument.");
+    return t_status.code;
+  }
+  if (Dart_CurrentIsolate() != nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantAcquire: exit the current isolate "
+                       "first.");
+    return t_status.code;
+  }
+
+  TenantEntry* tenant = nullptr;
+  std::vector<Dart_Isolate> detached;
+  {
+    std::lock_guard<std::mutex> lock(manager->mutex);
+    auto it = manager->tenants.find(tenant_id);
+    if (it == manager->tenants.end() || it->second->busy) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                         "DartVmEmbed_TenantAcquire: unknown or busy tenant.");
+      return t_status.code;
+    }
+    tenant = it->second;
+    RemoveFromTenantLru(manager, tenant);
+    tenant->busy = true;
+    if (tenant->isolate != nullptr) {
+      *out_isolate = tenant->isolate;
+      return DARTVM_EMBED_STATUS_OK;
+    }
+    // Busy keeps the entry alive and private to this thread while the
+    // isolate is created below. Make room before adding another group.
+    tenant->creating = true;
+    EvictTenantsToWatermark(manager, &detached);
+  }
+  ShutdownTenantIsolates(detached);
+
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromProgramFile(
+      tenant->program_path.c_str(), tenant->script_uri.c_str(), nullptr,
+      nullptr, /*error=*/nullptr);
+  Dart_IsolateGroup group = nullptr;
+  auto link = std::make_shared<TenantIsolateLink>();
+  link->manager = manager;
+  bool ok = isolate != nullptr;
+  if (ok) {
+    bool entered_isolate = false;
+    if (Dart_CurrentIsolate() == nullptr) {
+      Dart_EnterIsolate(isolate);
+      entered_isolate = true;
+    }
+    group = Dart_CurrentIsolateGroup();
+    if (entered_isolate) {
+      Dart_ExitIsolate();
+    }
+    {
+      // Keeps DartVmEmbed_ShutdownIsolates(nullptr, ...) away from it.
+      std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+      auto it = g_isolate_records.find(isolate);
+      if (it != g_isolate_records.end()) {
+        it->second.tenant_link = link;
+      }
+    }
+    DartVmEmbedTenantInitCallback on_created =
+        manager->config.on_isolate_created;
+    if (on_created != nullptr &&
+        !on_created(manager->config.user_data, tenant->tenant_id.c_str(),
+                    isolate)) {
+      DartVmEmbed_ShutdownIsolateByHandle(isolate);
+      RecordThreadStatus(DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED,
+                         "DartVmEmbed_TenantAcquire: on_isolate_created "
+                         "callback failed.");
+      ok = false;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(manager->mutex);
+  tenant->creating = false;
+  if (ok) {
+    // on_isolate_created may have shut the isolate down; its record, and
+    // the link in it, are gone then.
+    std::lock_guard<InstrumentedMutex> maps_lock(g_embedder_maps_mutex);
+    auto it = g_isolate_records.find(isolate);
+    if (it == g_isolate_records.end() || it->second.tenant_link != link) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED,
+                         "DartVmEmbed_TenantAcquire: the isolate shut down "
+                         "during on_isolate_created.");
+      ok = false;
+    }
+  }
+  if (!ok) {
+    tenant->busy = false;
+    return FinishThreadStatus(false, DARTVM_EMBED_STATUS_ISOLATE_CREATE_FAILED);
+  }
+  link->tenant = tenant;
+  tenant->link = link;
+  tenant->isolate = isolate;
+  tenant->group = group;
+  ++tenant->creations;
+  *out_isolate = isolate;
+  return FinishThreadStatus(true, DARTVM_EMBED_STATUS_OK);
+}
+
+DartVmEmbedStatus DartVmEmbed_TenantRelease(DartVmEmbedTenantManager* manager,
+                                            const char* tenant_id) {
+  ResetThreadStatus();
+  if (manager == nullptr || tenant_id == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantRelease: invalid argument.");
+    return t_status.code;
+  }
+  if (Dart_CurrentIsolate() != nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantRelease: exit the current isolate "
+                       "first.");
+    return t_status.code;
+  }
+  std::vector<Dart_Isolate> detached;
+  {
+    std::lock_guard<std::mutex> lock(manager->mutex);
+    auto it = manager->tenants.find(tenant_id);
+    if (it == manager->tenants.end() || !it->second->busy ||
+        it->second->creating) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                         "DartVmEmbed_TenantRelease: tenant is not acquired.");
+      return t_status.code;
+    }
+    TenantEntry* tenant = it->second;
+    tenant->busy = false;
+    if (tenant->isolate == nullptr) {
+      return DARTVM_EMBED_STATUS_OK;
+    }
+
+    if (tenant->heap_quota_bytes > 0 &&
+        TenantHeapUsedBytes(*tenant) > tenant->heap_quota_bytes) {
+      DetachTenantIsolate(manager, tenant, &detached);
+      ++tenant->quota_kills;
+      RecordThreadStatus(DARTVM_EMBED_STATUS_QUOTA_EXCEEDED,
+                         "DartVmEmbed_TenantRelease: tenant heap quota "
+                         "exceeded; the isolate was shut down.");
+    } else {
+      tenant->lru_it =
+          manager->idle_lru.insert(manager->idle_lru.end(), tenant);
+      tenant->in_lru = true;
+      EvictTenantsToWatermark(manager, &detached);
+    }
+  }
+  ShutdownTenantIsolates(detached);
+  return t_status.code;
+}
+
+DartVmEmbedStatus DartVmEmbed_TenantGetStats(DartVmEmbedTenantManager* manager,
+                                             const char* tenant_id,
+                                             DartVmEmbedTenantStats* out_stats) {
+  ResetThreadStatus();
+  if (manager == nullptr || tenant_id == nullptr || out_stats == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantGetStats: invalid argument.");
+    return t_status.code;
+  }
+  std::lock_guard<std::mutex> lock(manager->mutex);
+  auto it = manager->tenants.find(tenant_id);
+  if (it == manager->tenants.end()) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_TenantGetStats: unknown tenant.");
+    return t_status.code;
+  }
+  const TenantEntry& tenant = *it->second;
+  out_stats->resident = tenant.isolate != nullptr;
+  out_stats->busy = tenant.busy;
+  out_stats->heap_used_bytes = TenantHeapUsedBytes(tenant);
+  out_stats->heap_quota_bytes = tenant.heap_quota_bytes;
+  out_stats->creations = tenant.creations;
+  out_stats->evictions = tenant.evictions;
+  out_stats->quota_kills = tenant.quota_kills;
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+void DartVmEmbed_GetMetricsSnapshot(DartVmEmbedMetricsSnapshot* out_snapshot) {
+  if (out_snapshot == nullptr) {
+    return;
+  }
+  *out_snapshot = DartVmEmbedMetricsSnapshot();
+  out_snapshot->isolate_creations_total = SumMetric(kMetricIsolateCreations);
+  out_snapshot->isolate_creation_failures_total =
+      SumMetric(kMetricIsolateCreationFailures);
+  out_snapshot->isolate_shutdowns_total = SumMetric(kMetricIsolateShutdowns);
+  out_snapshot->isolates_alive = out_snapshot->isolate_creations_total -
+                                 out_snapshot->isolate_shutdowns_total;
+  out_snapshot->kernel_buffer_bytes = SumMetric(kMetricKernelBufferBytes);
+  out_snapshot->loaded_aot_elfs = SumMetric(kMetricLoadedAotElfs);
+  out_snapshot->reload_file_checks_total = SumMetric(kMetricReloadFileChecks);
+  out_snapshot->service_warmups_total = SumMetric(kMetricServiceWarmups);
+  out_snapshot->service_warmup_retries_total =
+      SumMetric(kMetricServiceWarmupRetries);
+  out_snapshot->isolate_spawns_total = SumMetric(kMetricIsolateSpawns);
+  out_snapshot->isolate_spawn_setup_ns_total =
+      SumMetric(kMetricIsolateSpawnSetupNs);
+  for (const MetricsShard& shard : g_metrics_shards) {
+    for (size_t i = 0; i < kCreationLatencyBuckets; ++i) {
+      out_snapshot->creation_latency_buckets[i] +=
+          shard.latency_buckets[i].load(std::memory_order_relaxed);
+    }
+    out_snapshot->creation_latency_sum_ns +=
+        shard.latency_sum_ns.load(std::memory_order_relaxed);
+  }
+}
+
+static void AppendMetric(std::string* out,
+                         const char* name,
+                         const char* type,
+                         const char* help,
+                         int64_t value) {
+  char line[256];
+  snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", name,
+           help, name, type, name, static_cast<long long>(value));
+  out->append(line);
+}
+
+// Writes a temporary file next to |path| and renames it over |path|, so
+// readers never observe a partially written file.
+static bool ReplaceFileContents(const char* path,
+                                const void* data,
+                                size_t size) {
+  std::string tmp_path = std::string(path) + ".XXXXXX";
+  const int fd = mkstemp(&tmp_path[0]);
+  if (fd < 0) {
+    return false;
+  }
+  fchmod(fd, 0644);
+  const bool written = WriteFully(fd, data, size);
+  const bool closed = close(fd) == 0;
+  if (!written || !closed || rename(tmp_path.c_str(), path) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+static std::string FormatMetricsPrometheus() {
+  DartVmEmbedMetricsSnapshot snapshot;
+  DartVmEmbed_GetMetricsSnapshot(&snapshot);
+  std::string out;
+  AppendMetric(&out, "dartvm_embed_isolates_alive", "gauge",
+               "Root isolates created through the embedder and not shut down.",
+               snapshot.isolates_alive);
+  AppendMetric(&out, "dartvm_embed_isolate_creations_total", "counter",
+               "Successful root isolate creations.",
+               snapshot.isolate_creations_total);
+  AppendMetric(&out, "dartvm_embed_isolate_creation_failures_total", "counter",
+               "Failed root isolate creations.",
+               snapshot.isolate_creation_failures_total);
+  AppendMetric(&out, "dartvm_embed_isolate_shutdowns_total", "counter",
+               "Isolates shut down through the embedder.",
+               snapshot.isolate_shutdowns_total);
+  AppendMetric(&out, "dartvm_embed_kernel_buffer_bytes", "gauge",
+               "Kernel bytes retained for program-file isolates.",
+               snapshot.kernel_buffer_bytes);
+  AppendMetric(&out, "dartvm_embed_loaded_aot_elfs", "gauge",
+               "AOT ELF snapshots currently loaded.", snapshot.loaded_aot_elfs);
+  AppendMetric(&out, "dartvm_embed_reload_file_checks_total", "counter",
+               "File-modified checks made by the VM during reloads.",
+               snapshot.reload_file_checks_total);
+  AppendMetric(&out, "dartvm_embed_service_warmups_total", "counter",
+               "Successful VM service reload warmups.",
+               snapshot.service_warmups_total);
+  AppendMetric(&out, "dartvm_embed_service_warmup_retries_total", "counter",
+               "Failed VM service reload warmup attempts.",
+               snapshot.service_warmup_retries_total);
+  AppendMetric(&out, "dartvm_embed_isolate_spawns_total", "counter",
+               "Isolates initialized inside an existing group (Isolate.spawn).",
+               snapshot.isolate_spawns_total);
+
+  char line[256];
+  const char* spawn_setup = "dartvm_embed_isolate_spawn_setup_seconds_total";
+  snprintf(line, sizeof(line),
+           "# HELP %s Embedder setup time spent in spawned isolates.\n"
+           "# TYPE %s counter\n%s %.9f\n",
+           spawn_setup, spawn_setup, spawn_setup,
+           static_cast<double>(snapshot.isolate_spawn_setup_ns_total) / 1e9);
+  out.append(line);
+
+  const char* histogram = "dartvm_embed_isolate_creation_seconds";
+  snprintf(line, sizeof(line),
+           "# HELP %s Root isolate creation latency.\n# TYPE %s histogram\n",
+           histogram, histogram);
+  out.append(line);
+  int64_t cumulative = 0;
+  for (size_t i = 0; i < kCreationLatencyBuckets; ++i) {
+    cumulative += snapshot.creation_latency_buckets[i];
+    if (i + 1 < kCreationLatencyBuckets) {
+      snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %lld\n", histogram,
+               static_cast<double>(kCreationLatencyBoundsNs[i]) / 1e9,
+               static_cast<long long>(cumulative));
+    } else {
+      snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %lld\n", histogram,
+               static_cast<long long>(cumulative));
+    }
+    out.append(line);
+  }
+  snprintf(line, sizeof(line), "%s_sum %.9f\n%s_count %lld\n", histogram,
+           static_cast<double>(snapshot.creation_latency_sum_ns) / 1e9,
+           histogram, static_cast<long long>(cumulative));
+  out.append(line);
+  return out;
+}
+
+DartVmEmbedStatus DartVmEmbed_WriteMetricsPrometheusFd(int fd) {
+  ResetThreadStatus();
+  if (fd < 0) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_WriteMetricsPrometheusFd: invalid fd.");
+    return t_status.code;
+  }
+  const std::string text = FormatMetricsPrometheus();
+  if (!WriteFully(fd, text.data(), text.size())) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_IO_ERROR,
+                       "DartVmEmbed_WriteMetricsPrometheusFd: write failed.");
+    return t_status.code;
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_WriteMetricsPrometheusFile(const char* path) {
+  ResetThreadStatus();
+  if (path == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_WriteMetricsPrometheusFile: path is null.");
+    return t_status.code;
+  }
+  const std::string text = FormatMetricsPrometheus();
+  if (!ReplaceFileContents(path, text.data(), text.size())) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_IO_ERROR,
+                       "DartVmEmbed_WriteMetricsPrometheusFile: failed to "
+                       "write metrics file.");
+    return t_status.code;
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_StartHeapSampling(
+    const DartVmEmbedHeapSamplingConfig* config) {
+  ResetThreadStatus();
+  const DartVmEmbedHeapSamplingConfig defaults;
+  if (config == nullptr) {
+    config = &defaults;
+  }
+  if (config->sampling_interval_bytes <= 0 || config->max_stacks <= 0 ||
+      config->max_frames < 0 ||
+      config->max_frames > static_cast<int32_t>(kHeapSampleMaxFrames)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_StartHeapSampling: invalid config.");
+    return t_status.code;
+  }
+  if (!g_vm_initialized) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_StartHeapSampling: VM is not initialized.");
+    return t_status.code;
+  }
+
+  std::lock_guard<std::mutex> lock(g_heap_sampling.mutex);
+  if (g_heap_sampling.active) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_StartHeapSampling: sampling is already "
+                       "active.");
+    return t_status.code;
+  }
+  // The table outlives Stop: live samples still reference it by index, so it
+  // only ever grows.
+  if (g_heap_sampling.stacks.empty()) {
+    g_heap_sampling.stacks.emplace_back();
+    g_heap_sampling.stacks[0].class_name = "[stack table full]";
+  }
+  const uint32_t max_stacks = static_cast<uint32_t>(config->max_stacks);
+  if (max_stacks > g_heap_sampling.max_stacks) {
+    g_heap_sampling.max_stacks = max_stacks;
+    RebuildHeapSampleSlots(&g_heap_sampling);
+  }
+  g_heap_sampling.max_frames.store(static_cast<uint32_t>(config->max_frames),
+                                   std::memory_order_relaxed);
+  g_heap_sampling.interval_bytes = config->sampling_interval_bytes;
+  if (!g_heap_sampling.callbacks_registered) {
+    Dart_RegisterHeapSamplingCallback(HeapSampleCreateCallback,
+                                      HeapSampleDeleteCallback);
+    g_heap_sampling.callbacks_registered = true;
+  }
+  Dart_SetHeapSamplingPeriod(
+      static_cast<intptr_t>(config->sampling_interval_bytes));
+  Dart_EnableHeapSampling();
+  g_heap_sampling.active = true;
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_StopHeapSampling(void) {
+  ResetThreadStatus();
+  std::lock_guard<std::mutex> lock(g_heap_sampling.mutex);
+  if (!g_heap_sampling.active) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_StopHeapSampling: sampling is not active.");
+    return t_status.code;
+  }
+  Dart_DisableHeapSampling();
+  g_heap_sampling.active = false;
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_GetHeapSamplingStats(
+    DartVmEmbedHeapSamplingStats* out_stats) {
+  ResetThreadStatus();
+  if (out_stats == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_GetHeapSamplingStats: out_stats is null.");
+    return t_status.code;
+  }
+  *out_stats = DartVmEmbedHeapSamplingStats();
+  std::lock_guard<std::mutex> lock(g_heap_sampling.mutex);
+  out_stats->active = g_heap_sampling.active;
+  out_stats->samples_total = g_heap_sampling.samples_total;
+  out_stats->overflow_samples = g_heap_sampling.overflow_samples;
+  if (!g_heap_sampling.stacks.empty()) {
+    out_stats->stacks =
+        static_cast<int64_t>(g_heap_sampling.stacks.size() - 1);
+  }
+  for (const HeapSampleStack& stack : g_heap_sampling.stacks) {
+    out_stats->live_samples += stack.live_count;
+    out_stats->live_sampled_bytes += stack.live_bytes;
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+// Minimal protobuf writer for the pprof profile.proto message.
+static void PutVarint(std::string* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+static void PutVarintField(std::string* out, int field, uint64_t value) {
+  PutVarint(out, static_cast<uint64_t>(field) << 3);
+  PutVarint(out, value);
+}
+
+static void PutBytesField(std::string* out,
+                          int field,
+                          const std::string& bytes) {
+  PutVarint(out, (static_cast<uint64_t>(field) << 3) | 2);
+  PutVarint(out, bytes.size());
+  out->append(bytes);
+}
+
+static void PutPackedField(std::string* out,
+                           int field,
+                           const std::vector<uint64_t>& values) {
+  std::string packed;
+  for (uint64_t value : values) {
+    PutVarint(&packed, value);
+  }
+  PutBytesField(out, field, packed);
+}
+
+struct PprofStringTable {
+  std::vector<std::string> strings{std::string()};
+  std::unordered_map<std::string, uint64_t> index{{std::string(), 0}};
+
+  uint64_t Intern(const std::string& value) {
+    auto it = index.find(value);
+    if (it != index.end()) {
+      return it->second;
+    }
+    const uint64_t id = strings.size();
+    strings.push_back(value);
+    index.emplace(value, id);
+    return id;
+  }
+};
+
+struct PprofMapping {
+  uintptr_t start;
+  uintptr_t limit;
+  uint64_t offset;
+  std::string path;
+};
+
+// Executable file mappings, so pprof can symbolize native and AOT frames.
+static std::vector<PprofMapping> ReadExecutableMappings() {
+  std::vector<PprofMapping> mappings;
+  FILE* maps = fopen("/proc/self/maps", "r");
+  if (maps == nullptr) {
+    return mappings;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), maps) != nullptr) {
+    unsigned long long start = 0;
+    unsigned long long limit = 0;
+    unsigned long long offset = 0;
+    char perms[8] = {};
+    int path_start = 0;
+    if (sscanf(line, "%llx-%llx %7s %llx %*s %*s %n", &start, &limit, perms,
+               &offset, &path_start) < 4 ||
+        perms[2] != 'x' || path_start == 0 || line[path_start] != '/') {
+      continue;
+    }
+    std::string path(line + path_start);
+    while (!path.empty() && (path.back() == '\n' || path.back() == ' ')) {
+      path.pop_back();
+    }
+    mappings.push_back(PprofMapping{static_cast<uintptr_t>(start),
+                                    static_cast<uintptr_t>(limit), offset,
+                                    path});
+  }
+  fclose(maps);
+  return mappings;
+}
+
+// Undoes Poisson sampling the same way Go's heap profiles do.
+static void ScaleHeapSample(int64_t count,
+                            int64_t bytes,
+                            int64_t interval,
+                            int64_t* out_count,
+                            int64_t* out_bytes) {
+  if (count <= 0 || bytes <= 0) {
+    *out_count = 0;
+    *out_bytes = 0;
+    return;
+  }
+  const double average = static_cast<double>(bytes) / count;
+  const double scale = 1.0 / (1.0 - std::exp(-average / interval));
+  *out_count = static_cast<int64_t>(count * scale);
+  *out_bytes = static_cast<int64_t>(bytes * scale);
+}
+
+static std::string EncodeHeapProfilePprof() {
+  std::vector<HeapSampleStack> stacks;
+  int64_t interval = 0;
+  {
+    std::lock_guard<std::mutex> lock(g_heap_sampling.mutex);
+    stacks = g_heap_sampling.stacks;
+    interval = g_heap_sampling.interval_bytes;
+  }
+
+  PprofStringTable strings;
+  std::string profile;
+  const char* sample_types[][2] = {{"alloc_objects", "count"},
+                                   {"alloc_space", "bytes"},
+                                   {"inuse_objects", "count"},
+                                   {"inuse_space", "bytes"}};
+  for (const auto& sample_type : sample_types) {
+    std::string value_type;
+    PutVarintField(&value_type, 1, strings.Intern(sample_type[0]));
+    PutVarintField(&value_type, 2, strings.Intern(sample_type[1]));
+    PutBytesField(&profile, 1, value_type);
+  }
+
+  const std::vector<PprofMapping> mappings = ReadExecutableMappings();
+  std::unordered_map<uintptr_t, uint64_t> address_locations;
+  std::unordered_map<std::string, uint64_t> class_locations;
+  std::string locations;
+  std::string functions;
+  uint64_t next_location_id = 1;
+
+  for (const HeapSampleStack& stack : stacks) {
+    if (stack.alloc_count == 0) {
+      continue;
+    }
+    std::vector<uint64_t> location_ids;
+    // The allocated class is the leaf frame.
+    auto class_it = class_locations.find(stack.class_name);
+    if (class_it == class_locations.end()) {
+      const uint64_t id = next_location_id++;
+      std::string function;
+      PutVarintField(&function, 1, id);
+      PutVarintField(&function, 2, strings.Intern(stack.class_name));
+      PutBytesField(&functions, 5, function);
+      std::string line;
+      PutVarintField(&line, 1, id);
+      std::string location;
+      PutVarintField(&location, 1, id);
+      PutBytesField(&location, 4, line);
+      PutBytesField(&locations, 4, location);
+      class_it = class_locations.emplace(stack.class_name, id).first;
+    }
+    location_ids.push_back(class_it->second);
+    for (uint32_t i = 0; i < stack.frame_count; ++i) {
+      const uintptr_t pc = stack.frames[i];
+      auto address_it = address_locations.find(pc);
+      if (address_it == address_locations.end()) {
+        const uint64_t id = next_location_id++;
+        std::string location;
+        PutVarintField(&location, 1, id);
+        for (size_t m = 0; m < mappings.size(); ++m) {
+          if (pc >= mappings[m].start && pc < mappings[m].limit) {
+            PutVarintField(&location, 2, m + 1);
+            break;
+          }
+        }
+        PutVarintField(&location, 3, pc);
+        PutBytesField(&locations, 4, location);
+        address_it = address_locations.emplace(pc, id).first;
+      }
+      location_ids.push_back(address_it->second);
+    }
+
+    int64_t alloc_count = 0;
+    int64_t alloc_bytes = 0;
+    int64_t live_count = 0;
+    int64_t live_bytes = 0;
+    ScaleHeapSample(stack.alloc_count, stack.alloc_bytes, interval,
+                    &alloc_count, &alloc_bytes);
+    ScaleHeapSample(stack.live_count, stack.live_bytes, interval, &live_count,
+                    &live_bytes);
+    std::string sample;
+    PutPackedField(&sample, 1, location_ids);
+    PutPackedField(&sample, 2,
+                   {static_cast<uint64_t>(alloc_count),
+                    static_cast<uint64_t>(alloc_bytes),
+                    static_cast<uint64_t>(live_count),
+                    static_cast<uint64_t>(live_bytes)});
+    PutBytesField(&profile, 2, sample);
+  }
+
+  for (size_t m = 0; m < mappings.size(); ++m) {
+    std::string mapping;
+    PutVarintField(&mapping, 1, m + 1);
+    PutVarintField(&mapping, 2, mappings[m].start);
+    PutVarintField(&mapping, 3, mappings[m].limit);
+    PutVarintField(&mapping, 4, mappings[m].offset);
+    PutVarintField(&mapping, 5, strings.Intern(mappings[m].path));
+    PutBytesField(&profile, 3, mapping);
+  }
+  profile.append(locations);
+  profile.append(functions);
+
+  std::string period_type;
+  PutVarintField(&period_type, 1, strings.Intern("space"));
+  PutVarintField(&period_type, 2, strings.Intern("bytes"));
+  for (const std::string& value : strings.strings) {
+    PutBytesField(&profile, 6, value);
+  }
+  const int64_t now_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  PutVarintField(&profile, 9, static_cast<uint64_t>(now_ns));
+  PutBytesField(&profile, 11, period_type);
+  PutVarintField(&profile, 12, static_cast<uint64_t>(interval));
+  return profile;
+}
+
+DartVmEmbedStatus DartVmEmbed_WriteHeapProfilePprof(const char* path) {
+  ResetThreadStatus();
+  if (path == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_WriteHeapProfilePprof: path is null.");
+    return t_status.code;
+  }
+  const std::string profile = EncodeHeapProfilePprof();
+  if (!ReplaceFileContents(path, profile.data(), profile.size())) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_IO_ERROR,
+                       "DartVmEmbed_WriteHeapProfilePprof: failed to write "
+                       "profile.");
+    return t_status.code;
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+// Minimal JSON reader for VM service responses.
+struct JsonValue {
+  enum Type { kNull, kBool, kNumber, kString, kArray, kObject };
+  Type type = kNull;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+
+  const JsonValue* Get(const char* key) const {
+    for (const auto& member : object) {
+      if (member.first == key) {
+        return &member.second;
+      }
+    }
+    return nullptr;
+  }
+};
+
+class JsonReader {
+ public:
+  JsonReader(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  bool Parse(JsonValue* out) {
+    if (!ParseValue(out, 0)) {
+      return false;
+    }
+    SkipSpace();
+    return p_ == end_;
+  }
+
+ private:
+  static const int kMaxDepth = 64;
+
+  void SkipSpace() {
+    while (p_ < end_ &&
+           (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+      ++p_;
+    }
+  }
+
+  bool Consume(const char* literal) {
+    const size_t len = strlen(literal);
+    if (static_cast<size_t>(end_ - p_) < len || memcmp(p_, literal, len) != 0) {
+      return false;
+    }
+    p_ += len;
+    return true;
+  }
+
+  static void AppendUtf8(uint32_t code_point, std::string* out) {
+    if (code_point < 0x80) {
+      out->push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      out->push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    } else if (code_point < 0x10000) {
+      out->push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    } else {
+      out->push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    }
+  }
+
+  bool ParseHex4(uint32_t* out) {
+    if (end_ - p_ < 4) {
+      return false;
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = *p_++;
+      value <<= 4;
+      if (c >= '0' && c <= '9') {
+        value |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        value |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        value |= c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    *out = value;
+    return true;
+  }
+
+  bool ParseString(std::string* out) {
+    if (p_ >= end_ || *p_ != '"') {
+      return false;
+    }
+    ++p_;
+    while (p_ < end_ && *p_ != '"') {
+      if (*p_ != '\\') {
+        out->push_back(*p_++);
+        continue;
+      }
+      if (++p_ >= end_) {
+        return false;
+      }
+      const char escape = *p_++;
+      switch (escape) {
+        case '"':
+        case '\\':
+        case '/':
+          out->push_back(escape);
+          break;
+        case 'b':
+          out->push_back('\b');
+          break;
+        case 'f':
+          out->push_back('\f');
+          break;
+        case 'n':
+          out->push_back('\n');
+          break;
+        case 'r':
+          out->push_back('\r');
+          break;
+        case 't':
+          out->push_back('\t');
+          break;
+        case 'u': {
+          uint32_t code_point = 0;
+          if (!ParseHex4(&code_point)) {
+            return false;
+          }
+          if (code_point >= 0xd800 && code_point < 0xdc00 && end_ - p_ >= 6 &&
+              p_[0] == '\\' && p_[1] == 'u') {
+            p_ += 2;
+            uint32_t low = 0;
+            if (!ParseHex4(&low)) {
+              return false;
+            }
+            code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+          }
+          AppendUtf8(code_point, out);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    if (p_ >= end_) {
+      return false;
+    }
+    ++p_;
+    return true;
+  }
+
+  bool ParseValue(JsonValue* out, int depth) {
+    if (depth > kMaxDepth) {
+      return false;
+    }
+    SkipSpace();
+    if (p_ >= end_) {
+      return false;
+    }
+    switch (*p_) {
+      case '{': {
+        ++p_;
+        out->type = JsonValue::kObject;
+        SkipSpace();
+        if (p_ < end_ && *p_ == '}') {
+          ++p_;
+          return true;
+        }
+        while (true) {
+          SkipSpace();
+          std::pair<std::string, JsonValue> member;
+          if (!ParseString(&member.first)) {
+            return false;
+          }
+          SkipSpace();
+          if (p_ >= end_ || *p_++ != ':' ||
+              !ParseValue(&member.second, depth + 1)) {
+            return false;
+          }
+          out->object.push_back(std::move(member));
+          SkipSpace();
+          if (p_ < end_ && *p_ == ',') {
+            ++p_;
+            continue;
+          }
+          return p_ < end_ && *p_++ == '}';
+        }
+      }
+      case '[': {
+        ++p_;
+        out->type = JsonValue::kArray;
+        SkipSpace();
+        if (p_ < end_ && *p_ == ']') {
+          ++p_;
+          return true;
+        }
+        while (true) {
+          out->array.emplace_back();
+          if (!ParseValue(&out->array.back(), depth + 1)) {
+            return false;
+          }
+          SkipSpace();
+          if (p_ < end_ && *p_ == ',') {
+            ++p_;
+            continue;
+          }
+          return p_ < end_ && *p_++ == ']';
+        }
+      }
+      case '"':
+        out->type = JsonValue::kString;
+        return ParseString(&out->string);
+      case 't':
+        out->type = JsonValue::kBool;
+        out->boolean = true;
+        return Consume("true");
+      case 'f':
+        out->type = JsonValue::kBool;
+        return Consume("false");
+      case 'n':
+        return Consume("null");
+      default: {
+        const std::string number(p_, std::min<size_t>(end_ - p_, 64));
+        char* number_end = nullptr;
+        out->type = JsonValue::kNumber;
+        out->number = strtod(number.c_str(), &number_end);
+        if (number_end == number.c_str()) {
+          return false;
+        }
+        p_ += number_end - number.c_str();
+        return true;
+      }
+    }
+  }
+
+  const char* p_;
+  const char* end_;
+};
+
+// Sends |request| to the VM service isolate in-process and returns the
+// JSON-RPC "result" object. Retries while the service isolate starts up.
+static bool InvokeVmServiceRequest(const std::string& request,
+                                   JsonValue* out_result,
+                                   std::string* out_error) {
+  if (!g_service_isolate_enabled) {
+    *out_error =
+        "the VM service isolate is disabled; set "
+        "DartVmEmbedInitConfig::enable_service_isolate or "
+        "DARTVM_EMBED_VM_SERVICE=1.";
+    return false;
+  }
+  OpenServiceIsolateGate();
+  const int max_retries = 10;
+  for (int i = 0; i < max_retries; ++i) {
+    uint8_t* response_json = nullptr;
+    intptr_t response_len = 0;
+    char* vm_error = nullptr;
+    const bool invoked = Dart_InvokeVMServiceMethod(
+        reinterpret_cast<uint8_t*>(const_cast<char*>(request.data())),
+        static_cast<intptr_t>(request.size()), &response_json, &response_len,
+        &vm_error);
+    if (!invoked) {
+      *out_error = vm_error != nullptr ? vm_error : "VM service unavailable.";
+      free(vm_error);
+      free(response_json);
+      usleep(100 * 1000);
+      continue;
+    }
+    free(vm_error);
+    JsonValue response;
+    const char* begin = reinterpret_cast<const char*>(response_json);
+    const bool parsed = JsonReader(begin, begin + response_len).Parse(&response);
+    free(response_json);
+    const JsonValue* result = parsed ? response.Get("result") : nullptr;
+    if (result == nullptr || result->type != JsonValue::kObject) {
+      const JsonValue* error = parsed ? response.Get("error") : nullptr;
+      const JsonValue* message =
+          error != nullptr ? error->Get("message") : nullptr;
+      *out_error = message != nullptr && message->type == JsonValue::kString
+                       ? message->string
+                       : "unexpected VM service response.";
+      return false;
+    }
+    *out_result = *result;
+    return true;
+  }
+  return false;
+}
+
+static bool SetVmServiceFlag(const char* name,
+                             const char* value,
+                             std::string* out_error) {
+  char request[256];
+  snprintf(request, sizeof(request),
+           "{\"jsonrpc\":\"2.0\",\"id\":\"setFlag\",\"method\":"
+           "\"setFlag\",\"params\":{\"name\":\"%s\",\"value\":\"%s\"}}",
+           name, value);
+  JsonValue result;
+  return InvokeVmServiceRequest(request, &result, out_error);
+}
+
+DartVmEmbedStatus DartVmEmbed_StartCpuProfile(
+    const DartVmEmbedCpuProfileConfig* config) {
+  ResetThreadStatus();
+  const DartVmEmbedCpuProfileConfig defaults;
+  if (config == nullptr) {
+    config = &defaults;
+  }
+  if (config->sample_period_us < 50) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_StartCpuProfile: sample_period_us must be "
+                       "at least 50.");
+    return t_status.code;
+  }
+  if (!g_vm_initialized) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_StartCpuProfile: VM is not initialized.");
+    return t_status.code;
+  }
+  char period[32];
+  snprintf(period, sizeof(period), "%d", config->sample_period_us);
+  std::string service_error;
+  if (!SetVmServiceFlag("profile_period", period, &service_error) ||
+      !SetVmServiceFlag("profiler", "true", &service_error)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED, service_error.c_str());
+    return t_status.code;
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_StopCpuProfile(void) {
+  ResetThreadStatus();
+  if (!g_vm_initialized) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_StopCpuProfile: VM is not initialized.");
+    return t_status.code;
+  }
+  std::string service_error;
+  if (!SetVmServiceFlag("profiler", "false", &service_error)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED, service_error.c_str());
+    return t_status.code;
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+// "Owner.name" for Dart functions, the symbol for native ones.
+static std::string CpuProfileFunctionName(const JsonValue& profile_function) {
+  const JsonValue* function = profile_function.Get("function");
+  const JsonValue* name = function != nullptr ? function->Get("name") : nullptr;
+  if (name == nullptr || name->type != JsonValue::kString) {
+    return "<unknown>";
+  }
+  const JsonValue* owner = function->Get("owner");
+  const JsonValue* owner_type = owner != nullptr ? owner->Get("type") : nullptr;
+  const JsonValue* owner_name = owner != nullptr ? owner->Get("name") : nullptr;
+  if (owner_type != nullptr && owner_type->string == "@Class" &&
+      owner_name != nullptr && !owner_name->string.empty()) {
+    return owner_name->string + "." + name->string;
+  }
+  return name->string;
+}
+
+static std::string EncodeCpuProfileCollapsed(
+    const std::vector<std::string>& names,
+    const std::vector<std::pair<std::vector<uint64_t>, int64_t>>& stacks) {
+  std::string out;
+  for (const auto& stack : stacks) {
+    // Service stacks are leaf first; collapsed stacks are root first.
+    for (size_t i = stack.first.size(); i > 0; --i) {
+      std::string frame = names[stack.first[i - 1]];
+      std::replace(frame.begin(), frame.end(), ';', ':');
+      out.append(frame);
+      out.push_back(i > 1 ? ';' : ' ');
+    }
+    if (stack.first.empty()) {
+      out.append("<empty> ");
+    }
+    out.append(std::to_string(stack.second));
+    out.push_back('\n');
+  }
+  return out;
+}
+
+static std::string EncodeCpuProfilePprof(
+    const std::vector<std::string>& names,
+    const std::vector<std::string>& urls,
+    const std::vector<std::pair<std::vector<uint64_t>, int64_t>>& stacks,
+    int64_t period_ns,
+    int64_t duration_ns) {
+  PprofStringTable strings;
+  std::string profile;
+  const char* sample_types[][2] = {{"samples", "count"},
+                                   {"cpu", "nanoseconds"}};
+  for (const auto& sample_type : sample_types) {
+    std::string value_type;
+    PutVarintField(&value_type, 1, strings.Intern(sample_type[0]));
+    PutVarintField(&value_type, 2, strings.Intern(sample_type[1]));
+    PutBytesField(&profile, 1, value_type);
+  }
+  for (const auto& stack : stacks) {
+    std::vector<uint64_t> location_ids;
+    for (uint64_t index : stack.first) {
+      location_ids.push_back(index + 1);
+    }
+    std::string sample;
+    PutPackedField(&sample, 1, location_ids);
+    PutPackedField(&sample, 2,
+                   {static_cast<uint64_t>(stack.second),
+                    static_cast<uint64_t>(stack.second * period_ns)});
+    PutBytesField(&profile, 2, sample);
+  }
+  // One location and one function per service ProfileFunction.
+  for (size_t i = 0; i < names.size(); ++i) {
+    std::string line;
+    PutVarintField(&line, 1, i + 1);
+    std::string location;
+    PutVarintField(&location, 1, i + 1);
+    PutBytesField(&location, 4, line);
+    PutBytesField(&profile, 4, location);
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    std::string function;
+    PutVarintField(&function, 1, i + 1);
+    PutVarintField(&function, 2, strings.Intern(names[i]));
+    PutVarintField(&function, 4, strings.Intern(urls[i]));
+    PutBytesField(&profile, 5, function);
+  }
+  std::string period_type;
+  PutVarintField(&period_type, 1, strings.Intern("cpu"));
+  PutVarintField(&period_type, 2, strings.Intern("nanoseconds"));
+  for (const std::string& value : strings.strings) {
+    PutBytesField(&profile, 6, value);
+  }
+  const int64_t now_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  PutVarintField(&profile, 9, static_cast<uint64_t>(now_ns));
+  PutVarintField(&profile, 10, static_cast<uint64_t>(duration_ns));
+  PutBytesField(&profile, 11, period_type);
+  PutVarintField(&profile, 12, static_cast<uint64_t>(period_ns));
+  return profile;
+}
+
+DartVmEmbedStatus DartVmEmbed_DumpCpuProfile(Dart_Isolate isolate,
+                                             const char* path,
+                                             DartVmEmbedCpuProfileFormat format,
+                                             bool clear_samples) {
+  ResetThreadStatus();
+  if (isolate == nullptr || path == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_DumpCpuProfile: isolate and path are "
+                       "required.");
+    return t_status.code;
+  }
+  if (format != DARTVM_EMBED_CPU_PROFILE_PPROF &&
+      format != DARTVM_EMBED_CPU_PROFILE_COLLAPSED) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_DumpCpuProfile: unknown format.");
+    return t_status.code;
+  }
+  if (!g_vm_initialized) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_DumpCpuProfile: VM is not initialized.");
+    return t_status.code;
+  }
+  char isolate_service_id[128];
+  if (!ResolveIsolateServiceId(isolate, isolate_service_id,
+                               sizeof(isolate_service_id))) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_DumpCpuProfile: failed to resolve isolate "
+                       "service id.");
+    return t_status.code;
+  }
+
+  char request[256];
+  snprintf(request, sizeof(request),
+           "{\"jsonrpc\":\"2.0\",\"id\":\"cpu\",\"method\":"
+           "\"getCpuSamples\",\"params\":{\"isolateId\":\"%s\","
+           "\"timeOriginMicros\":0,\"timeExtentMicros\":-1}}",
+           isolate_service_id);
+  JsonValue samples;
+  std::string service_error;
+  if (!InvokeVmServiceRequest(request, &samples, &service_error)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED, service_error.c_str());
+    return t_status.code;
+  }
+
+  std::vector<std::string> names;
+  std::vector<std::string> urls;
+  if (const JsonValue* functions = samples.Get("functions")) {
+    for (const JsonValue& function : functions->array) {
+      names.push_back(CpuProfileFunctionName(function));
+      const JsonValue* url = function.Get("resolvedUrl");
+      urls.push_back(url != nullptr ? url->string : std::string());
+    }
+  }
+  // Aggregate identical stacks; the service reports one entry per tick.
+  std::vector<std::pair<std::vector<uint64_t>, int64_t>> stacks;
+  std::unordered_map<std::string, size_t> stack_index;
+  if (const JsonValue* sample_list = samples.Get("samples")) {
+    for (const JsonValue& sample : sample_list->array) {
+      const JsonValue* stack = sample.Get("stack");
+      std::vector<uint64_t> frames;
+      std::string key;
+      if (stack != nullptr) {
+        for (const JsonValue& frame : stack->array) {
+          if (frame.type != JsonValue::kNumber || frame.number < 0 ||
+              frame.number >= static_cast<double>(names.size())) {
+            continue;
+          }
+          const uint64_t index = static_cast<uint64_t>(frame.number);
+          frames.push_back(index);
+          key.append(reinterpret_cast<const char*>(&index), sizeof(index));
+        }
+      }
+      auto it = stack_index.find(key);
+      if (it == stack_index.end()) {
+        it = stack_index.emplace(key, stacks.size()).first;
+        stacks.emplace_back(std::move(frames), 0);
+      }
+      ++stacks[it->second].second;
+    }
+  }
+
+  const JsonValue* period = samples.Get("samplePeriod");
+  const JsonValue* extent = samples.Get("timeExtentMicros");
+  const std::string output =
+      format == DARTVM_EMBED_CPU_PROFILE_COLLAPSED
+          ? EncodeCpuProfileCollapsed(names, stacks)
+          : EncodeCpuProfilePprof(
+                names, urls, stacks,
+                period != nullptr
+                    ? static_cast<int64_t>(period->number) * 1000
+                    : 0,
+                extent != nullptr
+                    ? static_cast<int64_t>(extent->number) * 1000
+                    : 0);
+  if (!ReplaceFileContents(path, output.data(), output.size())) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_IO_ERROR,
+                       "DartVmEmbed_DumpCpuProfile: failed to write profile.");
+    return t_status.code;
+  }
+
+  if (clear_samples) {
+    snprintf(request, sizeof(request),
+             "{\"jsonrpc\":\"2.0\",\"id\":\"clear\",\"method\":"
+             "\"clearCpuSamples\",\"params\":{\"isolateId\":\"%s\"}}",
+             isolate_service_id);
+    JsonValue cleared;
+    if (!InvokeVmServiceRequest(request, &cleared, &service_error)) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED, service_error.c_str());
+      return t_status.code;
+    }
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+void DartVmEmbed_ShutdownIsolate(void) {
+  Dart_Isolate isolate = Dart_CurrentIsolate();
+  if (isolate == nullptr) {
+    return;
+  }
+
+  IsolateRecord record;
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    auto it = g_isolate_records.find(isolate);
+    if (it != g_isolate_records.end()) {
+      record = std::move(it->second);
+      g_isolate_records.erase(it);
     }
+  }
+  // Only records tracked by CreationMetricsScope (which attaches the pump)
+  // were counted as creations; spawned and foreign isolates are not.
+  const bool counted = record.message_pump != nullptr;
+
+  // The record is gone, so OnIsolateShutdown will not find these.
+  DetachPreparedCalls(record.prepared_calls);
+  UnlinkTenantIsolate(record.tenant_link);
+  Dart_ShutdownIsolate();
+  ReleaseMessagePump(isolate);
+
+  if (t_placed_for_isolate == isolate) {
+    t_placed_for_isolate = nullptr;
+  }
+  if (counted) {
+    AddMetric(kMetricIsolateShutdowns, 1);
+  }
+
+  if (record.aot_elf != nullptr) {
+    DartVmEmbed_UnloadAotElf(record.aot_elf);
+  }
+  if (!record.kernel.empty()) {
+    AddMetric(kMetricKernelBufferBytes,
+              -static_cast<int64_t>(record.kernel.size()));
+  }
+  if (record.owned.owns_isolate) {
+    delete record.owned.isolate_data;
+  }
+  if (record.owned.owns_group) {
+    delete record.owned.isolate_group_data;
+  }
+}
 
+DartVmEmbedStatus DartVmEmbed_GetEmbedderStats(
+    DartVmEmbedEmbedderStats* out_stats) {
+  ResetThreadStatus();
+  if (out_stats == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_GetEmbedderStats: out_stats is null.");
+    return t_status.code;
+  }
+  *out_stats = DartVmEmbedEmbedderStats();
+  {
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    out_stats->tracked_isolates =
+        static_cast<int64_t>(g_isolate_records.size());
+    out_stats->callback_owned_isolate_data =
+        static_cast<int64_t>(g_callback_owned_isolate_data.size());
+    out_stats->callback_owned_group_data =
+        static_cast<int64_t>(g_callback_owned_group_data.size());
+    out_stats->group_setup_caches =
+        static_cast<int64_t>(g_group_setup_caches.size());
+    for (const auto& entry : g_isolate_records) {
+      const IsolateRecord& record = entry.second;
+      out_stats->owned_isolates +=
+          record.owned.owns_isolate || record.owned.owns_group;
+      out_stats->kernel_buffers += !record.kernel.empty();
+      out_stats->loaded_aot_elfs += record.aot_elf != nullptr;
+      out_stats->prepared_call_isolates += !record.prepared_calls.empty();
+      out_stats->warmed_isolates += record.service_warmed;
+      out_stats->isolate_placements += record.has_placement;
+      out_stats->message_notify_fds +=
+          record.message_pump != nullptr &&
+          record.message_pump->notify_fd.load(std::memory_order_relaxed) >= 0;
+    }
+    for (const auto& entry : g_group_snapshots) {
+      out_stats->app_jit_snapshots += entry.second.from_app_jit_cache;
+      out_stats->app_snapshots += !entry.second.from_app_jit_cache;
+    }
+  }
+  {
+    std::shared_lock<std::shared_mutex> lock(g_native_ports_mutex);
+    for (const auto& entry : g_native_ports) {
+      out_stats->native_ports += entry.second->owner != nullptr;
+    }
   }
+  // Read after the lock so this call's own acquisition is included.
+  out_stats->lock_acquisitions = g_embedder_maps_mutex.acquisitions();
+  out_stats->lock_contentions = g_embedder_maps_mutex.contentions();
+  out_stats->lock_wait_ns = g_embedder_maps_mutex.wait_ns();
+  return DARTVM_EMBED_STATUS_OK;
 }
 
 void DartVmEmbed_ShutdownIsolateByHandle(Dart_Isolate isolate) {
@@ -1593,4 +6550,432 @@ void DartVmEmbed_ShutdownIsolateByHandle(Dart_Isolate isolate) {
   DartVmEmbed_ShutdownIsolate();
 }
 
+DartVmEmbedStatus DartVmEmbed_ShutdownIsolates(const Dart_Isolate* isolates,
+                                               intptr_t count,
+                                               int worker_count) {
+  ResetThreadStatus();
+  if (count < 0 || (isolates == nullptr && count != 0)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_ShutdownIsolates: invalid isolate list.");
+    return t_status.code;
+  }
+  if (Dart_CurrentIsolate() != nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_ShutdownIsolates: exit the current "
+                       "isolate first.");
+    return t_status.code;
+  }
+
+  std::vector<Dart_Isolate> targets;
+  if (isolates != nullptr) {
+    targets.assign(isolates, isolates + count);
+  } else {
+    // Only isolates the public create functions made, with embedder-owned
+    // isolate data; tenant isolates belong to their manager.
+    std::lock_guard<InstrumentedMutex> lock(g_embedder_maps_mutex);
+    targets.reserve(g_isolate_records.size());
+    for (const auto& entry : g_isolate_records) {
+      const IsolateRecord& record = entry.second;
+      if ((record.owned.owns_isolate || record.owned.owns_group) &&
+          record.tenant_link == nullptr) {
+        targets.push_back(entry.first);
+      }
+    }
+  }
+  targets.erase(std::remove(targets.begin(), targets.end(), nullptr),
+                targets.end());
+
+  size_t workers = worker_count > 0
+                       ? static_cast<size_t>(worker_count)
+                       : static_cast<size_t>(std::thread::hardware_concurrency());
+  workers = std::max<size_t>(1, std::min(workers, targets.size()));
+
+  // Each root isolate is its own group, so groups tear down independently.
+  std::atomic<size_t> next{0};
+  auto drain = [&targets, &next]() {
+    for (size_t i = next.fetch_add(1, std::memory_order_relaxed);
+         i < targets.size();
+         i = next.fetch_add(1, std::memory_order_relaxed)) {
+      DartVmEmbed_ShutdownIsolateByHandle(targets[i]);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(workers - 1);
+  for (size_t i = 1; i < workers; ++i) {
+    threads.emplace_back(drain);
+  }
+  drain();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+void DartVmEmbed_FastExit(int exit_code) {
+  // Only user-space buffers need flushing; isolate heaps, mappings and
+  // embedder state go away with the process.
+  fflush(nullptr);
+  _exit(exit_code);
+}
+
+DartVmEmbedStatus DartVmEmbed_StartServiceIsolate(void) {
+  ResetThreadStatus();
+  if (!g_vm_initialized) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_StartServiceIsolate: VM is not "
+                       "initialized.");
+    return t_status.code;
+  }
+  if (!g_service_isolate_enabled) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_StartServiceIsolate: the service isolate "
+                       "is disabled.");
+    return t_status.code;
+  }
+  OpenServiceIsolateGate();
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_PrestartKernelService(void) {
+  ResetThreadStatus();
+#if defined(DARTVM_EMBED_DEFAULT_PRECOMPILATION_FLAG)
+  RecordThreadStatus(DARTVM_EMBED_STATUS_UNSUPPORTED,
+                     "DartVmEmbed_PrestartKernelService is unavailable in "
+                     "precompiled runtime.");
+  return t_status.code;
+#else
+  if (!g_vm_initialized) {
+    RecordThreadStatus(
+        DARTVM_EMBED_STATUS_FAILED,
+        "DartVmEmbed_PrestartKernelService: VM is not initialized.");
+    return t_status.code;
+  }
+  if (g_kernel_service.mode.load(std::memory_order_acquire) ==
+      kKernelServiceDisabled) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_UNSUPPORTED,
+                       "DartVmEmbed_PrestartKernelService: kernel isolate is "
+                       "disabled (start_kernel_isolate=false).");
+    return t_status.code;
+  }
+  if (!EnsureKernelServiceStarted()) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_PrestartKernelService: failed to start "
+                       "the kernel isolate.");
+    return t_status.code;
+  }
+  return DARTVM_EMBED_STATUS_OK;
+#endif
+}
+
+DartVmEmbedStatus DartVmEmbed_GetKernelServiceStats(
+    DartVmEmbedKernelServiceStats* out_stats) {
+  ResetThreadStatus();
+  if (out_stats == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_GetKernelServiceStats: out_stats is null.");
+    return t_status.code;
+  }
+  *out_stats = DartVmEmbedKernelServiceStats();
+  if (!g_vm_initialized) {
+    return DARTVM_EMBED_STATUS_OK;
+  }
+  out_stats->lazy = g_kernel_service.lazy;
+  switch (g_kernel_service.mode.load(std::memory_order_acquire)) {
+    case kKernelServiceLazy:
+      out_stats->state = DARTVM_EMBED_KERNEL_SERVICE_NOT_STARTED;
+      break;
+    case kKernelServiceStarted:
+      out_stats->state = Dart_KernelIsolateIsRunning()
+                             ? DARTVM_EMBED_KERNEL_SERVICE_RUNNING
+                             : DARTVM_EMBED_KERNEL_SERVICE_STARTING;
+      break;
+    default:
+      return DARTVM_EMBED_STATUS_OK;
+  }
+  const int64_t initialized =
+      g_kernel_service.initialized_ns.load(std::memory_order_relaxed);
+  const int64_t requested =
+      g_kernel_service.requested_ns.load(std::memory_order_relaxed);
+  const int64_t ready = g_kernel_service.ready_ns.load(std::memory_order_relaxed);
+  if (requested >= 0) {
+    out_stats->start_requested_ns = requested - initialized;
+    if (ready >= 0) {
+      out_stats->startup_ns = ready - requested;
+    }
+  }
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+// Seeds tried per bucket before the table is rebuilt with more slots.
+static const uint32_t kFfiNativeMaxSeeds = 1u << 16;
+static const int kFfiNativeMaxTableAttempts = 8;
+
+// Places every bucket into |slot_count| slots, largest buckets first while
+// most slots are still free; each takes the first seed that sends all of its
+// names to distinct free slots. Fails when a bucket exhausts the seed cap.
+static bool BuildFfiNativeTable(const DartVmEmbedFfiNative* natives,
+                                const std::vector<uint64_t>& hashes,
+                                const std::vector<std::vector<size_t>>& buckets,
+                                const std::vector<size_t>& order,
+                                size_t slot_count,
+                                FfiNativeTable* out_table) {
+  FfiNativeTable table;
+  table.seeds.assign(buckets.size(), 0);
+  table.slots.resize(slot_count);
+  std::vector<bool> used(slot_count, false);
+  std::vector<size_t> positions;
+  for (size_t bucket : order) {
+    if (buckets[bucket].empty()) {
+      break;
+    }
+    uint32_t seed = 1;
+    for (; seed <= kFfiNativeMaxSeeds; ++seed) {
+      positions.clear();
+      bool fits = true;
+      for (size_t entry : buckets[bucket]) {
+        const size_t slot =
+            FfiNativeSeededHash(hashes[entry], seed) % slot_count;
+        if (used[slot] || std::find(positions.begin(), positions.end(),
+                                    slot) != positions.end()) {
+          fits = false;
+          break;
+        }
+        positions.push_back(slot);
+      }
+      if (fits) {
+        break;
+      }
+    }
+    if (seed > kFfiNativeMaxSeeds) {
+      return false;
+    }
+    table.seeds[bucket] = seed;
+    for (size_t i = 0; i < positions.size(); ++i) {
+      const DartVmEmbedFfiNative& native = natives[buckets[bucket][i]];
+      used[positions[i]] = true;
+      table.slots[positions[i]] =
+          FfiNativeSlot{native.name, native.function, native.args_n};
+    }
+  }
+  *out_table = std::move(table);
+  return true;
+}
+
+DartVmEmbedStatus DartVmEmbed_RegisterFfiNatives(
+    const DartVmEmbedFfiNative* natives,
+    intptr_t count) {
+  ResetThreadStatus();
+  if (count < 0 || (count > 0 && natives == nullptr)) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_RegisterFfiNatives: invalid argument.");
+    return t_status.code;
+  }
+  if (g_vm_initialized) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_RegisterFfiNatives: register natives "
+                       "before the VM is initialized.");
+    return t_status.code;
+  }
+  std::unordered_set<std::string> names;
+  for (intptr_t i = 0; i < count; ++i) {
+    if (natives[i].name == nullptr || natives[i].function == nullptr ||
+        !names.insert(natives[i].name).second) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                         "DartVmEmbed_RegisterFfiNatives: entries need a "
+                         "unique name and a function.");
+      return t_status.code;
+    }
+  }
+
+  FfiNativeTable table;
+  if (count > 0) {
+    const size_t size = static_cast<size_t>(count);
+    std::vector<uint64_t> hashes(size);
+    std::vector<std::vector<size_t>> buckets(size);
+    for (size_t i = 0; i < size; ++i) {
+      hashes[i] = FfiNativeNameHash(natives[i].name);
+      buckets[FfiNativeSeededHash(hashes[i], 0) % size].push_back(i);
+    }
+    std::vector<size_t> order(size);
+    for (size_t i = 0; i < size; ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return buckets[a].size() > buckets[b].size();
+    });
+
+    // Starts minimal; a bucket that finds no seed within the cap retries the
+    // whole table with more slots, which makes free slots easy to hit.
+    size_t slot_count = size;
+    bool built = false;
+    for (int attempt = 0; attempt < kFfiNativeMaxTableAttempts && !built;
+         ++attempt) {
+      built = BuildFfiNativeTable(natives, hashes, buckets, order, slot_count,
+                                  &table);
+      slot_count += slot_count / 2 + 1;
+    }
+    if (!built) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                         "DartVmEmbed_RegisterFfiNatives: could not build "
+                         "the symbol hash.");
+      return t_status.code;
+    }
+  }
+  g_ffi_natives = std::move(table);
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_NewNativePort(
+    Dart_Isolate owner,
+    const DartVmEmbedNativePortConfig* config,
+    int64_t* out_port) {
+  ResetThreadStatus();
+  if (out_port != nullptr) {
+    *out_port = ILLEGAL_PORT;
+  }
+  if (config == nullptr || config->handler == nullptr ||
+      out_port == nullptr ||
+      (config->concurrency != DARTVM_EMBED_NATIVE_PORT_SERIAL &&
+       config->threads < 1) ||
+      config->concurrency < DARTVM_EMBED_NATIVE_PORT_SERIAL ||
+      config->concurrency > DARTVM_EMBED_NATIVE_PORT_KEYED) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_NewNativePort: invalid argument.");
+    return t_status.code;
+  }
+  if (!g_vm_initialized) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_NewNativePort: VM is not initialized.");
+    return t_status.code;
+  }
+
+  auto port = std::make_shared<NativePort>();
+  if (config->name != nullptr) {
+    port->name = config->name;
+  }
+  port->owner = owner;
+  port->handler = config->handler;
+  port->user_data = config->user_data;
+  port->key = config->key;
+  port->keyed = config->concurrency == DARTVM_EMBED_NATIVE_PORT_KEYED;
+  const int threads = config->concurrency == DARTVM_EMBED_NATIVE_PORT_SERIAL
+                          ? 1
+                          : config->threads;
+  // Built in place: a lane's deque has no noexcept move to resize with.
+  port->lanes = std::vector<NativePortLane>(port->keyed ? threads : 1);
+  if (!port->keyed) {
+    port->lanes[0].max_active = threads;
+  }
+
+  port->id = Dart_NewNativePort(
+      port->name.empty() ? "dartvm_embed_native_port" : port->name.c_str(),
+      NativePortDispatch, /*handle_concurrently=*/false);
+  if (port->id == ILLEGAL_PORT) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                       "DartVmEmbed_NewNativePort: Dart_NewNativePort "
+                       "failed.");
+    return t_status.code;
+  }
+  StartNativePortPool();
+
+  // The owner is checked under both locks: DartVmEmbed_ShutdownIsolate
+  // erases its record before the shutdown callback closes its ports, so a
+  // port registered here is either rejected or closed by that callback.
+  const char* reject = nullptr;
+  {
+    std::unique_lock<InstrumentedMutex> records_lock(g_embedder_maps_mutex,
+                                                     std::defer_lock);
+    if (owner != nullptr) {
+      records_lock.lock();
+    }
+    std::unique_lock<std::shared_mutex> lock(g_native_ports_mutex);
+    if (owner != nullptr && g_isolate_records.count(owner) == 0) {
+      reject = "DartVmEmbed_NewNativePort: owner was not created through "
+               "the embedder.";
+    } else if (!port->name.empty() &&
+               !g_native_port_names.emplace(port->name, port->id).second) {
+      reject = "DartVmEmbed_NewNativePort: a port with this name is already "
+               "open.";
+    } else {
+      g_native_ports.emplace(port->id, port);
+    }
+  }
+  if (reject != nullptr) {
+    CloseNativePortRecord(port);
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT, reject);
+    return t_status.code;
+  }
+  *out_port = port->id;
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+DartVmEmbedStatus DartVmEmbed_CloseNativePort(int64_t port_id) {
+  ResetThreadStatus();
+  std::shared_ptr<NativePort> port;
+  {
+    std::unique_lock<std::shared_mutex> lock(g_native_ports_mutex);
+    auto it = g_native_ports.find(port_id);
+    if (it == g_native_ports.end()) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                         "DartVmEmbed_CloseNativePort: unknown port.");
+      return t_status.code;
+    }
+    if (t_native_port_worker == it->second.get()) {
+      RecordThreadStatus(DARTVM_EMBED_STATUS_FAILED,
+                         "DartVmEmbed_CloseNativePort: a port cannot be "
+                         "closed from its own handler.");
+      return t_status.code;
+    }
+    port = std::move(it->second);
+    g_native_ports.erase(it);
+    if (!port->name.empty()) {
+      g_native_port_names.erase(port->name);
+    }
+  }
+  CloseNativePortRecord(port);
+  return DARTVM_EMBED_STATUS_OK;
+}
+
+int64_t DartVmEmbed_LookupNativePort(const char* name) {
+  if (name == nullptr) {
+    return ILLEGAL_PORT;
+  }
+  std::shared_lock<std::shared_mutex> lock(g_native_ports_mutex);
+  auto it = g_native_port_names.find(name);
+  return it != g_native_port_names.end() ? it->second : ILLEGAL_PORT;
+}
+
+Dart_Handle DartVmEmbed_LookupNativeSendPort(const char* name) {
+  const int64_t port = DartVmEmbed_LookupNativePort(name);
+  return port != ILLEGAL_PORT ? Dart_NewSendPort(port) : Dart_Null();
+}
+
+DartVmEmbedStatus DartVmEmbed_GetNativePortStats(
+    int64_t port_id,
+    DartVmEmbedNativePortStats* out_stats) {
+  ResetThreadStatus();
+  if (out_stats == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_GetNativePortStats: out_stats is null.");
+    return t_status.code;
+  }
+  *out_stats = DartVmEmbedNativePortStats();
+  std::shared_ptr<NativePort> port;
+  {
+    std::shared_lock<std::shared_mutex> lock(g_native_ports_mutex);
+    auto it = g_native_ports.find(port_id);
+    if (it != g_native_ports.end()) {
+      port = it->second;
+    }
+  }
+  if (port == nullptr) {
+    RecordThreadStatus(DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                       "DartVmEmbed_GetNativePortStats: unknown port.");
+    return t_status.code;
+  }
+  std::lock_guard<std::mutex> lock(port->mutex);
+  *out_stats = port->stats;
+  return DARTVM_EMBED_STATUS_OK;
+}
+
 }  // extern "C"
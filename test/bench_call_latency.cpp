@@ -0,0 +1,124 @@
+// Host->Dart call latency benchmark.
+//
+// Compares, per call:
+// - run_root_entry: DartVmEmbed_RunRootEntryOnIsolate (name lookup,
+//   _startMainIsolate dispatch and message loop on every call)
+// - lookup_invoke: DartVmEmbed_InvokeBatch with one call per batch
+//   (isolate/scope entry plus string-based Dart_Invoke on every call)
+// - prepared: DartVmEmbed_InvokePrepared (resolved once)
+// - batch: DartVmEmbed_InvokeBatch with all calls in one batch
+//
+// Usage: dartvm_embed_lib_bench_call_latency [kernel.dill] [iterations]
+
+#include "dartvm_embed_lib.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void Report(const char* name, Clock::time_point start, int64_t iterations) {
+  const auto elapsed =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+  std::cout << name << ": "
+            << static_cast<double>(elapsed.count()) / iterations
+            << " ns/call\n";
+}
+
+bool Check(DartVmEmbedStatus status, const char* what) {
+  if (status != DARTVM_EMBED_STATUS_OK) {
+    std::cerr << what << " failed: " << DartVmEmbed_LastErrorMessage() << "\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* kernel_path =
+      argc > 1 ? argv[1] : DARTVM_EMBED_BENCH_CALL_LATENCY_KERNEL;
+  const int64_t iterations = argc > 2 ? atoll(argv[2]) : 100000;
+  if (iterations <= 0) {
+    std::cerr << "iterations must be positive\n";
+    return 1;
+  }
+
+  Dart_Isolate isolate = nullptr;
+  if (!Check(DartVmEmbed_CreateIsolateFromProgramFileEx(
+                 kernel_path, nullptr, nullptr, nullptr, &isolate),
+             "CreateIsolateFromProgramFileEx")) {
+    return 1;
+  }
+
+  DartVmEmbedValue args[2];
+  args[0].type = DARTVM_EMBED_VALUE_INT64;
+  args[0].as_int64 = 1;
+  args[1].type = DARTVM_EMBED_VALUE_INT64;
+  args[1].as_int64 = 2;
+  DartVmEmbedValue result;
+
+  // The run_root_entry path drains the message loop per call, so it gets a
+  // smaller iteration count.
+  const int64_t entry_iterations = iterations / 100 > 0 ? iterations / 100 : 1;
+  auto start = Clock::now();
+  for (int64_t i = 0; i < entry_iterations; ++i) {
+    if (!Check(DartVmEmbed_RunRootEntryOnIsolateEx(isolate, "noop"),
+               "RunRootEntryOnIsolateEx")) {
+      return 1;
+    }
+  }
+  Report("run_root_entry", start, entry_iterations);
+
+  start = Clock::now();
+  for (int64_t i = 0; i < iterations; ++i) {
+    if (!Check(DartVmEmbed_InvokeBatch(isolate, "add", args, 2, 1, &result, 0,
+                                       nullptr),
+               "InvokeBatch")) {
+      return 1;
+    }
+  }
+  Report("lookup_invoke", start, iterations);
+
+  DartVmEmbedPreparedCall* call = nullptr;
+  if (!Check(DartVmEmbed_PrepareCall(isolate, nullptr, "add", &call),
+             "PrepareCall")) {
+    return 1;
+  }
+  start = Clock::now();
+  for (int64_t i = 0; i < iterations; ++i) {
+    if (!Check(DartVmEmbed_InvokePrepared(call, args, 2, &result),
+               "InvokePrepared")) {
+      return 1;
+    }
+  }
+  Report("prepared", start, iterations);
+
+  std::vector<DartVmEmbedValue> batch_args(static_cast<size_t>(iterations) * 2);
+  for (size_t i = 0; i < batch_args.size(); ++i) {
+    batch_args[i] = args[i % 2];
+  }
+  std::vector<DartVmEmbedValue> batch_results(static_cast<size_t>(iterations));
+  start = Clock::now();
+  if (!Check(DartVmEmbed_InvokeBatch(isolate, "add", batch_args.data(), 2,
+                                     iterations, batch_results.data(), 0,
+                                     nullptr),
+             "InvokeBatch")) {
+    return 1;
+  }
+  Report("batch", start, iterations);
+
+  DartVmEmbed_ReleasePreparedCall(call);
+  DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  char* error = nullptr;
+  if (!DartVmEmbed_Cleanup(&error)) {
+    std::cerr << "Cleanup failed: " << (error != nullptr ? error : "") << "\n";
+    free(error);
+    return 1;
+  }
+  return 0;
+}
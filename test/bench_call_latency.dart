@@ -0,0 +1,9 @@
+// Entry points exercised by bench_call_latency.cpp.
+
+@pragma('vm:entry-point')
+int add(int a, int b) => a + b;
+
+@pragma('vm:entry-point')
+void noop() {}
+
+void main() {}
@@ -0,0 +1,77 @@
+// Entry points exercised by test_embed_api_live_jit.cpp.
+
+import 'dart:isolate';
+
+int fib(int n) => n < 2 ? n : fib(n - 1) + fib(n - 2);
+
+int add(int a, int b) => a + b;
+
+double scale(int x, double factor) => x * factor;
+
+bool isEven(int x) => x.isEven;
+
+final int answer = 42;
+
+final List<List<int>> _retained = <List<int>>[];
+
+// Allocates about 5MB and keeps a tenth of it reachable.
+int allocate() {
+  var total = 0;
+  for (var i = 0; i < 10000; i++) {
+    final list = List<int>.filled(64, i);
+    total += list.length;
+    if (i % 10 == 0) {
+      _retained.add(list);
+    }
+  }
+  return total;
+}
+
+// Runs Dart code for about ms milliseconds.
+int burn(int ms) {
+  final watch = Stopwatch()..start();
+  var n = 0;
+  while (watch.elapsedMilliseconds < ms) {
+    n += fib(15);
+  }
+  return n;
+}
+
+// Keeps the message loop running until the host posts to the returned port.
+int openPort() {
+  late final RawReceivePort port;
+  port = RawReceivePort((_) => port.close());
+  return port.sendPort.nativePort;
+}
+
+var received = 0;
+var receivedTotal = 0;
+
+// Counts and sums the ints the host posts to the returned port.
+int openCounter() {
+  final port = RawReceivePort((Object? message) {
+    received++;
+    receivedTotal += message as int;
+  });
+  return port.sendPort.nativePort;
+}
+
+int receivedCount() => received;
+
+int receivedSum() => receivedTotal;
+
+// Never returns; only a deadline kill ends it.
+void spin() {
+  var n = 0;
+  while (true) {
+    n = fib(10) + n % 7;
+  }
+}
+
+// Short enough for every test that runs it; enough work to give an AppJIT
+// training run something to compile.
+void main() {
+  if (fib(20) != 6765) {
+    throw StateError('fib');
+  }
+}
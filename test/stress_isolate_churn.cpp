@@ -0,0 +1,356 @@
+// Isolate churn stress harness.
+//
+// Runs create -> run main -> shutdown cycles from many host threads, rotating
+// through the creation APIs, and reports per thread count:
+// - throughput (cycles/s overall and per thread)
+// - embedder lock acquisitions, contended acquisitions and wait time
+// - RSS growth over the phase
+// - embedder map entries left behind once every isolate is shut down
+//
+// Usage: dartvm_embed_lib_stress_churn [--kernel=path.dill] [--source=path.dart]
+//            [--cycles=N] [--threads=1,2,4,8] [--apis=kernel,file,buffer,...]
+//
+// --cycles is per thread count (default 100000; pass millions for soak runs).
+// APIs: kernel, file, buffer, jit_cache, source. Exits non-zero on any
+// failure or leaked map entry.
+
+#include "dartvm_embed_lib.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Api { kKernel, kFile, kBuffer, kJitCache, kSource };
+
+struct Options {
+  std::string kernel_path = DARTVM_EMBED_STRESS_CHURN_KERNEL;
+  std::string source_path = DARTVM_EMBED_STRESS_CHURN_SOURCE;
+  int64_t cycles = 100000;
+  std::vector<int> thread_counts;
+  std::vector<Api> apis;
+};
+
+struct Program {
+  std::vector<uint8_t> kernel;
+  std::string cache_dir;
+};
+
+std::vector<std::string> Split(const std::string& list) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  while (start <= list.size()) {
+    const size_t comma = list.find(',', start);
+    const size_t end = comma == std::string::npos ? list.size() : comma;
+    if (end > start) {
+      parts.push_back(list.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return parts;
+}
+
+bool ParseApi(const std::string& name, Api* out) {
+  static const struct {
+    const char* name;
+    Api api;
+  } kApis[] = {{"kernel", Api::kKernel},
+               {"file", Api::kFile},
+               {"buffer", Api::kBuffer},
+               {"jit_cache", Api::kJitCache},
+               {"source", Api::kSource}};
+  for (const auto& entry : kApis) {
+    if (name == entry.name) {
+      *out = entry.api;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  std::string threads;
+  std::string apis = "kernel,file,buffer,jit_cache,source";
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t eq = arg.find('=');
+    const std::string key = arg.substr(0, eq);
+    const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (key == "--kernel") {
+      options->kernel_path = value;
+    } else if (key == "--source") {
+      options->source_path = value;
+    } else if (key == "--cycles") {
+      options->cycles = atoll(value.c_str());
+    } else if (key == "--threads") {
+      threads = value;
+    } else if (key == "--apis") {
+      apis = value;
+    } else {
+      std::cerr << "unknown option " << arg << "\n";
+      return false;
+    }
+  }
+  if (options->cycles <= 0) {
+    std::cerr << "--cycles must be positive\n";
+    return false;
+  }
+  if (threads.empty()) {
+    const int cpus = static_cast<int>(std::thread::hardware_concurrency());
+    for (int count = 1; count < cpus; count *= 2) {
+      options->thread_counts.push_back(count);
+    }
+    options->thread_counts.push_back(cpus > 0 ? cpus : 1);
+  } else {
+    for (const std::string& count : Split(threads)) {
+      const int value = atoi(count.c_str());
+      if (value <= 0) {
+        std::cerr << "bad thread count " << count << "\n";
+        return false;
+      }
+      options->thread_counts.push_back(value);
+    }
+  }
+  for (const std::string& name : Split(apis)) {
+    Api api;
+    if (!ParseApi(name, &api)) {
+      std::cerr << "unknown api " << name << "\n";
+      return false;
+    }
+    options->apis.push_back(api);
+  }
+  return !options->apis.empty();
+}
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>* out) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  uint8_t buffer[64 * 1024];
+  size_t n = 0;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    out->insert(out->end(), buffer, buffer + n);
+  }
+  fclose(file);
+  return !out->empty();
+}
+
+int64_t RssBytes() {
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr) {
+    return 0;
+  }
+  long long pages = 0;
+  long long resident = 0;
+  const int read = fscanf(statm, "%lld %lld", &pages, &resident);
+  fclose(statm);
+  return read == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+DartVmEmbedEmbedderStats EmbedderStats() {
+  DartVmEmbedEmbedderStats stats;
+  DartVmEmbed_GetEmbedderStats(&stats);
+  return stats;
+}
+
+Dart_Isolate Create(Api api,
+                    const Options& options,
+                    const Program& program,
+                    char** error) {
+  const char* uri = options.kernel_path.c_str();
+  switch (api) {
+    case Api::kKernel:
+      return DartVmEmbed_CreateIsolateFromKernel(
+          uri, "churn", program.kernel.data(),
+          static_cast<intptr_t>(program.kernel.size()), nullptr, nullptr,
+          error);
+    case Api::kFile:
+      return DartVmEmbed_CreateIsolateFromProgramFile(uri, nullptr, nullptr,
+                                                      nullptr, error);
+    case Api::kBuffer:
+      return DartVmEmbed_CreateIsolateFromProgramBuffer(
+          program.kernel.data(), static_cast<intptr_t>(program.kernel.size()),
+          uri, nullptr, nullptr, error);
+    case Api::kJitCache:
+      return DartVmEmbed_CreateIsolateFromAppJitCache(
+          program.cache_dir.c_str(), uri, "churn", program.kernel.data(),
+          static_cast<intptr_t>(program.kernel.size()), nullptr, nullptr,
+          nullptr, error);
+    case Api::kSource:
+      return DartVmEmbed_CreateIsolateFromSource(
+          options.source_path.c_str(), options.source_path.c_str(), "churn",
+          nullptr, nullptr, error);
+  }
+  return nullptr;
+}
+
+// Populates the AppJIT cache so jit_cache cycles measure the hit path.
+void WarmJitCache(const Options& options, const Program& program) {
+  char* error = nullptr;
+  Dart_Isolate isolate = Create(Api::kJitCache, options, program, &error);
+  if (isolate != nullptr &&
+      DartVmEmbed_RunRootEntryOnIsolateEx(isolate, "main") ==
+          DARTVM_EMBED_STATUS_OK &&
+      !DartVmEmbed_SaveAppJitSnapshot(isolate, program.cache_dir.c_str(),
+                                      &error)) {
+    std::cerr << "warning: AppJIT cache not populated: "
+              << (error != nullptr ? error : "") << "\n";
+  }
+  free(error);
+  DartVmEmbed_ShutdownIsolateByHandle(isolate);
+}
+
+bool RunPhase(int thread_count, const Options& options, const Program& program) {
+  const DartVmEmbedEmbedderStats before = EmbedderStats();
+  const int64_t rss_before = RssBytes();
+  std::atomic<int64_t> next_cycle{0};
+  std::atomic<bool> failed{false};
+  std::vector<int64_t> per_thread(thread_count, 0);
+
+  const auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&, t]() {
+      int64_t cycle = 0;
+      while (!failed.load(std::memory_order_relaxed) &&
+             (cycle = next_cycle.fetch_add(1)) < options.cycles) {
+        const Api api = options.apis[cycle % options.apis.size()];
+        char* error = nullptr;
+        Dart_Isolate isolate = Create(api, options, program, &error);
+        if (isolate == nullptr) {
+          std::cerr << "create failed: " << (error != nullptr ? error : "")
+                    << "\n";
+          free(error);
+          failed = true;
+          return;
+        }
+        if (DartVmEmbed_RunRootEntryOnIsolateEx(isolate, "main") !=
+            DARTVM_EMBED_STATUS_OK) {
+          std::cerr << "run failed: " << DartVmEmbed_LastErrorMessage()
+                    << "\n";
+          failed = true;
+        }
+        DartVmEmbed_ShutdownIsolateByHandle(isolate);
+        ++per_thread[t];
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  const DartVmEmbedEmbedderStats after = EmbedderStats();
+  const int64_t rss_after = RssBytes();
+  int64_t completed = 0;
+  for (int64_t count : per_thread) {
+    completed += count;
+  }
+
+  printf("threads=%d cycles=%lld seconds=%.3f cycles_per_sec=%.1f "
+         "per_thread_cycles_per_sec=%.1f\n",
+         thread_count, static_cast<long long>(completed), seconds,
+         completed / seconds, completed / seconds / thread_count);
+  printf("  lock acquisitions=%lld contended=%lld wait_ms=%.3f\n",
+         static_cast<long long>(after.lock_acquisitions -
+                                before.lock_acquisitions),
+         static_cast<long long>(after.lock_contentions -
+                                before.lock_contentions),
+         (after.lock_wait_ns - before.lock_wait_ns) / 1e6);
+  printf("  rss_growth_mb=%.2f\n", (rss_after - rss_before) / 1048576.0);
+
+  const struct {
+    const char* name;
+    int64_t before;
+    int64_t after;
+  } maps[] = {
+      {"tracked_isolates", before.tracked_isolates, after.tracked_isolates},
+      {"owned_isolates", before.owned_isolates, after.owned_isolates},
+      {"callback_owned_isolate_data", before.callback_owned_isolate_data,
+       after.callback_owned_isolate_data},
+      {"callback_owned_group_data", before.callback_owned_group_data,
+       after.callback_owned_group_data},
+      {"group_setup_caches", before.group_setup_caches,
+       after.group_setup_caches},
+      {"kernel_buffers", before.kernel_buffers, after.kernel_buffers},
+      {"loaded_aot_elfs", before.loaded_aot_elfs, after.loaded_aot_elfs},
+      {"app_jit_snapshots", before.app_jit_snapshots, after.app_jit_snapshots},
+      {"app_snapshots", before.app_snapshots, after.app_snapshots},
+      {"prepared_call_isolates", before.prepared_call_isolates,
+       after.prepared_call_isolates},
+      {"warmed_isolates", before.warmed_isolates, after.warmed_isolates},
+      {"isolate_placements", before.isolate_placements,
+       after.isolate_placements},
+      {"message_notify_fds", before.message_notify_fds,
+       after.message_notify_fds},
+      {"native_ports", before.native_ports, after.native_ports},
+  };
+  bool leaked = false;
+  for (const auto& map : maps) {
+    if (map.after != map.before) {
+      printf("  LEAK %s: %lld -> %lld\n", map.name,
+             static_cast<long long>(map.before),
+             static_cast<long long>(map.after));
+      leaked = true;
+    }
+  }
+  fflush(stdout);
+  return !failed && !leaked;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    return 2;
+  }
+  Program program;
+  if (!ReadFile(options.kernel_path, &program.kernel)) {
+    std::cerr << "failed to read " << options.kernel_path << "\n";
+    return 1;
+  }
+  char cache_dir[] = "/tmp/dartvm_embed_churn_XXXXXX";
+  if (mkdtemp(cache_dir) == nullptr) {
+    std::cerr << "mkdtemp failed\n";
+    return 1;
+  }
+  program.cache_dir = cache_dir;
+
+  DartVmEmbedInitConfig config;
+  char* error = nullptr;
+  if (!DartVmEmbed_Initialize(&config, &error)) {
+    std::cerr << "Initialize failed: " << (error != nullptr ? error : "")
+              << "\n";
+    free(error);
+    return 1;
+  }
+  WarmJitCache(options, program);
+
+  bool ok = true;
+  for (int thread_count : options.thread_counts) {
+    ok = RunPhase(thread_count, options, program) && ok;
+  }
+
+  std::error_code ignored;
+  std::filesystem::remove_all(program.cache_dir, ignored);
+  if (!DartVmEmbed_Cleanup(&error)) {
+    std::cerr << "Cleanup failed: " << (error != nullptr ? error : "") << "\n";
+    free(error);
+    return 1;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+// Entry point for the isolate churn stress harness: a little work so each
+// cycle actually runs Dart code, nothing that outlives main.
+void main() {
+  var sum = 0;
+  for (var i = 0; i < 100; i++) {
+    sum += i;
+  }
+  if (sum < 0) {
+    print(sum);
+  }
+}
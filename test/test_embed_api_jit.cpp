@@ -1,8 +1,19 @@
 #include "dartvm_embed_lib.h"
+#include "dartvm_embed_cobject.h"
 
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
+#include <cstdio>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 namespace {
 
@@ -101,6 +112,978 @@ bool TestLoadAotInJitFlavor() {
   return pass;
 }
 
+bool TestAppJitCacheValidation() {
+  char* error = nullptr;
+  const bool saved = DartVmEmbed_SaveAppJitSnapshot(nullptr, "/tmp", &error);
+  const bool save_pass =
+      Expect(!saved, "SaveAppJitSnapshot(nullptr) should fail") &&
+      Expect(ContainsText(error, "invalid argument"),
+             "SaveAppJitSnapshot error should mention invalid argument");
+  free(error);
+
+  error = nullptr;
+  bool cache_hit = true;
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromAppJitCache(
+      nullptr, "main.dart", "main", nullptr, 0, nullptr, nullptr, &cache_hit,
+      &error);
+  const bool load_pass =
+      Expect(isolate == nullptr,
+             "CreateIsolateFromAppJitCache(nullptr) should fail") &&
+      Expect(!cache_hit, "CreateIsolateFromAppJitCache failure is not a hit") &&
+      Expect(ContainsText(error, "invalid argument"),
+             "CreateIsolateFromAppJitCache error should mention invalid argument");
+  free(error);
+
+  return save_pass && load_pass;
+}
+
+bool TestProgramBufferValidation() {
+  char* error = nullptr;
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromProgramBuffer(
+      nullptr, 0, "main.dart", nullptr, nullptr, &error);
+  const bool buffer_pass =
+      Expect(isolate == nullptr,
+             "CreateIsolateFromProgramBuffer(nullptr) should fail") &&
+      Expect(ContainsText(error, "invalid argument"),
+             "CreateIsolateFromProgramBuffer error should mention invalid argument");
+  free(error);
+
+  // AppJIT snapshot header: magic number followed by four blob sizes.
+  const uint8_t app_jit_bytes[40] = {0xdc, 0xdc, 0xf6, 0xf6};
+  error = nullptr;
+  isolate = DartVmEmbed_CreateIsolateFromProgramBuffer(
+      app_jit_bytes, sizeof(app_jit_bytes), "main.dart", nullptr, nullptr,
+      &error);
+  const bool app_jit_pass =
+      Expect(isolate == nullptr,
+             "CreateIsolateFromProgramBuffer should reject AppJIT bytes") &&
+      Expect(ContainsText(error, "AppJIT snapshots need executable mappings"),
+             "CreateIsolateFromProgramBuffer should detect AppJIT bytes");
+  free(error);
+
+  const uint8_t elf_bytes[] = {0x7f, 'E', 'L', 'F'};
+  DartVmEmbedAotElfHandle handle = nullptr;
+  const uint8_t* vm_data = nullptr;
+  const uint8_t* vm_instr = nullptr;
+  const uint8_t* iso_data = nullptr;
+  const uint8_t* iso_instr = nullptr;
+  error = nullptr;
+  const bool ok = DartVmEmbed_LoadAotElfFromMemory(
+      elf_bytes, sizeof(elf_bytes), &handle, &vm_data, &vm_instr, &iso_data,
+      &iso_instr, &error);
+  const bool elf_pass =
+      Expect(!ok, "LoadAotElfFromMemory should fail in jit flavor") &&
+      Expect(handle == nullptr,
+             "LoadAotElfFromMemory failure should keep handle null") &&
+      Expect(ContainsText(error, "only available in AOT runtime flavor"),
+             "LoadAotElfFromMemory jit error should mention AOT only");
+  free(error);
+  return buffer_pass && app_jit_pass && elf_pass;
+}
+
+bool TestStatusApiValidation() {
+  Dart_Isolate isolate = reinterpret_cast<Dart_Isolate>(0x1);
+  DartVmEmbedStatus status = DartVmEmbed_CreateIsolateFromProgramFileEx(
+      nullptr, nullptr, nullptr, nullptr, &isolate);
+  const bool null_path_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "ProgramFileEx(nullptr) should report invalid argument") &&
+      Expect(isolate == nullptr, "ProgramFileEx failure should clear isolate") &&
+      Expect(DartVmEmbed_LastStatus() == status,
+             "LastStatus should match the returned status") &&
+      Expect(ContainsText(DartVmEmbed_LastErrorMessage(), "program_path is null"),
+             "LastErrorMessage should mention null program_path");
+
+  status = DartVmEmbed_CreateIsolateFromProgramFileEx(
+      "/nonexistent/dartvm_embed_missing.dill", nullptr, nullptr, nullptr,
+      &isolate);
+  const bool missing_pass =
+      Expect(status == DARTVM_EMBED_STATUS_IO_ERROR,
+             "ProgramFileEx(missing) should report an i/o error");
+
+  status = DartVmEmbed_RunLoopOnIsolateEx(nullptr);
+  const bool loop_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "RunLoopOnIsolateEx(nullptr) should report invalid argument") &&
+      Expect(ContainsText(DartVmEmbed_LastErrorMessage(), "isolate is null"),
+             "LastErrorMessage should mention null isolate");
+
+  const bool name_pass =
+      Expect(ContainsText(DartVmEmbed_StatusName(DARTVM_EMBED_STATUS_OK), "ok"),
+             "StatusName should name OK");
+  return null_path_pass && missing_pass && loop_pass && name_pass;
+}
+
+bool TestInvokeBatchValidation() {
+  DartVmEmbedValue results[1];
+  intptr_t completed = -1;
+  DartVmEmbedStatus status = DartVmEmbed_InvokeBatch(
+      nullptr, "add", nullptr, 0, 1, results, 0, &completed);
+  const bool null_isolate_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "InvokeBatch(nullptr isolate) should report invalid argument") &&
+      Expect(completed == 0, "InvokeBatch failure should report 0 completed");
+
+  status = DartVmEmbed_InvokeBatch(reinterpret_cast<Dart_Isolate>(0x1), "add",
+                                   nullptr, 17, 1, results, 0, &completed);
+  const bool arg_count_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "InvokeBatch should reject more than 16 arguments");
+  return null_isolate_pass && arg_count_pass;
+}
+
+bool TestPreparedCallValidation() {
+  DartVmEmbedPreparedCall* call =
+      reinterpret_cast<DartVmEmbedPreparedCall*>(0x1);
+  DartVmEmbedStatus status =
+      DartVmEmbed_PrepareCall(nullptr, nullptr, "add", &call);
+  const bool prepare_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "PrepareCall(nullptr isolate) should report invalid argument") &&
+      Expect(call == nullptr, "PrepareCall failure should clear out_call");
+
+  status = DartVmEmbed_InvokePrepared(nullptr, nullptr, 0, nullptr);
+  const bool invoke_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "InvokePrepared(nullptr) should report invalid argument");
+  DartVmEmbed_ReleasePreparedCall(nullptr);
+  return prepare_pass && invoke_pass;
+}
+
+bool TestPlacementValidation() {
+  DartVmEmbedPlacement placement;
+  placement.cpu_count = 2;
+  DartVmEmbedStatus status = DartVmEmbed_SetThreadPlacement(&placement);
+  const bool cpus_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "SetThreadPlacement should reject a null cpu list") &&
+      Expect(ContainsText(DartVmEmbed_LastErrorMessage(), "cpus is null"),
+             "SetThreadPlacement error should mention null cpus");
+
+  const int far_cpus[] = {0, 1 << 20};
+  placement.cpus = far_cpus;
+  status = DartVmEmbed_SetThreadPlacement(&placement);
+  const bool range_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "SetThreadPlacement should reject CPUs beyond cpu_set_t") &&
+      Expect(ContainsText(DartVmEmbed_LastErrorMessage(), "CPU index"),
+             "SetThreadPlacement error should mention the CPU index");
+
+  status = DartVmEmbed_SetThreadPlacement(nullptr);
+  const bool clear_pass = Expect(status == DARTVM_EMBED_STATUS_OK,
+                                 "SetThreadPlacement(nullptr) should succeed");
+
+  DartVmEmbedPlacementReport report;
+  status = DartVmEmbed_GetIsolatePlacement(nullptr, &report);
+  const bool report_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "GetIsolatePlacement(nullptr) should report invalid argument");
+  return cpus_pass && range_pass && clear_pass && report_pass;
+}
+
+bool TestDeadlineValidation() {
+  DartVmEmbedStatus status =
+      DartVmEmbed_RunLoopOnIsolateWithDeadline(nullptr, 1000000);
+  const bool loop_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "RunLoopOnIsolateWithDeadline(nullptr) should report invalid "
+             "argument");
+  status = DartVmEmbed_RunRootEntryOnIsolateWithDeadline(
+      reinterpret_cast<Dart_Isolate>(0x1), "main", 0);
+  const bool budget_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "RunRootEntryOnIsolateWithDeadline should reject a zero budget");
+  const bool name_pass = Expect(
+      ContainsText(DartVmEmbed_StatusName(DARTVM_EMBED_STATUS_TIMEOUT), "timed"),
+      "StatusName should name TIMEOUT");
+  return loop_pass && budget_pass && name_pass;
+}
+
+bool TestTenantManagerValidation() {
+  DartVmEmbedTenantManager* manager = nullptr;
+  DartVmEmbedTenantManagerConfig config;
+  DartVmEmbedStatus status = DartVmEmbed_TenantManagerCreate(&config, &manager);
+  bool pass = Expect(status == DARTVM_EMBED_STATUS_OK,
+                     "TenantManagerCreate should succeed") &&
+              Expect(manager != nullptr, "TenantManagerCreate should set manager");
+  if (manager == nullptr) {
+    return false;
+  }
+
+  status = DartVmEmbed_TenantRegister(manager, "a", "/nonexistent/a.dill",
+                                      nullptr, 0);
+  pass = Expect(status == DARTVM_EMBED_STATUS_OK,
+                "TenantRegister should succeed") && pass;
+  status = DartVmEmbed_TenantRegister(manager, "a", "/nonexistent/a.dill",
+                                      nullptr, 0);
+  pass = Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                "TenantRegister should reject duplicate tenants") && pass;
+
+  Dart_Isolate isolate = nullptr;
+  status = DartVmEmbed_TenantAcquire(manager, "a", &isolate);
+  pass = Expect(status == DARTVM_EMBED_STATUS_IO_ERROR,
+                "TenantAcquire should report the missing program") &&
+         Expect(isolate == nullptr, "TenantAcquire failure should not set isolate") &&
+         pass;
+
+  DartVmEmbedTenantStats stats;
+  status = DartVmEmbed_TenantGetStats(manager, "a", &stats);
+  pass = Expect(status == DARTVM_EMBED_STATUS_OK,
+                "TenantGetStats should succeed") &&
+         Expect(!stats.resident && !stats.busy,
+                "Failed tenant should be neither resident nor busy") &&
+         pass;
+
+  status = DartVmEmbed_TenantRelease(manager, "a");
+  pass = Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                "TenantRelease should reject a tenant that is not acquired") &&
+         pass;
+  pass = Expect(DartVmEmbed_TenantUnregister(manager, "a") ==
+                    DARTVM_EMBED_STATUS_OK,
+                "TenantUnregister should succeed") &&
+         pass;
+  DartVmEmbed_TenantManagerDestroy(manager);
+  return pass;
+}
+
+bool TestMetricsValidation() {
+  DartVmEmbedMetricsSnapshot before;
+  DartVmEmbed_GetMetricsSnapshot(&before);
+  char* error = nullptr;
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromProgramFile(
+      "/nonexistent/metrics.dill", nullptr, nullptr, nullptr, &error);
+  free(error);
+  DartVmEmbedMetricsSnapshot after;
+  DartVmEmbed_GetMetricsSnapshot(&after);
+  const bool failure_pass =
+      Expect(isolate == nullptr, "CreateIsolateFromProgramFile should fail") &&
+      Expect(after.isolate_creation_failures_total ==
+                 before.isolate_creation_failures_total + 1,
+             "Failed creation should be counted once");
+
+  const DartVmEmbedStatus ex_status = DartVmEmbed_CreateIsolateFromKernelEx(
+      "main.dart", "main", nullptr, 0, nullptr, nullptr, nullptr);
+  DartVmEmbed_ShutdownIsolate();
+  DartVmEmbedMetricsSnapshot after_ex;
+  DartVmEmbed_GetMetricsSnapshot(&after_ex);
+  const bool gauge_pass =
+      Expect(ex_status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "CreateIsolateFromKernelEx(nullptr out) should fail") &&
+      Expect(after_ex.isolate_creation_failures_total ==
+                 after.isolate_creation_failures_total + 1,
+             "Ex argument failure should be counted") &&
+      Expect(after_ex.isolate_shutdowns_total == before.isolate_shutdowns_total &&
+                 after_ex.isolates_alive == before.isolates_alive,
+             "Shutdown without a tracked isolate should not move the gauge");
+
+  char path[] = "/tmp/dartvm_embed_metrics_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    return Expect(false, "mkstemp failed");
+  }
+  close(fd);
+  DartVmEmbedStatus status = DartVmEmbed_WriteMetricsPrometheusFile(path);
+  std::string text;
+  FILE* file = fopen(path, "rb");
+  if (file != nullptr) {
+    char buffer[512];
+    size_t n = 0;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      text.append(buffer, n);
+    }
+    fclose(file);
+  }
+  unlink(path);
+  const bool file_pass =
+      Expect(status == DARTVM_EMBED_STATUS_OK,
+             "WriteMetricsPrometheusFile should succeed") &&
+      Expect(ContainsText(text.c_str(),
+                          "dartvm_embed_isolate_creation_failures_total"),
+             "Prometheus output should include the failure counter") &&
+      Expect(ContainsText(text.c_str(),
+                          "dartvm_embed_isolate_creation_seconds_bucket{le="
+                          "\"+Inf\"}"),
+             "Prometheus output should include the latency histogram") &&
+      Expect(ContainsText(text.c_str(),
+                          "dartvm_embed_isolate_spawn_setup_seconds_total"),
+             "Prometheus output should include spawn setup time");
+
+  status = DartVmEmbed_WriteMetricsPrometheusFd(-1);
+  const bool fd_pass = Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+                              "WriteMetricsPrometheusFd(-1) should fail");
+  return failure_pass && gauge_pass && file_pass && fd_pass;
+}
+
+bool TestHeapSamplingValidation() {
+  DartVmEmbedHeapSamplingConfig config;
+  config.sampling_interval_bytes = 0;
+  DartVmEmbedStatus status = DartVmEmbed_StartHeapSampling(&config);
+  const bool config_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "StartHeapSampling should reject a zero interval");
+  status = DartVmEmbed_StartHeapSampling(nullptr);
+  const bool vm_pass = Expect(status == DARTVM_EMBED_STATUS_FAILED,
+                              "StartHeapSampling should require the VM");
+  status = DartVmEmbed_StopHeapSampling();
+  const bool stop_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "StopHeapSampling should fail when sampling is not active");
+
+  DartVmEmbedHeapSamplingStats stats;
+  status = DartVmEmbed_GetHeapSamplingStats(&stats);
+  const bool stats_pass =
+      Expect(status == DARTVM_EMBED_STATUS_OK,
+             "GetHeapSamplingStats should succeed") &&
+      Expect(!stats.active && stats.samples_total == 0,
+             "Heap sampling should be idle");
+
+  char path[] = "/tmp/dartvm_embed_heap_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    return Expect(false, "mkstemp failed");
+  }
+  close(fd);
+  status = DartVmEmbed_WriteHeapProfilePprof(path);
+  std::string profile;
+  FILE* file = fopen(path, "rb");
+  if (file != nullptr) {
+    char buffer[512];
+    size_t n = 0;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      profile.append(buffer, n);
+    }
+    fclose(file);
+  }
+  unlink(path);
+  const bool write_pass =
+      Expect(status == DARTVM_EMBED_STATUS_OK,
+             "WriteHeapProfilePprof should succeed") &&
+      Expect(profile.find("inuse_space") != std::string::npos,
+             "Heap profile should declare its sample types");
+  return config_pass && vm_pass && stop_pass && stats_pass && write_pass;
+}
+
+bool TestCpuProfileValidation() {
+  DartVmEmbedCpuProfileConfig config;
+  config.sample_period_us = 0;
+  DartVmEmbedStatus status = DartVmEmbed_StartCpuProfile(&config);
+  const bool config_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "StartCpuProfile should reject a zero sample period");
+  status = DartVmEmbed_StartCpuProfile(nullptr);
+  const bool vm_pass = Expect(status == DARTVM_EMBED_STATUS_FAILED,
+                              "StartCpuProfile should require the VM");
+  status = DartVmEmbed_DumpCpuProfile(nullptr, "/tmp/unused.pb.gz",
+                                      DARTVM_EMBED_CPU_PROFILE_PPROF, false);
+  const bool dump_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "DumpCpuProfile(nullptr) should report invalid argument") &&
+      Expect(ContainsText(DartVmEmbed_LastErrorMessage(), "isolate"),
+             "DumpCpuProfile error should mention the isolate");
+  return config_pass && vm_pass && dump_pass;
+}
+
+bool TestEmbedderStatsValidation() {
+  DartVmEmbedStatus status = DartVmEmbed_GetEmbedderStats(nullptr);
+  const bool null_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "GetEmbedderStats(nullptr) should report invalid argument");
+  DartVmEmbedEmbedderStats stats;
+  status = DartVmEmbed_GetEmbedderStats(&stats);
+  const bool stats_pass =
+      Expect(status == DARTVM_EMBED_STATUS_OK,
+             "GetEmbedderStats should succeed") &&
+      Expect(stats.owned_isolates == 0 && stats.kernel_buffers == 0 &&
+                 stats.group_setup_caches == 0 && stats.native_ports == 0,
+             "No isolates should be tracked before initialization") &&
+      Expect(stats.lock_acquisitions > 0,
+             "GetEmbedderStats should count its own lock acquisition");
+  return null_pass && stats_pass;
+}
+
+bool TestMessageNotifyValidation() {
+  const bool null_pass =
+      Expect(DartVmEmbed_GetMessageNotifyFd(nullptr) == -1 &&
+                 DartVmEmbed_LastStatus() ==
+                     DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "GetMessageNotifyFd(nullptr) should report invalid argument") &&
+      Expect(DartVmEmbed_HandlePendingMessages(nullptr) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "HandlePendingMessages(nullptr) should report invalid argument");
+  Dart_Isolate untracked = reinterpret_cast<Dart_Isolate>(0x1);
+  const bool untracked_pass =
+      Expect(DartVmEmbed_HandlePendingMessages(untracked) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "HandlePendingMessages should reject isolates without a notify "
+             "fd");
+  int64_t remaining = -1;
+  const bool pump_pass =
+      Expect(DartVmEmbed_PumpMessages(nullptr, 1000000, 8, &remaining) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "PumpMessages(nullptr) should report invalid argument") &&
+      Expect(remaining == 0, "PumpMessages should clear out_remaining") &&
+      Expect(DartVmEmbed_PumpMessages(untracked, 0, 0, nullptr) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "PumpMessages should reject isolates not created through the "
+             "embedder");
+  return null_pass && untracked_pass && pump_pass;
+}
+
+struct CObjectTestPoint {
+  int32_t x;
+  double y;
+};
+
+struct CObjectTestSample {
+  int64_t timestamp;
+  bool valid;
+  std::string tag;
+  CObjectTestPoint point;
+  std::vector<uint8_t> payload;
+  std::vector<int64_t> history;
+};
+
+}  // namespace
+
+namespace dartvm_embed {
+
+template <>
+struct CObjectFields<CObjectTestPoint> {
+  static constexpr auto kFields =
+      std::make_tuple(&CObjectTestPoint::x, &CObjectTestPoint::y);
+};
+
+template <>
+struct CObjectFields<CObjectTestSample> {
+  static constexpr auto kFields = std::make_tuple(
+      &CObjectTestSample::timestamp, &CObjectTestSample::valid,
+      &CObjectTestSample::tag, &CObjectTestSample::point,
+      &CObjectTestSample::payload, &CObjectTestSample::history);
+};
+
+}  // namespace dartvm_embed
+
+namespace {
+
+bool TestCObjectMarshalling() {
+  CObjectTestSample sample;
+  sample.timestamp = int64_t{1} << 40;
+  sample.valid = true;
+  sample.tag = "sensor";
+  sample.point = {-7, 2.5};
+  sample.payload = {1, 2, 3};
+  sample.history = {10, 20};
+
+  dartvm_embed::CObjectArena arena(256);
+  Dart_CObject* object = dartvm_embed::Marshal(sample, &arena);
+  const bool shape_pass =
+      Expect(object->type == Dart_CObject_kArray &&
+                 object->value.as_array.length == 6,
+             "Described structs should marshal to one element per field");
+  if (!shape_pass) {
+    return false;
+  }
+  Dart_CObject** fields = object->value.as_array.values;
+  Dart_CObject* point = fields[3];
+  const bool fields_pass =
+      Expect(fields[0]->type == Dart_CObject_kInt64 &&
+                 fields[0]->value.as_int64 == sample.timestamp,
+             "int64_t fields should marshal as kInt64") &&
+      Expect(fields[1]->type == Dart_CObject_kBool &&
+                 fields[1]->value.as_bool,
+             "bool fields should marshal as kBool") &&
+      Expect(fields[2]->type == Dart_CObject_kString &&
+                 std::strcmp(fields[2]->value.as_string, "sensor") == 0 &&
+                 fields[2]->value.as_string != sample.tag.c_str(),
+             "string fields should be copied into the arena") &&
+      Expect(point->type == Dart_CObject_kArray &&
+                 point->value.as_array.length == 2 &&
+                 point->value.as_array.values[0]->type ==
+                     Dart_CObject_kInt32 &&
+                 point->value.as_array.values[0]->value.as_int32 == -7 &&
+                 point->value.as_array.values[1]->type ==
+                     Dart_CObject_kDouble &&
+                 point->value.as_array.values[1]->value.as_double == 2.5,
+             "Nested structs should marshal in field order") &&
+      Expect(fields[4]->type == Dart_CObject_kTypedData &&
+                 fields[4]->value.as_typed_data.type ==
+                     Dart_TypedData_kUint8 &&
+                 fields[4]->value.as_typed_data.length == 3,
+             "Byte vectors should marshal as Uint8 typed data") &&
+      Expect(fields[5]->type == Dart_CObject_kArray &&
+                 fields[5]->value.as_array.length == 2 &&
+                 fields[5]->value.as_array.values[1]->value.as_int64 == 20,
+             "Vectors should marshal as arrays");
+
+  const size_t capacity = arena.capacity();
+  for (int i = 0; i < 4; ++i) {
+    arena.Reset();
+    dartvm_embed::Marshal(sample, &arena);
+  }
+  const bool reuse_pass =
+      Expect(arena.capacity() == capacity,
+             "A reset arena should reuse its blocks for the same batch");
+
+  const DartVmEmbedStatus status = DartVmEmbed_PostCObjectBatch(0, nullptr, 0);
+  const bool post_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "PostCObjectBatch should reject ILLEGAL_PORT") &&
+      Expect(DartVmEmbed_PostCObjectBatch(1, nullptr, 1) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "PostCObjectBatch should reject missing objects");
+  return fields_pass && reuse_pass && post_pass;
+}
+
+int32_t FfiNativeTestAdd(int32_t a, int32_t b) {
+  return a + b;
+}
+
+bool TestFfiNativesValidation() {
+  const bool null_pass =
+      Expect(DartVmEmbed_RegisterFfiNatives(nullptr, 1) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "RegisterFfiNatives should reject a missing table") &&
+      Expect(DartVmEmbed_RegisterFfiNatives(nullptr, -1) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "RegisterFfiNatives should reject a negative count");
+  void* add = reinterpret_cast<void*>(&FfiNativeTestAdd);
+  const DartVmEmbedFfiNative duplicates[] = {
+      {"host_add", add, 2},
+      {"host_add", add, 2},
+  };
+  const DartVmEmbedFfiNative unnamed[] = {{nullptr, add, 2}};
+  const bool entries_pass =
+      Expect(DartVmEmbed_RegisterFfiNatives(duplicates, 2) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "RegisterFfiNatives should reject duplicate names") &&
+      Expect(DartVmEmbed_RegisterFfiNatives(unnamed, 1) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "RegisterFfiNatives should reject unnamed entries");
+  const DartVmEmbedFfiNative natives[] = {
+      {"host_add", add, 2},
+      {"host_add_any", add, -1},
+      {"host_add_alias", add, 2},
+  };
+  const bool register_pass =
+      Expect(DartVmEmbed_RegisterFfiNatives(natives, 3) ==
+                 DARTVM_EMBED_STATUS_OK,
+             "RegisterFfiNatives should accept a table before "
+             "initialization");
+  const bool lookup_pass =
+      Expect(DartVmEmbed_LookupFfiNative("host_add", 2) == add &&
+                 DartVmEmbed_LookupFfiNative("host_add_alias", 2) == add,
+             "LookupFfiNative should find registered names") &&
+      Expect(DartVmEmbed_LookupFfiNative("host_add", 3) == nullptr,
+             "LookupFfiNative should reject a wrong arity") &&
+      Expect(DartVmEmbed_LookupFfiNative("host_add_any", 5) == add,
+             "LookupFfiNative should accept any arity for args_n -1") &&
+      Expect(DartVmEmbed_LookupFfiNative("host_sub", 2) == nullptr,
+             "LookupFfiNative should miss unknown names");
+
+  // Enough names that several buckets collide; every one must resolve.
+  std::vector<std::string> many_names;
+  std::vector<DartVmEmbedFfiNative> many;
+  for (int i = 0; i < 4096; ++i) {
+    many_names.push_back("host_fn_" + std::to_string(i));
+  }
+  for (const std::string& name : many_names) {
+    many.push_back({name.c_str(), add, 2});
+  }
+  bool many_pass = Expect(DartVmEmbed_RegisterFfiNatives(
+                              many.data(), static_cast<intptr_t>(many.size())) ==
+                              DARTVM_EMBED_STATUS_OK,
+                          "RegisterFfiNatives should build a large table");
+  for (const std::string& name : many_names) {
+    if (DartVmEmbed_LookupFfiNative(name.c_str(), 2) != add) {
+      many_pass = Expect(false, "LookupFfiNative should find every name");
+      break;
+    }
+  }
+  const bool remove_pass =
+      Expect(DartVmEmbed_RegisterFfiNatives(nullptr, 0) ==
+                 DARTVM_EMBED_STATUS_OK,
+             "RegisterFfiNatives(nullptr, 0) should remove the table") &&
+      Expect(DartVmEmbed_LookupFfiNative("host_add", 2) == nullptr,
+             "LookupFfiNative should miss after the table is removed") &&
+      Expect(DartVmEmbed_LookupFfiNative("DartVmEmbed_LookupNativeSendPort",
+                                         1) != nullptr,
+             "LookupFfiNative should resolve embedder natives without a "
+             "table");
+  return null_pass && entries_pass && register_pass && lookup_pass &&
+         many_pass && remove_pass;
+}
+
+void NativePortTestHandler(void* user_data,
+                           int64_t port,
+                           Dart_CObject* message) {
+  (void)user_data;
+  (void)port;
+  (void)message;
+}
+
+struct KeyedPortLog {
+  std::mutex mutex;
+  std::map<int64_t, std::vector<int64_t>> sequences;
+};
+
+void KeyedPortTestHandler(void* user_data,
+                          int64_t port,
+                          Dart_CObject* message) {
+  (void)port;
+  auto* log = static_cast<KeyedPortLog*>(user_data);
+  if (message->type != Dart_CObject_kArray ||
+      message->value.as_array.length != 2) {
+    return;
+  }
+  const int64_t key = message->value.as_array.values[0]->value.as_int64;
+  const int64_t seq = message->value.as_array.values[1]->value.as_int64;
+  std::lock_guard<std::mutex> lock(log->mutex);
+  log->sequences[key].push_back(seq);
+}
+
+// Needs an initialized VM: posts [key, seq] pairs to a keyed port and checks
+// that each key's messages arrive in order and that the stats count them.
+bool TestNativePortDelivery() {
+  KeyedPortLog log;
+  DartVmEmbedNativePortConfig config;
+  config.name = "test.keyed";
+  config.handler = KeyedPortTestHandler;
+  config.user_data = &log;
+  config.concurrency = DARTVM_EMBED_NATIVE_PORT_KEYED;
+  config.threads = 3;
+  int64_t port = 0;
+  const bool owner_pass =
+      Expect(DartVmEmbed_NewNativePort(reinterpret_cast<Dart_Isolate>(&log),
+                                       &config, &port) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "NewNativePort should reject owners the embedder did not "
+             "create");
+  if (!Expect(DartVmEmbed_NewNativePort(nullptr, &config, &port) ==
+                  DARTVM_EMBED_STATUS_OK,
+              "NewNativePort should succeed after initialization")) {
+    return false;
+  }
+  const bool lookup_pass =
+      Expect(DartVmEmbed_LookupNativePort("test.keyed") == port,
+             "LookupNativePort should find the named port");
+
+  const int64_t kKeys = 4;
+  const int64_t kPerKey = 64;
+  bool posted = true;
+  dartvm_embed::CObjectArena arena;
+  for (int64_t seq = 0; seq < kPerKey; ++seq) {
+    for (int64_t key = 0; key < kKeys; ++key) {
+      const std::vector<int64_t> pair = {key, seq};
+      posted = Dart_PostCObject(port, dartvm_embed::Marshal(pair, &arena)) &&
+               posted;
+      arena.Reset();
+    }
+  }
+  DartVmEmbedNativePortStats stats;
+  for (int i = 0; i < 500; ++i) {
+    if (DartVmEmbed_GetNativePortStats(port, &stats) ==
+            DARTVM_EMBED_STATUS_OK &&
+        stats.messages_handled == kKeys * kPerKey) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  const bool stats_pass =
+      Expect(posted, "Dart_PostCObject to the native port should succeed") &&
+      Expect(stats.messages_handled == kKeys * kPerKey,
+             "Native port stats should count every handled message") &&
+      Expect(stats.queue_depth == 0 && stats.max_queue_depth >= 1 &&
+                 stats.messages_dropped == 0,
+             "Native port stats should show the drained queue");
+
+  bool order_pass = true;
+  {
+    std::lock_guard<std::mutex> lock(log.mutex);
+    order_pass = Expect(static_cast<int64_t>(log.sequences.size()) == kKeys,
+                        "Every key should reach the handler");
+    for (const auto& entry : log.sequences) {
+      std::vector<int64_t> expected(kPerKey);
+      for (int64_t seq = 0; seq < kPerKey; ++seq) {
+        expected[seq] = seq;
+      }
+      order_pass = Expect(entry.second == expected,
+                          "Messages with one key should keep their order") &&
+                   order_pass;
+    }
+  }
+
+  const bool close_pass =
+      Expect(DartVmEmbed_CloseNativePort(port) == DARTVM_EMBED_STATUS_OK,
+             "CloseNativePort should close an open port") &&
+      Expect(DartVmEmbed_LookupNativePort("test.keyed") == 0,
+             "A closed port should no longer be registered");
+  return owner_pass && lookup_pass && stats_pass && order_pass && close_pass;
+}
+
+bool TestNativePortValidation() {
+  DartVmEmbedNativePortConfig config;
+  const bool default_pass =
+      Expect(config.concurrency == DARTVM_EMBED_NATIVE_PORT_SERIAL &&
+                 config.threads == 1 && config.name == nullptr &&
+                 config.key == nullptr,
+             "Native ports should default to one serial worker") &&
+      Expect(DartVmEmbedInitConfig().native_port_threads == 0,
+             "Native port pool should default to the hardware thread count");
+  int64_t port = -1;
+  const bool invalid_pass =
+      Expect(DartVmEmbed_NewNativePort(nullptr, nullptr, &port) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "NewNativePort should reject a missing config") &&
+      Expect(port == 0, "NewNativePort should clear out_port") &&
+      Expect(DartVmEmbed_NewNativePort(nullptr, &config, &port) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "NewNativePort should reject a config without a handler");
+  config.handler = NativePortTestHandler;
+  config.concurrency = DARTVM_EMBED_NATIVE_PORT_KEYED;
+  config.threads = 0;
+  const bool threads_pass =
+      Expect(DartVmEmbed_NewNativePort(nullptr, &config, &port) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "NewNativePort should reject keyed ports without lanes");
+  config.threads = 4;
+  config.name = "test.bridge";
+  const bool uninitialized_pass =
+      Expect(DartVmEmbed_NewNativePort(nullptr, &config, &port) ==
+                 DARTVM_EMBED_STATUS_FAILED,
+             "NewNativePort should fail before initialization") &&
+      Expect(DartVmEmbed_LookupNativePort("test.bridge") == 0 &&
+                 DartVmEmbed_LookupNativePort(nullptr) == 0,
+             "LookupNativePort should not find unregistered names");
+  DartVmEmbedNativePortStats stats;
+  const bool unknown_pass =
+      Expect(DartVmEmbed_CloseNativePort(1) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "CloseNativePort should reject unknown ports") &&
+      Expect(DartVmEmbed_GetNativePortStats(1, &stats) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "GetNativePortStats should reject unknown ports") &&
+      Expect(DartVmEmbed_GetNativePortStats(1, nullptr) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "GetNativePortStats(nullptr) should report invalid argument");
+  return default_pass && invalid_pass && threads_pass && uninitialized_pass &&
+         unknown_pass;
+}
+
+bool TestKernelServiceValidation() {
+  DartVmEmbedStatus status = DartVmEmbed_GetKernelServiceStats(nullptr);
+  const bool null_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "GetKernelServiceStats(nullptr) should report invalid argument");
+  DartVmEmbedKernelServiceStats stats;
+  status = DartVmEmbed_GetKernelServiceStats(&stats);
+  const bool stats_pass =
+      Expect(status == DARTVM_EMBED_STATUS_OK,
+             "GetKernelServiceStats should succeed without a VM") &&
+      Expect(stats.state == DARTVM_EMBED_KERNEL_SERVICE_DISABLED &&
+                 stats.startup_ns == -1,
+             "Kernel service should be disabled before initialization");
+  status = DartVmEmbed_PrestartKernelService();
+  const bool prestart_pass =
+      Expect(status == DARTVM_EMBED_STATUS_FAILED,
+             "PrestartKernelService should fail before initialization");
+  status = DartVmEmbed_StartServiceIsolate();
+  const bool service_pass =
+      Expect(status == DARTVM_EMBED_STATUS_FAILED,
+             "StartServiceIsolate should fail before initialization");
+  DartVmEmbedInitConfig config;
+  const bool default_pass = Expect(config.lazy_kernel_isolate,
+                                   "Kernel isolate should start lazily by "
+                                   "default");
+  return null_pass && stats_pass && prestart_pass && service_pass &&
+         default_pass;
+}
+
+bool TestBulkShutdownAndFastExit() {
+  DartVmEmbedStatus status = DartVmEmbed_ShutdownIsolates(nullptr, 3, 2);
+  const bool list_pass =
+      Expect(status == DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "ShutdownIsolates should reject a null list with a count");
+  status = DartVmEmbed_ShutdownIsolates(nullptr, 0, 4);
+  const bool empty_pass = Expect(status == DARTVM_EMBED_STATUS_OK,
+                                 "ShutdownIsolates with nothing tracked should "
+                                 "succeed");
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    DartVmEmbed_FastExit(7);
+  }
+  int wait_status = 0;
+  const bool exit_pass =
+      Expect(pid > 0 && waitpid(pid, &wait_status, 0) == pid,
+             "fork/waitpid should succeed") &&
+      Expect(WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == 7,
+             "FastExit should exit with the given code");
+  return list_pass && empty_pass && exit_pass;
+}
+
+int ExitWithRequestSize(void* user_data,
+                        const uint8_t* request,
+                        intptr_t request_size) {
+  (void)user_data;
+  (void)request;
+  return static_cast<int>(request_size);
+}
+
+bool TestForkWorkerBeforeInit() {
+  char* error = nullptr;
+  const bool preload_ok = DartVmEmbed_ForkServerPreloadProgram(nullptr, &error);
+  const bool preload_pass =
+      Expect(!preload_ok, "ForkServerPreloadProgram(nullptr) should fail") &&
+      Expect(ContainsText(error, "program_path is null"),
+             "ForkServerPreloadProgram error should mention null program_path");
+  free(error);
+
+  const uint8_t request[] = {1, 2, 3};
+  error = nullptr;
+  const int64_t pid = DartVmEmbed_ForkWorker(ExitWithRequestSize, nullptr,
+                                             request, sizeof(request), &error);
+  bool fork_pass = Expect(pid > 0, "ForkWorker should fork before VM init") &&
+                   Expect(error == nullptr, "ForkWorker should not set error");
+  free(error);
+  if (pid > 0) {
+    int status = 0;
+    fork_pass = Expect(waitpid(static_cast<pid_t>(pid), &status, 0) == pid,
+                       "Forked worker should be reapable") &&
+                Expect(WIFEXITED(status) && WEXITSTATUS(status) == 3,
+                       "Forked worker should exit with worker_main result") &&
+                fork_pass;
+  }
+  return preload_pass && fork_pass;
+}
+
+// The fork server reaps only its own workers: an unrelated child that has
+// already exited must still be reapable by its owner afterwards.
+bool TestForkServerReapsOwnWorkers() {
+  const uint8_t request[] = {1, 2, 3, 4, 5};
+  char* error = nullptr;
+  const int64_t other = DartVmEmbed_ForkWorker(ExitWithRequestSize, nullptr,
+                                               request, 3, &error);
+  free(error);
+  if (!Expect(other > 0, "ForkWorker should fork before VM init")) {
+    return false;
+  }
+  siginfo_t info;
+  waitid(P_PID, static_cast<id_t>(other), &info, WEXITED | WNOWAIT);
+
+  int fds[2];
+  if (!Expect(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0,
+              "socketpair should succeed")) {
+    return false;
+  }
+  const uint32_t request_size = sizeof(request);
+  const bool sent =
+      write(fds[0], &request_size, sizeof(request_size)) ==
+          static_cast<ssize_t>(sizeof(request_size)) &&
+      write(fds[0], request, sizeof(request)) ==
+          static_cast<ssize_t>(sizeof(request)) &&
+      shutdown(fds[0], SHUT_WR) == 0;
+
+  error = nullptr;
+  const bool served =
+      DartVmEmbed_ForkServerServe(fds[1], ExitWithRequestSize, nullptr, &error);
+  free(error);
+  int64_t worker = -1;
+  const bool replied =
+      read(fds[0], &worker, sizeof(worker)) ==
+      static_cast<ssize_t>(sizeof(worker));
+  close(fds[0]);
+  close(fds[1]);
+
+  int status = 0;
+  bool pass = Expect(sent && served, "ForkServerServe should return on EOF") &&
+              Expect(replied && worker > 0,
+                     "ForkServerServe should reply with the worker pid");
+  if (worker > 0) {
+    pass = Expect(waitpid(static_cast<pid_t>(worker), &status, 0) == worker &&
+                      WIFEXITED(status) && WEXITSTATUS(status) == 5,
+                  "Served worker should exit with worker_main result") &&
+           pass;
+  }
+  status = 0;
+  pass = Expect(waitpid(static_cast<pid_t>(other), &status, 0) == other &&
+                    WIFEXITED(status) && WEXITSTATUS(status) == 3,
+                "ForkServerServe should not reap unrelated children") &&
+         pass;
+  DartVmEmbed_ForkServerReleasePrograms();
+  return pass;
+}
+
+// Requires an initialized VM. A cache without a matching entry is a miss
+// that falls through to kernel creation, which rejects the bogus kernel.
+bool TestAppJitCacheMiss() {
+  char cache_dir[] = "/tmp/dartvm_embed_appjit_XXXXXX";
+  if (!Expect(mkdtemp(cache_dir) != nullptr, "mkdtemp should succeed")) {
+    return false;
+  }
+  static const uint8_t kKernel[] = {0x90, 0xab, 0xcd, 0xef, 0, 0, 0, 0};
+  char* error = nullptr;
+  bool cache_hit = true;
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromAppJitCache(
+      cache_dir, "main.dart", "main", kKernel, sizeof(kKernel), nullptr,
+      nullptr, &cache_hit, &error);
+  const bool pass =
+      Expect(isolate == nullptr,
+             "CreateIsolateFromAppJitCache should reject a bogus kernel") &&
+      Expect(!cache_hit, "CreateIsolateFromAppJitCache empty cache is a miss") &&
+      Expect(error != nullptr && !ContainsText(error, "invalid argument"),
+             "CreateIsolateFromAppJitCache miss should report the kernel "
+             "error");
+  free(error);
+  rmdir(cache_dir);
+  return pass;
+}
+
+// Requires an initialized VM. A file starting with the AppJIT snapshot
+// header is routed to the snapshot loader; anything else is read as kernel.
+bool TestProgramFileFormatDetection() {
+  char snapshot_path[] = "/tmp/dartvm_embed_appjit_XXXXXX";
+  char kernel_path[] = "/tmp/dartvm_embed_kernel_XXXXXX";
+  const int snapshot_fd = mkstemp(snapshot_path);
+  const int kernel_fd = mkstemp(kernel_path);
+  if (!Expect(snapshot_fd >= 0 && kernel_fd >= 0, "mkstemp should succeed")) {
+    return false;
+  }
+  // Magic number followed by the four (empty) blob sizes.
+  uint8_t snapshot_header[40] = {0xdc, 0xdc, 0xf6, 0xf6};
+  const uint8_t kernel_header[8] = {0x90, 0xab, 0xcd, 0xef};
+  const bool written =
+      write(snapshot_fd, snapshot_header, sizeof(snapshot_header)) ==
+          static_cast<ssize_t>(sizeof(snapshot_header)) &&
+      write(kernel_fd, kernel_header, sizeof(kernel_header)) ==
+          static_cast<ssize_t>(sizeof(kernel_header));
+  close(snapshot_fd);
+  close(kernel_fd);
+
+  char* error = nullptr;
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromProgramFile(
+      snapshot_path, "main.dart", nullptr, nullptr, &error);
+  const bool snapshot_pass =
+      Expect(written, "format detection inputs should be written") &&
+      Expect(isolate == nullptr, "empty AppJIT snapshot should fail") &&
+      Expect(ContainsText(error, "CreateIsolateFromAppSnapshot"),
+             "AppJIT header should be loaded as an app snapshot");
+  free(error);
+
+  error = nullptr;
+  isolate = DartVmEmbed_CreateIsolateFromProgramFile(
+      kernel_path, "main.dart", nullptr, nullptr, &error);
+  const bool kernel_pass =
+      Expect(isolate == nullptr, "truncated kernel should fail") &&
+      Expect(error != nullptr &&
+                 !ContainsText(error, "CreateIsolateFromAppSnapshot"),
+             "kernel header should not be loaded as an app snapshot");
+  free(error);
+
+  unlink(snapshot_path);
+  unlink(kernel_path);
+  return snapshot_pass && kernel_pass;
+}
+
 bool TestInitializeAndCleanupRoundTrip() {
   const char* vm_flags[] = {"--no-verify_sdk_hash"};
   DartVmEmbedInitConfig config;
@@ -137,6 +1120,22 @@ bool TestInitializeAndCleanupRoundTrip() {
   const bool service_query_pass =
       Expect(!DartVmEmbed_HasServiceMessages(),
              "HasServiceMessages should be false without service traffic");
+  DartVmEmbedKernelServiceStats kernel_stats;
+  const bool kernel_service_pass =
+      Expect(DartVmEmbed_GetKernelServiceStats(&kernel_stats) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 kernel_stats.state == DARTVM_EMBED_KERNEL_SERVICE_DISABLED,
+             "Kernel service should be disabled with start_kernel_isolate "
+             "off") &&
+      Expect(DartVmEmbed_PrestartKernelService() ==
+                 DARTVM_EMBED_STATUS_UNSUPPORTED,
+             "PrestartKernelService should be unsupported when disabled") &&
+      Expect(DartVmEmbed_StartServiceIsolate() == DARTVM_EMBED_STATUS_OK,
+             "StartServiceIsolate should release the deferred service "
+             "isolate");
+  const bool native_port_pass = TestNativePortDelivery();
+  const bool app_jit_miss_pass = TestAppJitCacheMiss();
+  const bool format_detection_pass = TestProgramFileFormatDetection();
 
   error = nullptr;
   const bool cleanup_ok = DartVmEmbed_Cleanup(&error);
@@ -146,7 +1145,8 @@ bool TestInitializeAndCleanupRoundTrip() {
   free(error);
 
   return init_pass && init2_pass && callback_pass && reloading_pass &&
-         service_query_pass && cleanup_pass;
+         service_query_pass && kernel_service_pass && native_port_pass &&
+         app_jit_miss_pass && format_detection_pass && cleanup_pass;
 }
 
 }  // namespace
@@ -158,6 +1158,26 @@ int main() {
   ok = TestRunEntryValidation() && ok;
   ok = TestCreateFromSourceValidation() && ok;
   ok = TestLoadAotInJitFlavor() && ok;
+  ok = TestAppJitCacheValidation() && ok;
+  ok = TestProgramBufferValidation() && ok;
+  ok = TestForkWorkerBeforeInit() && ok;
+  ok = TestForkServerReapsOwnWorkers() && ok;
+  ok = TestStatusApiValidation() && ok;
+  ok = TestInvokeBatchValidation() && ok;
+  ok = TestPreparedCallValidation() && ok;
+  ok = TestPlacementValidation() && ok;
+  ok = TestDeadlineValidation() && ok;
+  ok = TestTenantManagerValidation() && ok;
+  ok = TestMetricsValidation() && ok;
+  ok = TestHeapSamplingValidation() && ok;
+  ok = TestCpuProfileValidation() && ok;
+  ok = TestEmbedderStatsValidation() && ok;
+  ok = TestBulkShutdownAndFastExit() && ok;
+  ok = TestKernelServiceValidation() && ok;
+  ok = TestMessageNotifyValidation() && ok;
+  ok = TestCObjectMarshalling() && ok;
+  ok = TestFfiNativesValidation() && ok;
+  ok = TestNativePortValidation() && ok;
   ok = TestInitializeAndCleanupRoundTrip() && ok;
 
   if (!ok) {
@@ -0,0 +1,914 @@
+// Tests against a live VM, built when a dart CLI is available to compile
+// embed_api_live.dart. The VM can be initialized only once per process, so
+// every test runs between one DartVmEmbed_Initialize / DartVmEmbed_Cleanup
+// pair, in order.
+
+#include "dartvm_embed_lib.h"
+
+#include <dart_native_api.h>
+#include <poll.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char* const kKernelPath = DARTVM_EMBED_LIVE_TEST_KERNEL;
+const char* const kSourcePath = DARTVM_EMBED_LIVE_TEST_SOURCE;
+
+// Kernel bytes of embed_api_live.dart. Isolates created from them use the
+// buffer in place, so it lives until Cleanup.
+std::vector<uint8_t> g_kernel;
+
+bool Expect(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << "[FAIL] " << message << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool ReadFile(const char* path, std::vector<uint8_t>* out) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  out->assign(std::istreambuf_iterator<char>(in),
+              std::istreambuf_iterator<char>());
+  return !out->empty();
+}
+
+Dart_Isolate CreateFromKernel(const char* name) {
+  char* error = nullptr;
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromKernel(
+      kSourcePath, name, g_kernel.data(),
+      static_cast<intptr_t>(g_kernel.size()), nullptr, nullptr, &error);
+  if (isolate == nullptr) {
+    std::cerr << "CreateIsolateFromKernel: " << (error ? error : "") << "\n";
+  }
+  free(error);
+  return isolate;
+}
+
+bool RunMain(Dart_Isolate isolate) {
+  char* error = nullptr;
+  const bool ran = DartVmEmbed_RunRootEntryOnIsolate(isolate, "main", &error);
+  if (!ran) {
+    std::cerr << "RunRootEntryOnIsolate: " << (error ? error : "") << "\n";
+  }
+  free(error);
+  return ran;
+}
+
+bool CompileAndRunSource(const char* name) {
+  char* error = nullptr;
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromSource(
+      kSourcePath, nullptr, name, nullptr, nullptr, &error);
+  if (isolate == nullptr) {
+    std::cerr << "CreateIsolateFromSource: " << (error ? error : "") << "\n";
+    free(error);
+    return false;
+  }
+  free(error);
+  const bool ran = RunMain(isolate);
+  DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  return ran;
+}
+
+// Runs first: nothing has compiled a source yet.
+bool TestLazyKernelServiceStart() {
+  DartVmEmbedKernelServiceStats stats;
+  const bool deferred_pass =
+      Expect(DartVmEmbed_GetKernelServiceStats(&stats) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 stats.lazy &&
+                 stats.state == DARTVM_EMBED_KERNEL_SERVICE_NOT_STARTED &&
+                 stats.start_requested_ns == -1,
+             "Kernel isolate should be deferred after Initialize");
+
+  Dart_Isolate isolate = CreateFromKernel("live_kernel");
+  const bool kernel_pass =
+      Expect(isolate != nullptr, "CreateIsolateFromKernel should succeed") &&
+      Expect(DartVmEmbed_GetKernelServiceStats(&stats) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 stats.state == DARTVM_EMBED_KERNEL_SERVICE_NOT_STARTED,
+             "Loading a .dill should not start the kernel isolate");
+  if (isolate != nullptr) {
+    DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  }
+
+  const bool source_pass =
+      Expect(CompileAndRunSource("live_source_lazy"),
+             "Source compile should start the kernel isolate and succeed") &&
+      Expect(DartVmEmbed_GetKernelServiceStats(&stats) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 stats.state == DARTVM_EMBED_KERNEL_SERVICE_RUNNING &&
+                 stats.start_requested_ns >= 0 && stats.startup_ns >= 0,
+             "Kernel isolate should be running with its start time reported") &&
+      Expect(DartVmEmbed_PrestartKernelService() == DARTVM_EMBED_STATUS_OK,
+             "PrestartKernelService should be a no-op once started");
+  return deferred_pass && kernel_pass && source_pass;
+}
+
+// The kernel isolate is never shut down while the VM runs, so a compile
+// after an idle period reuses the one the first compile started.
+bool TestSourceCompileAfterIdle() {
+  DartVmEmbedKernelServiceStats first;
+  const bool first_pass =
+      Expect(CompileAndRunSource("live_source_1"),
+             "First source compile should succeed") &&
+      Expect(DartVmEmbed_GetKernelServiceStats(&first) ==
+                 DARTVM_EMBED_STATUS_OK,
+             "GetKernelServiceStats should succeed");
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  DartVmEmbedKernelServiceStats second;
+  const bool second_pass =
+      Expect(CompileAndRunSource("live_source_2"),
+             "Source compile after an idle period should succeed") &&
+      Expect(DartVmEmbed_GetKernelServiceStats(&second) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 second.state == DARTVM_EMBED_KERNEL_SERVICE_RUNNING &&
+                 second.start_requested_ns == first.start_requested_ns,
+             "The idle kernel isolate should keep running and not restart");
+  return first_pass && second_pass;
+}
+
+Dart_Isolate CreateFromAppJitCache(const char* cache_dir, bool* cache_hit) {
+  char* error = nullptr;
+  Dart_Isolate isolate = DartVmEmbed_CreateIsolateFromAppJitCache(
+      cache_dir, kSourcePath, "live_appjit", g_kernel.data(),
+      static_cast<intptr_t>(g_kernel.size()), nullptr, nullptr, cache_hit,
+      &error);
+  if (isolate == nullptr) {
+    std::cerr << "CreateIsolateFromAppJitCache: " << (error ? error : "")
+              << "\n";
+  }
+  free(error);
+  return isolate;
+}
+
+// Trains an isolate, saves it and starts the next one from the saved entry.
+bool TestAppJitSaveAndLoad() {
+  char dir_template[] = "/tmp/dartvm_embed_live_appjit_XXXXXX";
+  const char* cache_dir = mkdtemp(dir_template);
+  if (!Expect(cache_dir != nullptr, "mkdtemp should succeed")) {
+    return false;
+  }
+
+  bool cache_hit = true;
+  Dart_Isolate isolate = CreateFromAppJitCache(cache_dir, &cache_hit);
+  bool miss_pass = Expect(isolate != nullptr && !cache_hit,
+                          "An empty cache should fall back to kernel");
+  if (isolate != nullptr) {
+    char* error = nullptr;
+    miss_pass = Expect(RunMain(isolate), "Training run should succeed") &&
+                Expect(DartVmEmbed_SaveAppJitSnapshot(isolate, cache_dir,
+                                                      &error),
+                       "SaveAppJitSnapshot should succeed") &&
+                miss_pass;
+    if (error != nullptr) {
+      std::cerr << "SaveAppJitSnapshot: " << error << "\n";
+    }
+    free(error);
+    DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  }
+
+  size_t entries = 0;
+  bool temp_left = false;
+  for (const auto& entry : std::filesystem::directory_iterator(cache_dir)) {
+    ++entries;
+    temp_left = temp_left || entry.path().extension() != ".appjit";
+  }
+  const bool file_pass = Expect(entries == 1 && !temp_left,
+                                "The cache should hold exactly one .appjit "
+                                "entry and no temporary file");
+
+  cache_hit = false;
+  isolate = CreateFromAppJitCache(cache_dir, &cache_hit);
+  DartVmEmbedEmbedderStats stats;
+  bool hit_pass = Expect(isolate != nullptr && cache_hit,
+                         "The saved entry should be a cache hit") &&
+                  Expect(DartVmEmbed_GetEmbedderStats(&stats) ==
+                                 DARTVM_EMBED_STATUS_OK &&
+                             stats.app_jit_snapshots == 1,
+                         "The loaded snapshot should be held by its group");
+  if (isolate != nullptr) {
+    hit_pass = Expect(RunMain(isolate),
+                      "An isolate from the cache should run main") &&
+               hit_pass;
+    DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  }
+  const bool released_pass =
+      Expect(DartVmEmbed_GetEmbedderStats(&stats) == DARTVM_EMBED_STATUS_OK &&
+                 stats.app_jit_snapshots == 0,
+             "The snapshot should be released with its group");
+
+  std::error_code ignored;
+  std::filesystem::remove_all(cache_dir, ignored);
+  return miss_pass && file_pass && hit_pass && released_pass;
+}
+
+bool TenantStats(DartVmEmbedTenantManager* manager,
+                 const char* tenant_id,
+                 DartVmEmbedTenantStats* stats) {
+  return DartVmEmbed_TenantGetStats(manager, tenant_id, stats) ==
+         DARTVM_EMBED_STATUS_OK;
+}
+
+// Acquire reuses a resident isolate, and a tenant whose isolate died without
+// the manager (here a direct shutdown) gets a new one.
+bool TestTenantAcquireAndRecreate() {
+  DartVmEmbedTenantManager* manager = nullptr;
+  if (!Expect(DartVmEmbed_TenantManagerCreate(nullptr, &manager) ==
+                  DARTVM_EMBED_STATUS_OK,
+              "TenantManagerCreate should succeed")) {
+    return false;
+  }
+  bool pass = Expect(DartVmEmbed_TenantRegister(manager, "a", kKernelPath,
+                                                kSourcePath, 0) ==
+                         DARTVM_EMBED_STATUS_OK,
+                     "TenantRegister should succeed");
+
+  Dart_Isolate first = nullptr;
+  DartVmEmbedTenantStats stats;
+  pass = Expect(DartVmEmbed_TenantAcquire(manager, "a", &first) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    first != nullptr,
+                "TenantAcquire should create the isolate") &&
+         Expect(RunMain(first), "Tenant isolate should run main") &&
+         Expect(TenantStats(manager, "a", &stats) && stats.resident &&
+                    stats.busy && stats.creations == 1 &&
+                    stats.heap_used_bytes > 0,
+                "Acquired tenant should be resident and busy") &&
+         Expect(DartVmEmbed_TenantRelease(manager, "a") ==
+                    DARTVM_EMBED_STATUS_OK,
+                "TenantRelease should succeed") &&
+         pass;
+
+  Dart_Isolate again = nullptr;
+  pass = Expect(DartVmEmbed_TenantAcquire(manager, "a", &again) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    again == first,
+                "A resident tenant should hand out the same isolate") &&
+         pass;
+
+  DartVmEmbed_ShutdownIsolateByHandle(again);
+  pass = Expect(TenantStats(manager, "a", &stats) && !stats.resident &&
+                    stats.heap_used_bytes == 0,
+                "A tenant whose isolate shut down should not be resident") &&
+         Expect(DartVmEmbed_TenantRelease(manager, "a") ==
+                    DARTVM_EMBED_STATUS_OK,
+                "Releasing a tenant whose isolate died should succeed") &&
+         pass;
+
+  Dart_Isolate recreated = nullptr;
+  pass = Expect(DartVmEmbed_TenantAcquire(manager, "a", &recreated) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    recreated != nullptr,
+                "TenantAcquire should recreate a dead isolate") &&
+         Expect(RunMain(recreated), "Recreated isolate should run main") &&
+         Expect(TenantStats(manager, "a", &stats) && stats.resident &&
+                    stats.creations == 2,
+                "Recreation should be counted") &&
+         Expect(DartVmEmbed_TenantRelease(manager, "a") ==
+                    DARTVM_EMBED_STATUS_OK,
+                "TenantRelease should succeed") &&
+         pass;
+
+  DartVmEmbed_TenantManagerDestroy(manager);
+  return pass;
+}
+
+// A one-byte quota kills the tenant on release; a one-byte RSS watermark
+// evicts every idle tenant. Both come back on the next acquire.
+bool TestTenantQuotaAndEviction() {
+  DartVmEmbedTenantManagerConfig config;
+  config.rss_watermark_bytes = 1;
+  DartVmEmbedTenantManager* manager = nullptr;
+  if (!Expect(DartVmEmbed_TenantManagerCreate(&config, &manager) ==
+                  DARTVM_EMBED_STATUS_OK,
+              "TenantManagerCreate should succeed")) {
+    return false;
+  }
+  bool pass =
+      Expect(DartVmEmbed_TenantRegister(manager, "quota", kKernelPath,
+                                        kSourcePath, 1) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 DartVmEmbed_TenantRegister(manager, "idle", kKernelPath,
+                                            kSourcePath, 0) ==
+                     DARTVM_EMBED_STATUS_OK,
+             "TenantRegister should succeed");
+
+  DartVmEmbedTenantStats stats;
+  Dart_Isolate isolate = nullptr;
+  pass = Expect(DartVmEmbed_TenantAcquire(manager, "quota", &isolate) ==
+                    DARTVM_EMBED_STATUS_OK,
+                "TenantAcquire should succeed") &&
+         Expect(RunMain(isolate), "Tenant isolate should run main") &&
+         Expect(DartVmEmbed_TenantRelease(manager, "quota") ==
+                    DARTVM_EMBED_STATUS_QUOTA_EXCEEDED,
+                "Release over quota should report QUOTA_EXCEEDED") &&
+         Expect(TenantStats(manager, "quota", &stats) && !stats.resident &&
+                    stats.quota_kills == 1,
+                "Quota kill should shut the isolate down") &&
+         Expect(DartVmEmbed_TenantAcquire(manager, "quota", &isolate) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    isolate != nullptr,
+                "TenantAcquire should recreate a quota-killed tenant") &&
+         Expect(TenantStats(manager, "quota", &stats) &&
+                    stats.creations == 2,
+                "Recreation after a quota kill should be counted") &&
+         Expect(DartVmEmbed_TenantRelease(manager, "quota") ==
+                    DARTVM_EMBED_STATUS_QUOTA_EXCEEDED,
+                "Release over quota should report QUOTA_EXCEEDED") &&
+         pass;
+
+  pass = Expect(DartVmEmbed_TenantAcquire(manager, "idle", &isolate) ==
+                    DARTVM_EMBED_STATUS_OK,
+                "TenantAcquire should succeed") &&
+         Expect(DartVmEmbed_TenantRelease(manager, "idle") ==
+                    DARTVM_EMBED_STATUS_OK,
+                "TenantRelease should succeed") &&
+         Expect(TenantStats(manager, "idle", &stats) && !stats.resident &&
+                    stats.evictions == 1,
+                "An idle tenant above the RSS watermark should be evicted") &&
+         Expect(DartVmEmbed_TenantAcquire(manager, "idle", &isolate) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    isolate != nullptr,
+                "TenantAcquire should recreate an evicted tenant") &&
+         Expect(DartVmEmbed_TenantRelease(manager, "idle") ==
+                    DARTVM_EMBED_STATUS_OK,
+                "TenantRelease should succeed") &&
+         pass;
+
+  DartVmEmbed_TenantManagerDestroy(manager);
+  return pass;
+}
+
+}  // namespace
+
+// An entry that never returns is killed at its deadline, and the host can
+// shut that isolate down and keep running others.
+bool TestDeadlineKillsRunawayEntry() {
+  Dart_Isolate isolate = CreateFromKernel("deadline");
+  if (!Expect(isolate != nullptr, "Kernel isolate for the deadline test")) {
+    return false;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const DartVmEmbedStatus status =
+      DartVmEmbed_RunRootEntryOnIsolateWithDeadline(isolate, "spin",
+                                                    50 * 1000 * 1000);
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const bool timeout_pass =
+      Expect(status == DARTVM_EMBED_STATUS_TIMEOUT,
+             "A runaway entry should end with TIMEOUT") &&
+      Expect(DartVmEmbed_LastStatus() == DARTVM_EMBED_STATUS_TIMEOUT &&
+                 DartVmEmbed_LastErrorMessage()[0] != '\0',
+             "LastStatus should report the deadline kill") &&
+      Expect(elapsed < std::chrono::seconds(10),
+             "The deadline kill should not wait for the entry");
+  DartVmEmbed_ShutdownIsolateByHandle(isolate);
+
+  Dart_Isolate next = CreateFromKernel("after_deadline");
+  const bool next_pass =
+      Expect(next != nullptr, "Isolates should still start after a kill") &&
+      Expect(RunMain(next), "Isolates should still run after a kill");
+  if (next != nullptr) {
+    DartVmEmbed_ShutdownIsolateByHandle(next);
+  }
+  return timeout_pass && next_pass;
+}
+
+DartVmEmbedValue IntValue(int64_t value) {
+  DartVmEmbedValue result;
+  result.type = DARTVM_EMBED_VALUE_INT64;
+  result.as_int64 = value;
+  return result;
+}
+
+DartVmEmbedValue DoubleValue(double value) {
+  DartVmEmbedValue result;
+  result.type = DARTVM_EMBED_VALUE_DOUBLE;
+  result.as_double = value;
+  return result;
+}
+
+DartVmEmbedValue NullValue() {
+  DartVmEmbedValue result;
+  result.type = DARTVM_EMBED_VALUE_NULL;
+  result.as_int64 = 0;
+  return result;
+}
+
+// Every call of a batch reaches the Dart function with its own arguments,
+// across a scope recycle, and a failing call stops the batch.
+bool TestInvokeBatch() {
+  Dart_Isolate isolate = CreateFromKernel("batch");
+  if (!Expect(isolate != nullptr, "Kernel isolate for the batch test")) {
+    return false;
+  }
+  const intptr_t kCalls = 10;
+  std::vector<DartVmEmbedValue> args;
+  for (intptr_t i = 0; i < kCalls; ++i) {
+    args.push_back(IntValue(i));
+    args.push_back(IntValue(100 * i));
+  }
+  std::vector<DartVmEmbedValue> results(kCalls);
+  intptr_t completed = -1;
+  bool add_pass =
+      Expect(DartVmEmbed_InvokeBatch(isolate, "add", args.data(), 2, kCalls,
+                                     results.data(), 3, &completed) ==
+                 DARTVM_EMBED_STATUS_OK,
+             "InvokeBatch should call add") &&
+      Expect(completed == kCalls, "InvokeBatch should complete every call");
+  for (intptr_t i = 0; add_pass && i < kCalls; ++i) {
+    add_pass = Expect(results[i].type == DARTVM_EMBED_VALUE_INT64 &&
+                          results[i].as_int64 == 101 * i,
+                      "InvokeBatch should return each call's sum");
+  }
+
+  const DartVmEmbedValue scale_args[] = {IntValue(3), DoubleValue(0.5)};
+  DartVmEmbedValue scale_result = NullValue();
+  const DartVmEmbedValue even_args[] = {IntValue(4), IntValue(7)};
+  DartVmEmbedValue even_results[2] = {NullValue(), NullValue()};
+  const bool types_pass =
+      Expect(DartVmEmbed_InvokeBatch(isolate, "scale", scale_args, 2, 1,
+                                     &scale_result, 0, nullptr) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 scale_result.type == DARTVM_EMBED_VALUE_DOUBLE &&
+                 scale_result.as_double == 1.5,
+             "InvokeBatch should pass and return doubles") &&
+      Expect(DartVmEmbed_InvokeBatch(isolate, "isEven", even_args, 1, 2,
+                                     even_results, 0, nullptr) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 even_results[0].type == DARTVM_EMBED_VALUE_BOOL &&
+                 even_results[0].as_bool &&
+                 even_results[1].type == DARTVM_EMBED_VALUE_BOOL &&
+                 !even_results[1].as_bool,
+             "InvokeBatch should return bools");
+
+  // null is not an int, so the second call throws.
+  const DartVmEmbedValue bad_args[] = {IntValue(1), IntValue(2), NullValue(),
+                                       IntValue(2), IntValue(5), IntValue(6)};
+  DartVmEmbedValue bad_results[3] = {NullValue(), NullValue(), NullValue()};
+  completed = -1;
+  const bool failure_pass =
+      Expect(DartVmEmbed_InvokeBatch(isolate, "add", bad_args, 2, 3,
+                                     bad_results, 0, &completed) !=
+                 DARTVM_EMBED_STATUS_OK,
+             "InvokeBatch should report a throwing call") &&
+      Expect(completed == 1 && bad_results[0].as_int64 == 3,
+             "InvokeBatch should stop at the first failure") &&
+      Expect(DartVmEmbed_InvokeBatch(isolate, "missing", bad_args, 0, 1,
+                                     bad_results, 0, nullptr) !=
+                 DARTVM_EMBED_STATUS_OK,
+             "InvokeBatch should reject an unknown function");
+  DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  return add_pass && types_pass && failure_pass;
+}
+
+// A prepared call keeps working across invocations, and one whose isolate
+// has shut down fails cleanly and can still be released.
+bool TestPreparedCall() {
+  Dart_Isolate isolate = CreateFromKernel("prepared");
+  if (!Expect(isolate != nullptr, "Kernel isolate for the prepared call test")) {
+    return false;
+  }
+  DartVmEmbedPreparedCall* add = nullptr;
+  DartVmEmbedPreparedCall* scale = nullptr;
+  DartVmEmbedPreparedCall* identical = nullptr;
+  DartVmEmbedPreparedCall* field = nullptr;
+  bool prepare_pass =
+      Expect(DartVmEmbed_PrepareCall(isolate, nullptr, "add", &add) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 add != nullptr,
+             "PrepareCall should resolve a root-library function") &&
+      Expect(DartVmEmbed_PrepareCall(isolate, nullptr, "scale", &scale) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 scale != nullptr,
+             "PrepareCall should resolve a second function") &&
+      Expect(DartVmEmbed_PrepareCall(isolate, "dart:core", "identical",
+                                     &identical) == DARTVM_EMBED_STATUS_OK &&
+                 identical != nullptr,
+             "PrepareCall should resolve a function by library URI") &&
+      Expect(DartVmEmbed_PrepareCall(isolate, nullptr, "answer", &field) ==
+                     DARTVM_EMBED_STATUS_INVALID_ARGUMENT &&
+                 field == nullptr,
+             "PrepareCall should reject a target that is not a function") &&
+      Expect(DartVmEmbed_PrepareCall(isolate, nullptr, "missing", &field) !=
+                     DARTVM_EMBED_STATUS_OK &&
+                 field == nullptr,
+             "PrepareCall should reject an unknown function");
+  if (!prepare_pass) {
+    DartVmEmbed_ReleasePreparedCall(add);
+    DartVmEmbed_ReleasePreparedCall(scale);
+    DartVmEmbed_ReleasePreparedCall(identical);
+    DartVmEmbed_ReleasePreparedCall(field);
+    DartVmEmbed_ShutdownIsolateByHandle(isolate);
+    return false;
+  }
+
+  bool invoke_pass = true;
+  for (int64_t i = 0; invoke_pass && i < 5; ++i) {
+    const DartVmEmbedValue args[] = {IntValue(i), IntValue(i * i)};
+    DartVmEmbedValue result = NullValue();
+    invoke_pass = Expect(DartVmEmbed_InvokePrepared(add, args, 2, &result) ==
+                                 DARTVM_EMBED_STATUS_OK &&
+                             result.type == DARTVM_EMBED_VALUE_INT64 &&
+                             result.as_int64 == i + i * i,
+                         "InvokePrepared should return add's sum");
+  }
+  const DartVmEmbedValue scale_args[] = {IntValue(4), DoubleValue(0.25)};
+  DartVmEmbedValue scale_result = NullValue();
+  const DartVmEmbedValue same_args[] = {IntValue(3), IntValue(3)};
+  DartVmEmbedValue same_result = NullValue();
+  const DartVmEmbedValue bad_args[] = {NullValue(), IntValue(1)};
+  invoke_pass =
+      invoke_pass &&
+      Expect(DartVmEmbed_InvokePrepared(scale, scale_args, 2, &scale_result) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 scale_result.type == DARTVM_EMBED_VALUE_DOUBLE &&
+                 scale_result.as_double == 1.0,
+             "InvokePrepared should return scale's product") &&
+      Expect(DartVmEmbed_InvokePrepared(identical, same_args, 2,
+                                        &same_result) ==
+                     DARTVM_EMBED_STATUS_OK &&
+                 same_result.type == DARTVM_EMBED_VALUE_BOOL &&
+                 same_result.as_bool,
+             "InvokePrepared should call into other libraries") &&
+      Expect(DartVmEmbed_InvokePrepared(add, bad_args, 2, nullptr) !=
+                 DARTVM_EMBED_STATUS_OK,
+             "InvokePrepared should report a throwing call") &&
+      Expect(DartVmEmbed_InvokePrepared(add, scale_args, 1, nullptr) !=
+                 DARTVM_EMBED_STATUS_OK,
+             "InvokePrepared should report a wrong argument count");
+
+  // Released while the isolate is alive; add and identical outlive it.
+  DartVmEmbed_ReleasePreparedCall(scale);
+  DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  const DartVmEmbedValue args[] = {IntValue(1), IntValue(2)};
+  const bool detached_pass =
+      Expect(DartVmEmbed_InvokePrepared(add, args, 2, nullptr) ==
+                 DARTVM_EMBED_STATUS_INVALID_ARGUMENT,
+             "InvokePrepared should fail once the isolate has shut down");
+  DartVmEmbed_ReleasePreparedCall(add);
+  DartVmEmbed_ReleasePreparedCall(identical);
+  return invoke_pass && detached_pass;
+}
+
+bool ReadVarint(const uint8_t** p, const uint8_t* end, uint64_t* out) {
+  *out = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const uint8_t byte = *(*p)++;
+    *out |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Top-level fields of an encoded pprof Profile message.
+struct PprofSummary {
+  int sample_types = 0;
+  int samples = 0;
+  std::vector<std::string> strings;
+};
+
+// Checks that data is well-formed protobuf wire format and that every Sample
+// (field 2) is itself well-formed.
+bool ParseProtobuf(const uint8_t* p, const uint8_t* end, PprofSummary* out) {
+  while (p < end) {
+    uint64_t key = 0;
+    if (!ReadVarint(&p, end, &key)) {
+      return false;
+    }
+    uint64_t value = 0;
+    switch (key & 7) {
+      case 0:
+        if (!ReadVarint(&p, end, &value)) {
+          return false;
+        }
+        break;
+      case 1:
+        if (end - p < 8) {
+          return false;
+        }
+        p += 8;
+        break;
+      case 5:
+        if (end - p < 4) {
+          return false;
+        }
+        p += 4;
+        break;
+      case 2: {
+        if (!ReadVarint(&p, end, &value) ||
+            value > static_cast<uint64_t>(end - p)) {
+          return false;
+        }
+        const uint8_t* field = p;
+        p += value;
+        if (out == nullptr) {
+          break;
+        }
+        if ((key >> 3) == 1) {
+          ++out->sample_types;
+        } else if ((key >> 3) == 2) {
+          ++out->samples;
+          if (!ParseProtobuf(field, p, nullptr)) {
+            return false;
+          }
+        } else if ((key >> 3) == 6) {
+          out->strings.emplace_back(reinterpret_cast<const char*>(field),
+                                    static_cast<size_t>(value));
+        }
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool ParsePprof(const std::string& path, PprofSummary* out) {
+  std::vector<uint8_t> data;
+  return ReadFile(path.c_str(), &data) &&
+         ParseProtobuf(data.data(), data.data() + data.size(), out);
+}
+
+bool HasString(const PprofSummary& summary, const char* text) {
+  for (const std::string& entry : summary.strings) {
+    if (entry == text) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sampling catches allocations made by Dart code, and the pprof dump is a
+// well-formed profile carrying them.
+bool TestHeapSamplingProfile() {
+  char dir_template[] = "/tmp/dartvm_embed_live_heap_XXXXXX";
+  const char* dir = mkdtemp(dir_template);
+  if (!Expect(dir != nullptr, "mkdtemp should succeed")) {
+    return false;
+  }
+  const std::string path = std::string(dir) + "/heap.pb.raw";
+  Dart_Isolate isolate = CreateFromKernel("heap_sampling");
+  bool pass = Expect(isolate != nullptr, "Kernel isolate for heap sampling");
+
+  DartVmEmbedHeapSamplingConfig config;
+  config.sampling_interval_bytes = 4 * 1024;
+  pass = pass && Expect(DartVmEmbed_StartHeapSampling(&config) ==
+                            DARTVM_EMBED_STATUS_OK,
+                        "StartHeapSampling should succeed");
+  DartVmEmbedValue result = NullValue();
+  pass = pass && Expect(DartVmEmbed_InvokeBatch(isolate, "allocate", nullptr,
+                                                0, 1, &result, 0, nullptr) ==
+                                DARTVM_EMBED_STATUS_OK &&
+                            result.as_int64 == 640000,
+                        "allocate() should run while sampling");
+  DartVmEmbedHeapSamplingStats stats;
+  pass = Expect(DartVmEmbed_StopHeapSampling() == DARTVM_EMBED_STATUS_OK,
+                "StopHeapSampling should succeed") &&
+         pass &&
+         Expect(DartVmEmbed_GetHeapSamplingStats(&stats) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    !stats.active && stats.samples_total > 0 &&
+                    stats.stacks > 0,
+                "Sampling should record allocations");
+
+  PprofSummary summary;
+  pass = pass &&
+         Expect(DartVmEmbed_WriteHeapProfilePprof(path.c_str()) ==
+                    DARTVM_EMBED_STATUS_OK,
+                "WriteHeapProfilePprof should succeed") &&
+         Expect(ParsePprof(path, &summary),
+                "The heap profile should be well-formed protobuf") &&
+         Expect(summary.sample_types == 4 && summary.samples > 0,
+                "The heap profile should carry four values per sample") &&
+         Expect(HasString(summary, "alloc_space") &&
+                    HasString(summary, "inuse_space"),
+                "The heap profile should name its sample types");
+  if (isolate != nullptr) {
+    DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  }
+  std::error_code ignored;
+  std::filesystem::remove_all(dir, ignored);
+  return pass;
+}
+
+// Samples taken while Dart code runs reach both dump formats. The dumps go
+// through the service isolate and are answered by the isolate's message
+// loop, which runs on another thread meanwhile.
+bool TestCpuProfileDump() {
+  char dir_template[] = "/tmp/dartvm_embed_live_cpu_XXXXXX";
+  const char* dir = mkdtemp(dir_template);
+  if (!Expect(dir != nullptr, "mkdtemp should succeed")) {
+    return false;
+  }
+  const std::string pprof_path = std::string(dir) + "/cpu.pb.raw";
+  const std::string collapsed_path = std::string(dir) + "/cpu.collapsed";
+  Dart_Isolate isolate = CreateFromKernel("cpu_profile");
+  if (!Expect(isolate != nullptr, "Kernel isolate for CPU profiling")) {
+    std::error_code ignored;
+    std::filesystem::remove_all(dir, ignored);
+    return false;
+  }
+
+  DartVmEmbedCpuProfileConfig config;
+  config.sample_period_us = 250;
+  bool pass = Expect(DartVmEmbed_StartCpuProfile(&config) ==
+                         DARTVM_EMBED_STATUS_OK,
+                     "StartCpuProfile should succeed");
+  const DartVmEmbedValue burn_args[] = {IntValue(300)};
+  DartVmEmbedValue burned = NullValue();
+  DartVmEmbedValue port = NullValue();
+  pass = pass &&
+         Expect(DartVmEmbed_InvokeBatch(isolate, "burn", burn_args, 1, 1,
+                                        &burned, 0, nullptr) ==
+                    DARTVM_EMBED_STATUS_OK,
+                "burn() should run while profiling") &&
+         Expect(DartVmEmbed_InvokeBatch(isolate, "openPort", nullptr, 0, 1,
+                                        &port, 0, nullptr) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    port.type == DARTVM_EMBED_VALUE_INT64,
+                "openPort() should return a port");
+  std::thread loop;
+  if (pass) {
+    loop = std::thread([isolate] {
+      char* error = nullptr;
+      DartVmEmbed_RunLoopOnIsolate(isolate, &error);
+      free(error);
+    });
+  }
+
+  PprofSummary summary;
+  std::vector<uint8_t> collapsed;
+  pass = pass &&
+         Expect(DartVmEmbed_DumpCpuProfile(isolate, pprof_path.c_str(),
+                                           DARTVM_EMBED_CPU_PROFILE_PPROF,
+                                           /*clear_samples=*/false) ==
+                    DARTVM_EMBED_STATUS_OK,
+                "DumpCpuProfile should write pprof") &&
+         Expect(ParsePprof(pprof_path, &summary),
+                "The CPU profile should be well-formed protobuf") &&
+         Expect(summary.sample_types == 2 && summary.samples > 0 &&
+                    HasString(summary, "samples") && HasString(summary, "cpu"),
+                "The CPU profile should carry samples") &&
+         Expect(DartVmEmbed_DumpCpuProfile(isolate, collapsed_path.c_str(),
+                                           DARTVM_EMBED_CPU_PROFILE_COLLAPSED,
+                                           /*clear_samples=*/true) ==
+                    DARTVM_EMBED_STATUS_OK,
+                "DumpCpuProfile should write collapsed stacks") &&
+         Expect(ReadFile(collapsed_path.c_str(), &collapsed),
+                "The collapsed profile should not be empty");
+  if (pass) {
+    const std::string text(collapsed.begin(), collapsed.end());
+    const size_t line_end = text.find('\n');
+    const size_t count_start = text.rfind(' ', line_end);
+    pass = Expect(line_end != std::string::npos &&
+                      count_start != std::string::npos &&
+                      atoll(text.c_str() + count_start + 1) > 0,
+                  "Collapsed lines should end with a sample count") &&
+           Expect(text.find("burn") != std::string::npos,
+                  "The collapsed profile should include burn()");
+  }
+
+  if (loop.joinable()) {
+    Dart_PostInteger(port.as_int64, 0);
+    loop.join();
+  }
+  pass = Expect(DartVmEmbed_StopCpuProfile() == DARTVM_EMBED_STATUS_OK,
+                "StopCpuProfile should succeed") &&
+         pass;
+  DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  std::error_code ignored;
+  std::filesystem::remove_all(dir, ignored);
+  return pass;
+}
+
+int64_t InvokeInt(Dart_Isolate isolate, const char* function_name) {
+  DartVmEmbedValue result = NullValue();
+  if (DartVmEmbed_InvokeBatch(isolate, function_name, nullptr, 0, 1, &result,
+                              0, nullptr) != DARTVM_EMBED_STATUS_OK ||
+      result.type != DARTVM_EMBED_VALUE_INT64) {
+    return -1;
+  }
+  return result.as_int64;
+}
+
+bool FdReadable(int fd, int timeout_ms) {
+  pollfd entry = {fd, POLLIN, 0};
+  return poll(&entry, 1, timeout_ms) == 1 && (entry.revents & POLLIN) != 0;
+}
+
+// Host-driven delivery: posts signal the notify fd, HandlePendingMessages
+// runs the Dart handlers, and PumpMessages honours max_messages.
+bool TestMessagePumpDelivery() {
+  Dart_Isolate isolate = CreateFromKernel("pump");
+  if (!Expect(isolate != nullptr, "Kernel isolate for the pump test")) {
+    return false;
+  }
+  const int64_t port = InvokeInt(isolate, "openCounter");
+  const int fd = DartVmEmbed_GetMessageNotifyFd(isolate);
+  bool pass = Expect(port > 0, "openCounter() should return a port") &&
+              Expect(fd >= 0, "GetMessageNotifyFd should return an eventfd") &&
+              Expect(DartVmEmbed_GetMessageNotifyFd(isolate) == fd,
+                     "GetMessageNotifyFd should return the same fd");
+  if (!pass) {
+    DartVmEmbed_ShutdownIsolateByHandle(isolate);
+    return false;
+  }
+
+  // Earlier calls may leave a surplus count; settle it first.
+  if (FdReadable(fd, 0)) {
+    DartVmEmbed_HandlePendingMessages(isolate);
+  }
+  pass = Expect(!FdReadable(fd, 0), "The fd should be quiet with no posts");
+  for (int64_t i = 1; i <= 3; ++i) {
+    Dart_PostInteger(port, i);
+  }
+  pass = pass &&
+         Expect(FdReadable(fd, 5000), "A post should signal the fd") &&
+         Expect(DartVmEmbed_HandlePendingMessages(isolate) ==
+                    DARTVM_EMBED_STATUS_OK,
+                "HandlePendingMessages should succeed") &&
+         Expect(!FdReadable(fd, 0),
+                "HandlePendingMessages should drain the fd") &&
+         Expect(InvokeInt(isolate, "receivedCount") == 3 &&
+                    InvokeInt(isolate, "receivedSum") == 6,
+                "HandlePendingMessages should deliver every post");
+
+  Dart_PostInteger(port, 10);
+  Dart_PostInteger(port, 20);
+  int64_t remaining = -1;
+  pass = pass &&
+         Expect(DartVmEmbed_PumpMessages(isolate, 0, 1, &remaining) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    remaining >= 1,
+                "PumpMessages should stop at max_messages") &&
+         Expect(InvokeInt(isolate, "receivedCount") == 4,
+                "PumpMessages should deliver one message") &&
+         Expect(DartVmEmbed_PumpMessages(isolate, 0, 0, &remaining) ==
+                        DARTVM_EMBED_STATUS_OK &&
+                    remaining == 0,
+                "PumpMessages should drain the queue") &&
+         Expect(InvokeInt(isolate, "receivedCount") == 5 &&
+                    InvokeInt(isolate, "receivedSum") == 36,
+                "PumpMessages should deliver the rest");
+  DartVmEmbed_ShutdownIsolateByHandle(isolate);
+  return pass;
+}
+
+int main() {
+  if (!ReadFile(kKernelPath, &g_kernel)) {
+    std::cerr << "[FAIL] cannot read " << kKernelPath << "\n";
+    return 1;
+  }
+
+  const char* vm_flags[] = {"--no-verify_sdk_hash"};
+  DartVmEmbedInitConfig config;
+  config.vm_flag_count = 1;
+  config.vm_flags = vm_flags;
+  char* error = nullptr;
+  if (!DartVmEmbed_Initialize(&config, &error)) {
+    std::cerr << "[FAIL] Initialize: " << (error ? error : "") << "\n";
+    free(error);
+    return 1;
+  }
+
+  bool ok = true;
+  ok = TestLazyKernelServiceStart() && ok;
+  ok = TestSourceCompileAfterIdle() && ok;
+  ok = TestAppJitSaveAndLoad() && ok;
+  ok = TestTenantAcquireAndRecreate() && ok;
+  ok = TestTenantQuotaAndEviction() && ok;
+  ok = TestDeadlineKillsRunawayEntry() && ok;
+  ok = TestInvokeBatch() && ok;
+  ok = TestPreparedCall() && ok;
+  ok = TestHeapSamplingProfile() && ok;
+  ok = TestCpuProfileDump() && ok;
+  ok = TestMessagePumpDelivery() && ok;
+
+  error = nullptr;
+  ok = Expect(DartVmEmbed_Cleanup(&error), "Cleanup should succeed") && ok;
+  free(error);
+
+  if (!ok) {
+    return 1;
+  }
+  std::cout << "[PASS] dartvm_embed_lib_live_jit\n";
+  return 0;
+}